@@ -0,0 +1,56 @@
+#include "TimerExecutor.h"
+using namespace lsc;
+
+/**
+ *   Run one handler that blocks for BLOCK milliseconds on a TimerExecutor with WORKERS worker threads, alongside JOBS short
+ *   one-shot timers due every SPACING milliseconds. The blocking handler may hold one worker, but no short job may be
+ *   queued behind it while the other worker is free, so each must run within LATE milliseconds of its deadline. Prints
+ *   PASS or FAIL, so it may be run on a board or, with a host Arduino core, as a test.
+ */
+#if defined(__linux__) || defined(ESP32)
+
+#include <chrono>
+
+#define WORKERS  2
+#define BLOCK    1000                          // Milliseconds the blocking handler holds its worker
+#define JOBS     20
+#define SPACING  10                            // Milliseconds between short job deadlines
+#define START    20                            // Milliseconds before the first short job is due
+#define LATE     50                            // Most milliseconds a short job may run after its deadline
+
+std::atomic<unsigned long> ran[JOBS];
+std::atomic<int>           done{0};
+
+void setup() {
+  Serial.begin(115200);
+  while (!Serial) {
+    ; // wait for serial port to connect. Needed for native USB port only
+  }
+  Serial.println();
+
+  TimerExecutor executor(WORKERS,64);
+  unsigned long start = millis();
+  executor.schedule(1,[]{std::this_thread::sleep_for(std::chrono::milliseconds(BLOCK));done++;});
+  for( int i=0; i<JOBS; i++ ) executor.schedule(START+i*SPACING,[i]{ran[i] = millis();done++;});
+  while( done.load() < JOBS+1 ) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+  unsigned long worst = 0;
+  for( int i=0; i<JOBS; i++ ) {
+    unsigned long late = ran[i].load() - (start+START+i*SPACING);
+    if( (long)late > (long)worst ) worst = late;
+  }
+  bool pass = (worst <= LATE);
+  Serial.printf("%d jobs beside a %d ms handler on %d workers, worst %lu ms late: %s\n",JOBS,BLOCK,WORKERS,worst,((pass)?("PASS"):("FAIL")));
+}
+
+#else
+
+void setup() {
+  Serial.begin(115200);
+  Serial.printf("\nTimerExecutor needs std::thread (Linux or ESP32)\n");
+}
+
+#endif
+
+void loop() {
+}
@@ -0,0 +1,52 @@
+
+#include "SystemClock.h"
+#include "FleetSimulation.h"
+using namespace lsc;
+
+/**
+ *   10,000 devices reboot at once (a power cut) against one NTP server answering 5000 queries per second with a 200 ms
+ *   queue, then again with boots spread over 10 minutes, and again all at once behind a rate limit. The per interval peaks
+ *   show the herd returning every sync interval until it disperses. The library must be built with LSC_SIMULATION defined,
+ *   e.g. build_flags = -DLSC_SIMULATION in platformio.ini, for Linux (a host Arduino core) or an ESP32 with fewer devices.
+ */
+#if defined(LSC_SIMULATION) && (defined(__linux__) || defined(ESP32))
+
+#define HOURS 3
+
+void simulate(const char* title, double bootSpread, double rate) {
+  ServerModel  net;
+  net.loss          = 0.01;
+  FleetServer  server(net,5000.0,0.2,HOURS*3600.0,rate,100);
+  FleetModel   fleet;
+  fleet.devices     = 10000;
+  fleet.bootSpread  = bootSpread;
+  fleet.syncMinutes = 15;
+  FleetReport  report;
+  FleetSimulation::run(fleet,server,HOURS*3600.0,report);
+
+  Serial.printf("\n%s:\n",title);
+  report.print(Serial,server,fleet.syncMinutes*60.0);
+}
+
+void setup() {
+  Serial.begin(115200);
+  while (!Serial) {
+    ; // wait for serial port to connect. Needed for native USB port only
+  }
+  Serial.println();
+  simulate("All devices boot at once",0.0,0.0);
+  simulate("Boots spread over 10 minutes",600.0,0.0);
+  simulate("All at once, server limited to 2000 queries per second",0.0,2000.0);
+}
+
+#else
+
+void setup() {
+  Serial.begin(115200);
+  Serial.printf("\nBuild with -DLSC_SIMULATION on Linux or ESP32 to run the fleet simulation\n");
+}
+
+#endif
+
+void loop() {
+}
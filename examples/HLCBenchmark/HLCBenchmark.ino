@@ -0,0 +1,77 @@
+
+#include "SystemClock.h"
+#include "HLC.h"
+using namespace lsc;
+
+#ifdef ESP8266
+#include <ESP8266WiFi.h>
+#define BOARD   "ESP8266"
+#define THREADS 1
+#elif defined(ESP32)
+#include <WiFi.h>
+#include <thread>
+#define BOARD   "ESP32"
+#define THREADS 2
+#endif
+
+#define AP_SSID "MySSID"
+#define AP_PSK  "MyPSK"
+
+#define ITERATIONS 200000UL
+
+SystemClock   c;
+HLC           hlc(c);
+
+/**
+ *   Issue ITERATIONS timestamps, merging a simulated remote timestamp every 16th call, and count any
+ *   timestamp that fails to increase.
+ */
+void runHLC(unsigned long& errors) {
+  uint64_t previous = 0;
+  errors = 0;
+  for( unsigned long i=0; i<ITERATIONS; i++ ) {
+    uint64_t t = (((i&15)==0)?(hlc.update(hlc.last()+1)):(hlc.now()));
+    if( t <= previous ) errors++;
+    previous = t;
+  }
+}
+
+void setup() {
+  Serial.begin(115200);
+  while (!Serial) {
+    ; // wait for serial port to connect. Needed for native USB port only
+  }
+
+  Serial.println();
+  Serial.printf("Starting HLC Benchmark for Board %s\n",BOARD);
+
+  WiFi.begin(AP_SSID,AP_PSK);
+  Serial.printf("Connecting to Access Point %s\n",AP_SSID);
+  while(WiFi.status() != WL_CONNECTED) {Serial.print(".");delay(500);}
+  c.updateSysTime();
+
+  unsigned long errors[THREADS];
+  unsigned long start = micros();
+#if THREADS > 1
+  std::thread workers[THREADS];
+  for( int i=0; i<THREADS; i++ ) workers[i] = std::thread(runHLC,std::ref(errors[i]));
+  for( int i=0; i<THREADS; i++ ) workers[i].join();
+#else
+  runHLC(errors[0]);
+#endif
+  unsigned long elapsed = micros() - start;
+
+  unsigned long total = 0;
+  for( int i=0; i<THREADS; i++ ) total += errors[i];
+  double rate = (double)(THREADS*ITERATIONS)/((double)elapsed/1000000.0);
+  Serial.printf("%d threads issued %lu timestamps in %lu us (%.0f per second), ordering errors = %lu\n",THREADS,THREADS*ITERATIONS,elapsed,rate,total);
+
+  char buff[64];
+  HLCTimestamp last = HLCTimestamp::decode(hlc.last());
+  last.toInstant(c.sysTime()).printDateTime(buff,64);
+  Serial.printf("Last HLC timestamp %s logical %u\n",buff,last.logical());
+}
+
+void loop() {
+  c.doDevice();
+}
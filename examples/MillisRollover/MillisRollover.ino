@@ -0,0 +1,163 @@
+#include "Timer.h"
+#include "TimerService.h"
+#include "Simulation.h"
+using namespace lsc;
+
+/**
+ *   Drive a Deadline, periodic and one-shot Timers, and periodic and one-shot TimerService timers on a simulated device
+ *   through WRAPS rollovers of its 32-bit millis(), once with the tick counter starting at millis() == 0 and once starting
+ *   just short of the first rollover. Virtual time moves in 1 second steps, slowing to 1 millisecond steps within WINDOW
+ *   milliseconds of each rollover, so the test covers WRAPS * 49.7 days in a few seconds. Every expiry is checked against
+ *   the unwrapped tick count: nothing may fire early, nothing may fire more than one step late, and nothing may be
+ *   missed. The library must be built with LSC_SIMULATION defined. Prints PASS or FAIL, so it may be run on a board or,
+ *   with a host Arduino core, as a test.
+ */
+#ifdef LSC_SIMULATION
+
+#define WRAPS    3
+#define WINDOW   10000ULL                      // Milliseconds either side of a rollover run in 1 ms steps
+#define PERIOD   60000UL                       // Periodic Timer set point
+#define ONESHOT  7000UL                        // One-shot Timer set point, restarted from its handler
+#define SPAN     4000UL                        // Deadline duration, started SPAN/2 before each rollover
+#define ROLLOVER 4294967296ULL
+
+typedef struct Check {
+  uint64_t       periodicStart = 0;             // Unwrapped milliseconds the periodic Timer started
+  uint64_t       periodicFires = 0;
+  uint64_t       oneShotStart  = 0;             // Unwrapped milliseconds the one-shot Timer last started
+  uint64_t       oneShotFires  = 0;
+  uint64_t       wheelStart    = 0;             // Unwrapped milliseconds the TimerService timers were scheduled
+  uint64_t       wheelFires    = 0;
+  uint64_t       wheelOneStart = 0;             // Unwrapped milliseconds the one-shot TimerService timer was last scheduled
+  uint64_t       wheelOneFires = 0;
+  uint64_t       deadlineStart = 0;
+  uint64_t       deadlineWrap  = 0;             // Rollover the Deadline was started ahead of
+  uint64_t       deadlines     = 0;             // Deadlines checked across a rollover
+  uint64_t       errors        = 0;
+  uint64_t       now           = 0;             // Unwrapped milliseconds on the tick counter
+  uint64_t       step          = 1000;          // Milliseconds of the last step
+  TimerService*  wheel         = NULL;
+} Check;
+
+uint64_t ticks(const SimulatedDevice& d, double base) {return (uint64_t)(int64_t)floor((base + d.now())*1000.0);}
+
+void error(Check& c, const char* what, uint64_t now, uint64_t due) {
+  if( c.errors++ < 10 ) Serial.printf("  %s at %llu ms, due %llu ms\n",what,(unsigned long long)now,(unsigned long long)due);
+}
+
+/**
+ *   The one-shot TimerService timer reschedules itself from its handler, as the one-shot Timer restarts.
+ */
+void wheelOneShot(Check& c) {
+  uint64_t due = c.wheelOneStart + ONESHOT;
+  if( (c.now < due) || (c.now > due + c.step) ) error(c,"service one-shot fired",c.now,due);
+  c.wheelOneFires++;
+  c.wheelOneStart = c.now;
+  c.wheel->schedule(ONESHOT,[&c]{wheelOneShot(c);});
+}
+
+bool rollover(double base) {
+  ServerModel      net;
+  OscillatorModel  xtal;
+  xtal.ticks = base;                           // No oscillator error, so millis() is the true time plus base, wrapped
+  SimulatedServer  server(net);
+  SimulatedDevice  device(server,xtal,1);
+  device.install();
+
+  Check         c;
+  uint64_t&     step = c.step;
+  uint64_t&     now  = c.now;
+  Timer         periodic;
+  Timer         oneShot;
+  Deadline      deadline;
+  TimerService  wheel(4);                      // Reads its wheel time from the installed device
+  now     = ticks(device,base);
+  c.wheel = &wheel;
+
+  periodic.set(PERIOD);
+  periodic.setPeriodic(MISSED_CATCH_UP);
+  periodic.setHandler([&]{
+    uint64_t due = c.periodicStart + (c.periodicFires+1)*PERIOD;
+    if( (now <= due) || (now > due + step + 1) ) error(c,"periodic fired",now,due);
+    c.periodicFires++;
+  });
+  oneShot.set(ONESHOT);
+  oneShot.setHandler([&]{
+    uint64_t due = c.oneShotStart + ONESHOT;
+    if( (now <= due) || (now > due + step + 1) ) error(c,"one-shot fired",now,due);
+    c.oneShotFires++;
+    c.oneShotStart = now;
+    oneShot.start();
+  });
+
+  if( (uint32_t)LSC_MILLIS() != (uint32_t)now ) error(c,"millis() mismatch",LSC_MILLIS(),now);
+  c.periodicStart = c.oneShotStart = c.wheelStart = c.wheelOneStart = now;
+  periodic.start();
+  oneShot.start();
+  wheel.schedulePeriodic(PERIOD,[&]{
+    uint64_t due = c.wheelStart + (c.wheelFires+1)*PERIOD;
+    if( (now < due) || (now > due + step) ) error(c,"service periodic fired",now,due);
+    c.wheelFires++;
+  },MISSED_CATCH_UP);
+  wheel.schedule(ONESHOT,[&c]{wheelOneShot(c);});
+
+  uint64_t end = ((uint64_t)(base*1000.0)/ROLLOVER + WRAPS)*ROLLOVER + WINDOW;
+  while( now < end ) {
+    uint64_t next = (now/ROLLOVER + 1)*ROLLOVER;                    // Next rollover
+    uint64_t last = (now/ROLLOVER)*ROLLOVER;                        // Most recent rollover
+    bool     fine = (next - now <= WINDOW) || ((now >= WINDOW) && (now - last <= WINDOW));
+    step = ((fine)?(1):((next - WINDOW - now < 1000)?(next - WINDOW - now):(1000)));
+    device.advance(step/1000.0);
+    now = ticks(device,base);
+
+    if( (uint32_t)LSC_MILLIS() != (uint32_t)now ) error(c,"millis() mismatch",LSC_MILLIS(),now);
+    if( (next - now <= SPAN/2) && (next != c.deadlineWrap) ) {
+      deadline.start(SPAN);
+      c.deadlineStart = now;
+      c.deadlineWrap  = next;
+      c.deadlines++;
+    }
+    if( deadline.armed() ) {
+      bool due = (now - c.deadlineStart > SPAN);
+      if( deadline.expired(LSC_MILLIS()) != due ) error(c,"deadline expiry wrong",now,c.deadlineStart+SPAN);
+      if( deadline.elapsed(LSC_MILLIS()) != now - c.deadlineStart ) error(c,"deadline elapsed wrong",now,c.deadlineStart+SPAN);
+      if( due ) deadline.clear();
+    }
+    periodic.doDevice();
+    oneShot.doDevice();
+    wheel.doDevice();
+  }
+
+  uint64_t run = now - c.periodicStart;
+  if( c.periodicFires != (run-1)/PERIOD ) error(c,"periodic fires wrong",c.periodicFires,(run-1)/PERIOD);
+  if( c.wheelFires != run/PERIOD ) error(c,"service periodic fires wrong",c.wheelFires,run/PERIOD);
+  if( c.deadlines != WRAPS ) error(c,"deadlines checked",c.deadlines,WRAPS);
+  SimulatedDevice::uninstall();
+  Serial.printf("Start at millis() %lu: Timer %llu periodic, %llu one-shot, TimerService %llu periodic, %llu one-shot fires over %d rollovers, %llu errors\n",
+                (unsigned long)(uint32_t)(uint64_t)(base*1000.0),(unsigned long long)c.periodicFires,(unsigned long long)c.oneShotFires,
+                (unsigned long long)c.wheelFires,(unsigned long long)c.wheelOneFires,WRAPS,(unsigned long long)c.errors);
+  return (c.errors == 0);
+}
+
+void setup() {
+  Serial.begin(115200);
+  while (!Serial) {
+    ; // wait for serial port to connect. Needed for native USB port only
+  }
+  Serial.println();
+  bool pass = rollover(0.0);
+  pass = rollover(SIMULATION_WRAP - 5.0) && pass;
+  Serial.printf("%s\n",((pass)?("PASS"):("FAIL")));
+}
+
+#else
+
+void setup() {
+  Serial.begin(115200);
+  Serial.printf("\nBuild with -DLSC_SIMULATION to run the rollover test\n");
+}
+
+#endif
+
+void loop() {
+}
@@ -0,0 +1,57 @@
+
+#include "SystemClock.h"
+#include "Simulation.h"
+using namespace lsc;
+
+/**
+ *   Compare SystemClock accuracy at two sync intervals over a week of virtual time, against a server on a lossy network with
+ *   asymmetric delay and a crystal that drifts with temperature. The library must be built with LSC_SIMULATION defined,
+ *   e.g. build_flags = -DLSC_SIMULATION in platformio.ini; no network is used.
+ */
+#ifdef LSC_SIMULATION
+
+#define DAYS 7
+
+void simulate(unsigned int syncMinutes) {
+  ServerModel     net;
+  net.loss         = 0.02;           // 2% of queries or replies lost
+  net.asymmetry    = 0.004;          // Outbound 4 ms slower than return
+  net.outliers     = 0.01;           // 1% of replies delayed by net.outlierDelay
+  OscillatorModel xtal;
+  xtal.frequency    = 35.0;          // Crystal 35 ppm fast
+  xtal.randomWalk   = 0.001;
+  xtal.tempInterval = 3600.0;        // Hourly temperature changes of 0.5 ppm
+  xtal.tempStep     = 0.5;
+
+  SimulatedServer  server(net);
+  SimulatedDevice  device(server,xtal,42);    // Same seed, so both intervals see the same oscillator and network
+  SystemClock      clock;
+  SimulationReport report;
+  clock.ntpSync(syncMinutes);
+  Simulation::run(clock,device,DAYS*86400.0,1.0,report);
+
+  Serial.printf("\nSync every %u minutes:\n",syncMinutes);
+  report.print(Serial);
+}
+
+void setup() {
+  Serial.begin(115200);
+  while (!Serial) {
+    ; // wait for serial port to connect. Needed for native USB port only
+  }
+  Serial.println();
+  simulate(15);
+  simulate(60);
+}
+
+#else
+
+void setup() {
+  Serial.begin(115200);
+  Serial.printf("\nBuild with -DLSC_SIMULATION to run the simulation\n");
+}
+
+#endif
+
+void loop() {
+}
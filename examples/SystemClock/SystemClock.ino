@@ -42,6 +42,8 @@ const char html_template[]   PROGMEM = "<!DOCTYPE html><html><meta name=\"viewpo
 
 Timer         timer;
 SystemClock   c;
+Metrics       registry;                // NTP health, scraped as OpenMetrics text from /metrics
+NTPMetrics    ntpMetrics(registry);
 
 typedef struct NTPReport {
   char   startBuff[64];
@@ -90,6 +92,7 @@ void setup() {
 
   c.ntpSync(1);                // Synchronize every 1 minutes
   c.tzOffset(-5.0);            // Set the timezone offset to EST
+  c.setMetrics(&ntpMetrics);   // Record offset, delay and query status of each sync
 
   char dateBuff[64];
   Instant start = c.now();
@@ -105,6 +108,7 @@ void setup() {
  *   Compute NTP offset from internal millisecond timer every 15 seconds
  */
   timer.set(0,0,15);        // Set an interval of 15 seconds
+  timer.setPeriodic();      // Repeat every 15 seconds without drift
   timer.setHandler([]{
        NTPReport report;
        runReport(report);
@@ -114,11 +118,11 @@ void setup() {
        Serial.printf("NTP Clock Offset:   %f\n",report.clockOffset);
        Serial.printf("Last NTP Sync:      %s\n",report.lastSync);
        Serial.printf("Next NTP Sync:      %s\n",report.nextSync);
-       timer.start();
        });
   timer.start();
 
   server.on("/",[](){handleRequest();});
+  server.on("/metrics",[](){handleMetrics();});
 
 }
 
@@ -137,3 +141,27 @@ void handleRequest() {
   server.send(200,"text/html",htmlBuffer); 
 }
 
+/**
+ *   The exposition grows with the number of NTP servers and histogram buckets reached, so it is streamed as chunked
+ *   content through a small buffer rather than formatted whole into memory.
+ */
+class ChunkPrint : public Print {
+  public:
+  size_t         write(uint8_t c)                              {return write(&c,1);}
+  size_t         write(const uint8_t* b, size_t n)             {for( size_t i=0; i<n; i++ ) {_buf[_len++] = b[i];if( _len == sizeof(_buf) ) send();}return n;}
+  void           send()                                        {if( _len > 0 ) server.sendContent((const char*)_buf,_len);_len = 0;}
+
+  private:
+  uint8_t        _buf[512];
+  size_t         _len = 0;
+};
+
+void handleMetrics() {
+  ChunkPrint out;
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200,METRICS_CONTENT_TYPE,"");
+  registry.write(out);
+  out.send();
+  server.sendContent("");                  // Empty chunk ends the response
+}
+
@@ -0,0 +1,63 @@
+#include "Timer.h"
+#include "TimerService.h"
+using namespace lsc;
+
+/**
+ *   Arm and fire Timers and TimerService timers, with lambdas and with TimerCallbacks, counting every operator new along
+ *   the way; the count must stay at zero. An empty TimerCallback must be a handler that does nothing. Prints PASS or
+ *   FAIL, so it may be run on a board or, with a host Arduino core, as a test.
+ */
+
+#define CYCLES 1000
+
+static volatile unsigned long allocations = 0;
+
+void* operator new(size_t n)                   {allocations++;void* p = malloc(n);return ((p==NULL)?(malloc(1)):(p));}
+void* operator new[](size_t n)                 {allocations++;void* p = malloc(n);return ((p==NULL)?(malloc(1)):(p));}
+void  operator delete(void* p) noexcept        {free(p);}
+void  operator delete[](void* p) noexcept      {free(p);}
+void  operator delete(void* p, size_t) noexcept   {free(p);}
+void  operator delete[](void* p, size_t) noexcept {free(p);}
+
+TimerService  timers(64);
+Timer         timer;
+unsigned long fired = 0;
+
+void setup() {
+  Serial.begin(115200);
+  while (!Serial) {
+    ; // wait for serial port to connect. Needed for native USB port only
+  }
+  Serial.println();
+
+  struct {long a, b, c;} capture = {1,2,3};                    // Larger than a pointer, so a std::function would allocate
+  TimerCallback callback = []{fired++;};                         // Captureless, held inside the std::function
+  TimerCallback empty;
+  timers.reserve(64);
+
+  unsigned long before = allocations;
+  for( int i=0; i<CYCLES; i++ ) {
+    timers.schedule(i%3,[capture]{fired += capture.a;});
+    timer.set(1);
+    timer.setHandler([]{fired++;});
+    timer.start();
+    if( i&1 ) timer.setHandler(callback);
+    delay(2);
+    timers.doDevice();
+    timer.doDevice();
+  }
+  for( int i=0; i<10; i++ ) {delay(2);timers.doDevice();}
+  unsigned long allocated = allocations - before;
+
+  timer.setHandler(empty);
+  timer.set(1);
+  timer.start();
+  delay(2);
+  timer.doDevice();                                              // Must not call an empty std::function
+
+  bool pass = (allocated == 0) && (fired == 2*CYCLES);
+  Serial.printf("%u timers fired with %lu heap allocations: %s\n",(unsigned)fired,allocated,((pass)?("PASS"):("FAIL")));
+}
+
+void loop() {
+}
@@ -0,0 +1,86 @@
+/**
+ *
+ *  SystemClock Library
+ *  Copyright (C) 2024  Daniel L Toth
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or any
+ *  later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *  The author can be contacted at dan@leelanausoftware.com
+ *
+ */
+
+/**
+ *   Host tool computing Allan deviation from an exported offset history, using the library's own AllanDeviation.
+ *
+ *   Build:
+ *      g++ -O2 -DALLAN_TAUS=16 -I../../src allan.cpp ../../src/AllanDeviation.cpp -o allan
+ *   Run:
+ *      ./allan [-t tau0] [-p] < history.csv
+ *
+ *   Input is CSV or whitespace separated lines of time (seconds) and value, as written by OffsetHistory::write(); any
+ *   further columns, and lines that do not start with two numbers, are ignored. Values are the offsets corrected at each
+ *   sync, or phases with -p. tau0 defaults to the median interval between samples.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include "AllanDeviation.h"
+
+using namespace lsc;
+
+typedef struct Row {
+  double time;
+  double value;
+} Row;
+
+static double medianInterval(const std::vector<Row>& rows) {
+  std::vector<double> gaps;
+  for( size_t i=1; i<rows.size(); i++ ) gaps.push_back(rows[i].time - rows[i-1].time);
+  if( gaps.empty() ) return 1.0;
+  std::nth_element(gaps.begin(),gaps.begin()+gaps.size()/2,gaps.end());
+  return gaps[gaps.size()/2];
+}
+
+int main(int argc, char** argv) {
+  double tau0  = 0.0;
+  bool   phase = false;
+  for( int i=1; i<argc; i++ ) {
+    if( (strcmp(argv[i],"-t") == 0) && (i+1 < argc) ) tau0 = atof(argv[++i]);
+    else if( strcmp(argv[i],"-p") == 0 ) phase = true;
+    else {fprintf(stderr,"usage: %s [-t tau0] [-p] < history.csv\n",argv[0]);return 2;}
+  }
+
+  std::vector<Row> rows;
+  char line[256];
+  while( fgets(line,sizeof(line),stdin) != NULL ) {
+    for( char* c=line; *c; c++ ) if( *c == ',' ) *c = ' ';
+    Row r;
+    if( sscanf(line,"%lf %lf",&r.time,&r.value) == 2 ) rows.push_back(r);
+  }
+  if( rows.size() < 3 ) {fprintf(stderr,"%s: need at least 3 samples, read %zu\n",argv[0],rows.size());return 1;}
+  if( tau0 <= 0 ) tau0 = medianInterval(rows);
+
+  AllanDeviation allan(tau0);
+  for( const Row& r : rows ) {
+    if( phase ) allan.addPhase(r.value);
+    else allan.addOffset(r.time,r.value);
+  }
+
+  printf("# %zu samples, tau0 %.3f s\n",rows.size(),tau0);
+  printf("# %14s %10s %14s %14s\n","tau (s)","terms","adev","mdev");
+  for( int k=0; k<allan.taus(); k++ ) printf("  %14.3f %10u %14.6e %14.6e\n",allan.tau(k),allan.terms(k),allan.adev(k),allan.mdev(k));
+  return 0;
+}
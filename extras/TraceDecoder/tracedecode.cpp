@@ -0,0 +1,72 @@
+/**
+ *
+ *  SystemClock Library
+ *  Copyright (C) 2024  Daniel L Toth
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or any
+ *  later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *  The author can be contacted at dan@leelanausoftware.com
+ *
+ */
+
+/**
+ *   Host tool decoding a TraceBuffer snapshot saved from a device, using the library's own TraceDecoder.
+ *
+ *   Build:
+ *      g++ -O2 -I../../src tracedecode.cpp ../../src/TraceFormat.cpp -o tracedecode
+ *   Run:
+ *      ./tracedecode [-j] [snapshot.bin]
+ *
+ *   Input is the bytes written by TraceBuffer::write() or TraceBuffer::snapshot(), read from the named file or from stdin.
+ *   Events are printed one per line, merged across threads in tick order and stamped with UTC, or as a JSON array with -j.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include "TraceFormat.h"
+
+using namespace lsc;
+
+/**
+ *   TraceDecoder prints to anything with print(const char*).
+ */
+typedef struct FileOut {
+  FILE* file;
+  void  print(const char* s) {fputs(s,file);}
+} FileOut;
+
+int main(int argc, char** argv) {
+  bool        json = false;
+  const char* path = NULL;
+  for( int i=1; i<argc; i++ ) {
+    if( strcmp(argv[i],"-j") == 0 ) json = true;
+    else if( (path == NULL) && (argv[i][0] != '-') ) path = argv[i];
+    else {fprintf(stderr,"usage: %s [-j] [snapshot.bin]\n",argv[0]);return 2;}
+  }
+
+  FILE* in = ((path==NULL)?(stdin):(fopen(path,"rb")));
+  if( in == NULL ) {fprintf(stderr,"%s: cannot open %s\n",argv[0],path);return 1;}
+  std::vector<uint8_t> bytes;
+  uint8_t buf[4096];
+  size_t  n;
+  while( (n = fread(buf,1,sizeof(buf),in)) > 0 ) bytes.insert(bytes.end(),buf,buf+n);
+  if( in != stdin ) fclose(in);
+
+  TraceDecoder decoder;
+  if( !decoder.decode(bytes.data(),bytes.size()) ) {fprintf(stderr,"%s: not a valid trace snapshot (%zu bytes)\n",argv[0],bytes.size());return 1;}
+  FileOut out = {stdout};
+  if( json ) decoder.printJSON(out);
+  else decoder.printText(out);
+  return 0;
+}
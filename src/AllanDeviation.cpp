@@ -0,0 +1,99 @@
+/**
+ *
+ *  SystemClock Library
+ *  Copyright (C) 2024  Daniel L Toth
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or any
+ *  later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *  The author can be contacted at dan@leelanausoftware.com
+ *
+ */
+
+#include <math.h>
+#include "AllanDeviation.h"
+
+/** Leelanau Software Company namespace
+*
+*/
+namespace lsc {
+
+/**
+ *   With x[n] added, the newest second difference at m is d[n] = x[n] - 2x[n-m] + x[n-2m], defined once n >= 2m. The
+ *   MDEV window is the sum of d over the last m indices, full once n >= 3m-1; d[n-m] leaves it once n >= 3m.
+ */
+void AllanDeviation::addPhase(double x) {
+  uint32_t n = _n++;
+  _ring[n%ALLAN_RING] = x;
+  for( int k=0; k<ALLAN_TAUS; k++ ) {
+    uint32_t m = 1UL<<k;
+    if( n < 2*m ) break;
+    Tau&   t = _taus[k];
+    double d = second(n,m);
+    t.adevSum += d*d;
+    t.adevTerms++;
+    t.window  += d;
+    if( n >= 3*m ) t.window -= second(n-m,m);
+    if( n >= 3*m-1 ) {
+      t.mdevSum += t.window*t.window;
+      t.mdevTerms++;
+    }
+  }
+}
+
+/**
+ *   The clock was off by -offset just before it was corrected, so its free running phase is the negated running sum.
+ */
+void AllanDeviation::addOffset(double time, double offset) {
+  double next = _phase - offset;
+  if( _started ) {
+    long gap = lround((time - _time)/_tau0);
+    if( gap > ALLAN_MAX_GAP ) {
+      _n = 0;
+      for( int k=0; k<ALLAN_TAUS; k++ ) _taus[k].window = 0.0;
+    }
+    else for( long i=1; i<gap; i++ ) addPhase(_phase + (next - _phase)*i/gap);
+  }
+  addPhase(next);
+  _phase   = next;
+  _time    = time;
+  _started = true;
+}
+
+double AllanDeviation::adev(int k) const {
+  if( (k<0) || (k>=ALLAN_TAUS) || (_taus[k].adevTerms == 0) ) return 0.0;
+  double m = (double)(1UL<<k);
+  return sqrt(_taus[k].adevSum/(2.0*m*m*_tau0*_tau0*_taus[k].adevTerms));
+}
+
+double AllanDeviation::mdev(int k) const {
+  if( (k<0) || (k>=ALLAN_TAUS) || (_taus[k].mdevTerms == 0) ) return 0.0;
+  double m = (double)(1UL<<k);
+  return sqrt(_taus[k].mdevSum/(2.0*m*m*m*m*_tau0*_tau0*_taus[k].mdevTerms));
+}
+
+int AllanDeviation::taus() const {
+  int k = 0;
+  while( (k < ALLAN_TAUS) && (_taus[k].adevTerms > 0) ) k++;
+  return k;
+}
+
+void AllanDeviation::reset() {
+  _n       = 0;
+  _phase   = 0.0;
+  _time    = 0.0;
+  _started = false;
+  for( int k=0; k<ALLAN_TAUS; k++ ) _taus[k] = {0.0,0.0,0.0,0,0};
+}
+
+} // End of namespace lsc
@@ -0,0 +1,112 @@
+
+/**
+ *
+ *  SystemClock Library
+ *  Copyright (C) 2024  Daniel L Toth
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or any
+ *  later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *  The author can be contacted at dan@leelanausoftware.com
+ *
+ */
+
+#ifndef ALLAN_DEVIATION_H
+#define ALLAN_DEVIATION_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef ALLAN_TAUS
+#define ALLAN_TAUS           8                                          // Octaves of tau computed, tau0 to 2**(ALLAN_TAUS-1) * tau0
+#endif
+#define ALLAN_MAX_M          (1UL<<(ALLAN_TAUS-1))
+#define ALLAN_RING           (3*ALLAN_MAX_M+1)                          // Phases kept, enough for the MDEV window at the largest tau
+#define ALLAN_MAX_GAP        4                                          // Missed samples interpolated before the series is restarted
+
+/** Leelanau Software Company namespace
+*
+*/
+namespace lsc {
+
+/**
+ *   AllanDeviation characterizes an oscillator from its phase (time error) sampled every tau0 seconds, computing the
+ *   overlapping Allan deviation (ADEV) and modified Allan deviation (MDEV) at tau = m*tau0 for m = 1, 2, 4, ...
+ *   2**(ALLAN_TAUS-1). The plot of deviation against tau identifies the noise in the oscillator and so the sync interval
+ *   at which it stops averaging down: white phase noise falls as 1/tau (MDEV as tau**-1.5), white frequency noise as
+ *   tau**-0.5, and the deviation flattens at the flicker floor and rises under random walk and drift.
+ *
+ *   The computation is streaming: each phase updates, for every tau, the running sum of squared second differences
+ *   x[i+2m] - 2x[i+m] + x[i] (and for MDEV a sliding sum of m of them), so it is O(1) per tau per sample, O(n) per tau in
+ *   all, and keeps only the last ALLAN_RING phases. It depends on nothing but the C library, so the same code runs on
+ *   the device and in the host tool extras/AllanDeviation, and ALLAN_TAUS may be raised on the host for longer series.
+ *
+ *   SystemClock steps to NTP at each sync, so its phase is the running sum of the offsets corrected; addOffset() keeps that
+ *   sum. Samples should be regular (a fixed ntpSync() interval). A gap of up to ALLAN_MAX_GAP intervals is filled by linear
+ *   interpolation; a longer one restarts the series, keeping the sums so far.
+ *   The following methods are supported:
+ *      void      addPhase(double x)            // Add the next phase sample, in seconds
+ *      void      addOffset(double time, double offset)    // Add the offset corrected at time (seconds), filling gaps
+ *      double    tau0()                        // Sample interval in seconds
+ *      double    tau(int k)                    // Tau of octave k, tau0 * 2**k
+ *      double    adev(int k)                   // Overlapping Allan deviation at tau(k), 0 until it has a term
+ *      double    mdev(int k)                   // Modified Allan deviation at tau(k)
+ *      uint32_t  terms(int k)                  // Second differences in adev(k), a measure of its confidence
+ *      int       taus()                        // Octaves with at least one ADEV term
+ *      void      reset()                       // Forget all samples
+ *
+ *   Example:
+ *      AllanDeviation allan(sysClock.ntpSync()*60.0);
+ *      OffsetHistory::Cursor c = history.scan();
+ *      OffsetSample s;
+ *      while( c.next(s) ) allan.addOffset(s.time.sysTimed(),s.offset);
+ *      for( int k=0; k<allan.taus(); k++ ) Serial.printf("tau %8.0f s  adev %.3e  mdev %.3e\n",allan.tau(k),allan.adev(k),allan.mdev(k));
+ */
+class AllanDeviation {
+  public:
+  AllanDeviation(double tau0) : _tau0((tau0>0)?(tau0):(1.0))       {reset();}
+
+  void           addPhase(double x);
+  void           addOffset(double time, double offset);
+  double         tau0()                        const               {return _tau0;}
+  double         tau(int k)                    const               {return _tau0*(double)(1UL<<k);}
+  double         adev(int k)                   const;
+  double         mdev(int k)                   const;
+  uint32_t       terms(int k)                  const               {return (((k<0)||(k>=ALLAN_TAUS))?(0):(_taus[k].adevTerms));}
+  int            taus()                        const;
+  void           reset();
+
+  private:
+  typedef struct Tau {
+    double       adevSum;                                          // Sum of squared second differences
+    double       mdevSum;                                          // Sum of squared window sums
+    double       window;                                           // Sum of the last m second differences
+    uint32_t     adevTerms;
+    uint32_t     mdevTerms;
+  } Tau;
+
+  double         phase(uint32_t n)             const               {return _ring[n%ALLAN_RING];}
+  double         second(uint32_t n, uint32_t m) const              {return phase(n) - 2*phase(n-m) + phase(n-2*m);}
+
+  double         _tau0;
+  double         _ring[ALLAN_RING];
+  uint32_t       _n;                                               // Phases in the current series
+  double         _phase;                                           // Running sum of offsets
+  double         _time;                                            // Time of the last offset
+  bool           _started;
+  Tau            _taus[ALLAN_TAUS];
+};
+
+} // End of namespace lsc
+
+#endif
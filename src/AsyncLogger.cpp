@@ -0,0 +1,280 @@
+/**
+ *
+ *  SystemClock Library
+ *  Copyright (C) 2024  Daniel L Toth
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or any
+ *  later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *  The author can be contacted at dan@leelanausoftware.com
+ *
+ */
+
+#include <string.h>
+#include "AsyncLogger.h"
+
+/** Leelanau Software Company namespace
+*
+*/
+namespace lsc {
+
+#define LOG_QUEUE_MASK        (LOG_QUEUE_SIZE-1)
+
+static const char* LOG_LEVELS[] = {"ERROR","WARN ","INFO ","DEBUG"};
+
+AsyncLogger::AsyncLogger(Print& out) : _out(out) {
+  _records = new Record[LOG_QUEUE_SIZE];
+  for( uint32_t i=0; i<LOG_QUEUE_SIZE; i++ ) _records[i].sequence.store(i,std::memory_order_relaxed);
+}
+
+AsyncLogger::~AsyncLogger() {
+  stop();
+  delete[] _records;
+}
+
+/**
+ *   A slot is free for position pos when its sequence is pos. A sequence behind pos means the consumer has not yet
+ *   released the slot a lap earlier, so the queue is full. The fence after publishing pairs with the one the consumer
+ *   thread makes after setting _sleeping: either the consumer sees the record, or this producer sees it sleeping and,
+ *   being the first to clear _sleeping, wakes it.
+ */
+bool AsyncLogger::push(uint8_t level, uint64_t tick, const char* fmt, const LogArg* args, uint8_t count) {
+  uint32_t pos = _enqueue.load(std::memory_order_relaxed);
+  Record*  r;
+  for( ;; ) {
+    r = &_records[pos & LOG_QUEUE_MASK];
+    int32_t diff = (int32_t)(r->sequence.load(std::memory_order_acquire) - pos);
+    if( diff == 0 ) {
+      if( _enqueue.compare_exchange_weak(pos,pos+1,std::memory_order_relaxed) ) break;
+    }
+    else if( diff < 0 ) {_dropped.fetch_add(1,std::memory_order_relaxed);return false;}
+    else pos = _enqueue.load(std::memory_order_relaxed);
+  }
+  r->level = level;
+  r->count = count;
+  r->tick  = tick;
+  r->fmt   = fmt;
+  for( uint8_t i=0; i<count; i++ ) {r->types[i] = args[i].type;r->values[i] = args[i].u;}
+  r->sequence.store(pos+1,std::memory_order_release);
+#if defined(__linux__) || defined(ESP32)
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if( _sleeping.load(std::memory_order_relaxed) && _sleeping.exchange(false) ) {
+    std::lock_guard<std::mutex> lock(_wakeMutex);
+    _wake.notify_one();
+  }
+#endif
+  return true;
+}
+
+AsyncLogger::Record* AsyncLogger::front() {
+  Record* r = &_records[_dequeue & LOG_QUEUE_MASK];
+  return ((r->sequence.load(std::memory_order_acquire) == _dequeue+1)?(r):(NULL));
+}
+
+void AsyncLogger::release(Record* r) {
+  r->sequence.store(_dequeue+LOG_QUEUE_SIZE,std::memory_order_release);
+  _dequeue++;
+}
+
+void AsyncLogger::sync(SystemClock& c) {
+  unsigned int syncs = c.syncCount();
+  if( (syncs != _syncs) && anchor(TickAnchor(c.peekTime())) ) _syncs = syncs;
+}
+
+bool AsyncLogger::anchor(const TickAnchor& a) {
+  LogArg args[2];
+  args[0].type = LogArg::SIGNED;
+  args[0].i    = a.utc().secs();
+  args[1].type = LogArg::UNSIGNED;
+  args[1].u    = a.utc().fraction();
+  return push(ANCHOR,a.tick(),NULL,args,2);
+}
+
+/**
+ *   Each line is formatted into a local buffer and its record released before the line is written, so producers get the
+ *   slot back while the consumer waits on the output.
+ */
+uint32_t AsyncLogger::doDevice(uint32_t max) {
+  char     line[LOG_LINE_SIZE];
+  uint32_t written = 0;
+  Record*  r;
+  while( (written < max) && ((r = front()) != NULL) ) {
+    if( r->level == ANCHOR ) {
+      _anchor = TickAnchor(Instant((int64_t)r->values[0],(uint32_t)r->values[1]),r->tick);
+      release(r);
+      continue;
+    }
+    size_t len = render(*r,line,sizeof(line));
+    release(r);
+    emit(line,len);
+    written++;
+  }
+  uint32_t dropped = _dropped.load(std::memory_order_relaxed);
+  if( dropped != _reported ) {
+    size_t len = stamp(monotonicMicros(),line,sizeof(line));
+    len += snprintf(line+len,sizeof(line)-len," %s AsyncLogger dropped %lu messages\n",LOG_LEVELS[LOG_WARN],(unsigned long)(dropped-_reported));
+    if( len >= sizeof(line) ) len = sizeof(line)-1;
+    _reported = dropped;
+    emit(line,len);
+  }
+  return written;
+}
+
+void AsyncLogger::emit(const char* line, size_t len) {
+  if( _sink ) _sink(line,len);
+  else _out.write((const uint8_t*)line,len);
+}
+
+/**
+ *   A line that does not fit is cut short but always ends in a newline.
+ */
+size_t AsyncLogger::render(const Record& r, char* line, size_t size) {
+  size_t len = stamp(r.tick,line,size);
+  len += snprintf(line+len,size-len," %s ",LOG_LEVELS[(r.level<=LOG_DEBUG)?(r.level):((uint8_t)LOG_DEBUG)]);
+  if( len > size-2 ) len = size-2;
+  len += format(r.fmt,r.values,r.types,r.count,line+len,size-1-len);
+  line[len++] = '\n';
+  line[len]   = '\0';
+  return len;
+}
+
+/**
+ *   The date and time are rendered only when the second changes; the fraction is formatted for every line.
+ */
+size_t AsyncLogger::stamp(uint64_t tick, char* line, size_t size) {
+  if( !_anchor.valid() ) {
+    int n = snprintf(line,size,"+%llu",(unsigned long long)tick);
+    return (((size_t)n<size)?((size_t)n):(size-1));
+  }
+  Instant t = _anchor.toInstant(tick);
+  if( t.secs() != _second ) {
+    char text[32];
+    t.printISO(text,sizeof(text),0);
+    _secondLength = strlen(text)-1;                                     // Without the trailing Z
+    if( _secondLength >= sizeof(_secondText) ) _secondLength = sizeof(_secondText)-1;
+    memcpy(_secondText,text,_secondLength);
+    _second = t.secs();
+  }
+  size_t len = ((_secondLength<size)?(_secondLength):(size-1));
+  memcpy(line,_secondText,len);
+  int    n   = snprintf(line+len,size-len,".%06luZ",(unsigned long)(((uint64_t)t.fraction()*1000000)>>32));
+  len += (((size_t)n<size-len)?((size_t)n):(size-len-1));
+  return len;
+}
+
+/**
+ *   Formats one conversion at a time with snprintf, rewriting each integer conversion's length modifier to ll and each
+ *   floating conversion's to none, so the widened argument always matches what snprintf reads. An argument whose type
+ *   does not suit its conversion is converted; a conversion with no argument left is printed as written.
+ */
+size_t AsyncLogger::format(const char* fmt, const uint64_t* values, const uint8_t* types, uint8_t count, char* out, size_t size) {
+  size_t  len = 0;
+  uint8_t a   = 0;
+  if( size == 0 ) return 0;
+  out[0] = '\0';
+  for( const char* p = fmt; (*p != '\0') && (len < size-1); ) {
+    if( *p != '%' ) {out[len++] = *p++;continue;}
+    if( p[1] == '%' ) {out[len++] = '%';p += 2;continue;}
+    const char* start = p++;
+    while( (*p != '\0') && (strchr("-+ #0",*p) != NULL) ) p++;
+    while( (*p >= '0') && (*p <= '9') ) p++;
+    if( *p == '.' ) {p++;while( (*p >= '0') && (*p <= '9') ) p++;}
+    const char* modifier = p;
+    while( (*p != '\0') && (strchr("hljztL",*p) != NULL) ) p++;
+    char conversion = *p;
+    if( conversion == '\0' ) break;
+    p++;
+    char   spec[24];
+    size_t prefix = modifier - start;
+    if( (prefix > sizeof(spec)-4) || (a >= count) || (strchr("diouxXcfFeEgGaAsp",conversion) == NULL) ) {
+      while( (start < p) && (len < size-1) ) out[len++] = *start++;
+      continue;
+    }
+    memcpy(spec,start,prefix);
+    uint64_t v    = values[a];
+    uint8_t  type = types[a++];
+    double   d;
+    memcpy(&d,&v,sizeof(d));
+    int      n    = 0;
+    switch( conversion ) {
+      case 'd': case 'i':
+        memcpy(spec+prefix,"ll",2);spec[prefix+2] = conversion;spec[prefix+3] = '\0';
+        n = snprintf(out+len,size-len,spec,(long long)((type==LogArg::REAL)?((int64_t)d):((int64_t)v)));
+        break;
+      case 'o': case 'u': case 'x': case 'X':
+        memcpy(spec+prefix,"ll",2);spec[prefix+2] = conversion;spec[prefix+3] = '\0';
+        n = snprintf(out+len,size-len,spec,(unsigned long long)((type==LogArg::REAL)?((uint64_t)d):(v)));
+        break;
+      case 'c':
+        spec[prefix] = conversion;spec[prefix+1] = '\0';
+        n = snprintf(out+len,size-len,spec,(int)v);
+        break;
+      case 's':
+        spec[prefix] = conversion;spec[prefix+1] = '\0';
+        n = snprintf(out+len,size-len,spec,((type==LogArg::STRING)&&(v!=0))?((const char*)(uintptr_t)v):("(null)"));
+        break;
+      case 'p':
+        spec[prefix] = conversion;spec[prefix+1] = '\0';
+        n = snprintf(out+len,size-len,spec,(const void*)(uintptr_t)v);
+        break;
+      default:
+        spec[prefix] = conversion;spec[prefix+1] = '\0';
+        if( type == LogArg::SIGNED ) d = (double)(int64_t)v;
+        else if( type == LogArg::UNSIGNED ) d = (double)v;
+        n = snprintf(out+len,size-len,spec,d);
+        break;
+    }
+    if( n > 0 ) len += (((size_t)n<size-len)?((size_t)n):(size-len-1));
+  }
+  out[len] = '\0';
+  return len;
+}
+
+#if defined(__linux__) || defined(ESP32)
+
+/**
+ *   The consumer waits with no timeout once the queue is empty, so an idle logger costs no CPU. _sleeping is set while
+ *   holding _wakeMutex, and a producer that clears it takes the mutex to notify, so the wakeup cannot fall between the
+ *   consumer's last look at the queue and its wait.
+ */
+bool AsyncLogger::start() {
+  if( _running.exchange(true) ) return false;
+  _thread = std::thread([this]{
+    while( _running.load(std::memory_order_relaxed) ) {
+      if( doDevice() != 0 ) continue;
+      std::unique_lock<std::mutex> lock(_wakeMutex);
+      _sleeping.store(true);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if( front() == NULL ) _wake.wait(lock,[this]{return !_sleeping.load(std::memory_order_relaxed) || !_running.load(std::memory_order_relaxed);});
+      _sleeping.store(false,std::memory_order_relaxed);
+    }
+  });
+  return true;
+}
+
+void AsyncLogger::stop() {
+  if( !_running.exchange(false) ) return;
+  {std::lock_guard<std::mutex> lock(_wakeMutex);}
+  _wake.notify_one();
+  _thread.join();
+  doDevice();
+}
+
+#else
+
+bool AsyncLogger::start() {return false;}
+void AsyncLogger::stop()  {}
+
+#endif
+
+} // End of namespace lsc
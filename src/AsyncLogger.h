@@ -0,0 +1,208 @@
+
+/**
+ *
+ *  SystemClock Library
+ *  Copyright (C) 2024  Daniel L Toth
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or any
+ *  later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *  The author can be contacted at dan@leelanausoftware.com
+ *
+ */
+
+#ifndef ASYNC_LOGGER_H
+#define ASYNC_LOGGER_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <type_traits>
+#include "InplaceFunction.h"
+#include "Ticks.h"
+#include "SystemClock.h"
+#if defined(__linux__) || defined(ESP32)
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#endif
+
+#define LOG_QUEUE_BITS       6                                          // log2 of records the queue holds
+#define LOG_QUEUE_SIZE       (1<<LOG_QUEUE_BITS)
+#define LOG_MAX_ARGS         6                                          // Arguments a log message may carry
+#define LOG_LINE_SIZE        192                                        // Longest line written, longer lines are truncated
+
+/** Leelanau Software Company namespace
+*
+*/
+namespace lsc {
+
+/**
+ *   Severity of a log message; messages below an AsyncLogger's level() are discarded by the producer.
+ */
+enum LogLevel {LOG_ERROR, LOG_WARN, LOG_INFO, LOG_DEBUG};
+
+/**
+ *   Receives each formatted line, including its newline, when lines should go somewhere other than a Print, such as one
+ *   UDP datagram per line.
+ */
+typedef InplaceFunction<void(const char*,size_t),INPLACE_FUNCTION_SIZE> LogSink;
+
+/**
+ *   LogArg is one argument captured for deferred formatting: integers are widened to 64 bits, floating point to double,
+ *   and strings and pointers are kept as pointers.
+ */
+typedef struct LogArg {
+  enum Type : uint8_t {SIGNED, UNSIGNED, REAL, STRING, POINTER};
+  uint8_t type;
+  union {int64_t i;uint64_t u;double d;const char* s;const void* p;};
+} LogArg;
+
+/**
+ *   AsyncLogger moves formatting and output off the caller's path. A producer only reads monotonicMicros() and copies the
+ *   format pointer and its arguments into a lock-free bounded queue, so it never blocks on a UART, file, or socket; the
+ *   consumer formats lines in printf style and writes them to a Print (Serial, a File, a WiFiClient) or a LogSink.
+ *   The following methods are supported:
+ *      bool      error(const char* fmt, ...)   // Enqueue a message at LOG_ERROR, false if discarded or the queue is full
+ *      bool      warn(const char* fmt, ...)    // Enqueue a message at LOG_WARN
+ *      bool      info(const char* fmt, ...)    // Enqueue a message at LOG_INFO
+ *      bool      debug(const char* fmt, ...)   // Enqueue a message at LOG_DEBUG
+ *      bool      log(LogLevel l, const char* fmt, ...)   // Enqueue a message at level l
+ *      void      level(LogLevel l)             // Discard messages below l (default LOG_INFO)
+ *      LogLevel  level()                       // Current level
+ *      void      sink(LogSink s)               // Send lines to s rather than the Print, empty to return to the Print
+ *      void      sync(SystemClock& c)          // Enqueue a new anchor if c has synchronized since the last call; call from loop()
+ *      bool      anchor(const TickAnchor& a)   // Enqueue an anchor directly
+ *      uint32_t  doDevice(uint32_t max)        // Format and write up to max queued lines, returning the number written
+ *      bool      start()                       // Run doDevice() on a background thread (Linux and ESP32)
+ *      void      stop()                        // Stop the background thread, writing any lines still queued
+ *      uint32_t  dropped()                     // Messages lost because the queue was full
+ *
+ *   The queue is Vyukov's bounded queue: each slot carries a sequence number, producers claim slots with one compare and
+ *   swap, and the single consumer needs no atomic read-modify-write at all. Any number of threads may log at once. When
+ *   the queue is full a message is dropped rather than waiting, and the consumer reports the count dropped.
+ *
+ *   Only one thread consumes: either call doDevice() from the loop or start() the background thread, not both. Set the
+ *   sink before start(). The background thread sleeps on a condition variable while the queue is empty; the first
+ *   producer to enqueue after it does so wakes it, and every other push costs only a fence and a load.
+ *
+ *   Lines are stamped in UTC from the tick taken when the message was logged, using the latest anchor in the queue
+ *   before it, so a message logged before a clock step keeps the time it had. Consecutive lines usually fall in the same
+ *   second, so the consumer renders the date and time once per second and formats only the microseconds for each line.
+ *   Lines logged before the first anchor are stamped with their raw tick.
+ *
+ *   Arguments are formatted when the line is written, not when it is logged, so a %s argument must stay valid until
+ *   then: a string literal or other static storage, never a stack buffer. Field width and precision must be given in
+ *   the format, not by '*'.
+ *
+ *   Example:
+ *   AsyncLogger logger(Serial);
+ *   ...
+ *   logger.info("NTP offset %.3f ms from %s",offset*1000,serverName);
+ *   ...
+ *   void loop() {
+ *     sysClock.doDevice();
+ *     logger.sync(sysClock);
+ *     logger.doDevice();                      // Or call logger.start() once on Linux or ESP32
+ *   }
+ */
+class AsyncLogger {
+  public:
+  AsyncLogger(Print& out);
+  ~AsyncLogger();
+
+  template<typename... Args>
+  bool           log(LogLevel l, const char* fmt, Args... args) {
+                   static_assert(sizeof...(Args) <= LOG_MAX_ARGS,"Too many log arguments, see LOG_MAX_ARGS");
+                   if( l > _level.load(std::memory_order_relaxed) ) return false;
+                   LogArg a[sizeof...(Args)+1] = {arg(args)...};
+                   return push(l,monotonicMicros(),fmt,a,sizeof...(Args));
+                 }
+  template<typename... Args> bool error(const char* fmt, Args... args)  {return log(LOG_ERROR,fmt,args...);}
+  template<typename... Args> bool warn(const char* fmt, Args... args)   {return log(LOG_WARN,fmt,args...);}
+  template<typename... Args> bool info(const char* fmt, Args... args)   {return log(LOG_INFO,fmt,args...);}
+  template<typename... Args> bool debug(const char* fmt, Args... args)  {return log(LOG_DEBUG,fmt,args...);}
+
+  void           level(LogLevel l)                             {_level.store(l,std::memory_order_relaxed);}
+  LogLevel       level()                       const           {return _level.load(std::memory_order_relaxed);}
+  void           sink(LogSink s)                               {_sink = std::move(s);}
+  void           sync(SystemClock& c);
+  bool           anchor(const TickAnchor& a);
+  uint32_t       doDevice(uint32_t max = LOG_QUEUE_SIZE);
+  bool           start();
+  void           stop();
+  uint32_t       dropped()                     const           {return _dropped.load(std::memory_order_relaxed);}
+
+  private:
+  AsyncLogger(const AsyncLogger&)            = delete;
+  AsyncLogger& operator=(const AsyncLogger&) = delete;
+
+  static const uint8_t ANCHOR = 0xFF;                                   // Record level marking an anchor, args hold its UTC
+
+  typedef struct Record {
+    std::atomic<uint32_t>  sequence;                                    // Slot position when free, position+1 when filled
+    uint8_t                level;
+    uint8_t                count;
+    uint8_t                types[LOG_MAX_ARGS];
+    uint64_t               tick;
+    const char*            fmt;
+    uint64_t               values[LOG_MAX_ARGS];
+  } Record;
+
+  template<typename T>
+  static LogArg  arg(T v)                                      {
+                   LogArg a;
+                   if( std::is_floating_point<T>::value ) {a.type = LogArg::REAL;a.d = (double)v;}
+                   else if( std::is_signed<T>::value ) {a.type = LogArg::SIGNED;a.i = (int64_t)v;}
+                   else {a.type = LogArg::UNSIGNED;a.u = (uint64_t)v;}
+                   return a;
+                 }
+  static LogArg  arg(const char* s)                            {LogArg a;a.type = LogArg::STRING;a.s = s;return a;}
+  static LogArg  arg(char* s)                                  {return arg((const char*)s);}
+  static LogArg  arg(const void* p)                            {LogArg a;a.type = LogArg::POINTER;a.p = p;return a;}
+  static LogArg  arg(void* p)                                  {return arg((const void*)p);}
+  template<typename T>
+  static LogArg  arg(T* p)                                     {return arg((const void*)p);}
+
+  bool           push(uint8_t level, uint64_t tick, const char* fmt, const LogArg* args, uint8_t count);
+  Record*        front();                                               // Oldest filled record, NULL if none
+  void           release(Record* r);                                    // Return the front record to producers
+  size_t         render(const Record& r, char* line, size_t size);      // Format r as one line, returning its length
+  size_t         stamp(uint64_t tick, char* line, size_t size);         // UTC (or raw tick) prefix
+  static size_t  format(const char* fmt, const uint64_t* values, const uint8_t* types, uint8_t count, char* out, size_t size);
+  void           emit(const char* line, size_t len);
+
+  Print&                 _out;
+  LogSink                _sink;
+  std::atomic<LogLevel>  _level{LOG_INFO};
+  Record*                _records;
+  std::atomic<uint32_t>  _enqueue{0};                                   // Next position producers claim
+  uint32_t               _dequeue = 0;                                  // Next position the consumer reads
+  std::atomic<uint32_t>  _dropped{0};
+  uint32_t               _reported = 0;                                 // Drops already reported by the consumer
+  unsigned int           _syncs    = 0;                                 // syncCount() at the last sync()
+  TickAnchor             _anchor;                                       // Consumer's current anchor
+  int64_t                _second   = -1;                                // UTC second rendered in _secondText
+  char                   _secondText[24];
+  size_t                 _secondLength = 0;
+#if defined(__linux__) || defined(ESP32)
+  std::thread            _thread;
+  std::atomic<bool>      _running{false};
+  std::mutex             _wakeMutex;
+  std::condition_variable _wake;                                        // Signalled when the queue becomes non-empty
+  std::atomic<bool>      _sleeping{false};                              // Consumer thread found the queue empty and waits
+#endif
+};
+
+} // End of namespace lsc
+
+#endif
@@ -0,0 +1,238 @@
+/**
+ *
+ *  SystemClock Library
+ *  Copyright (C) 2024  Daniel L Toth
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or any
+ *  later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *  The author can be contacted at dan@leelanausoftware.com
+ *
+ */
+
+#include "CronSchedule.h"
+
+/** Leelanau Software Company namespace
+*
+*/
+namespace lsc {
+
+static const char* monthNames[] = {"JAN","FEB","MAR","APR","MAY","JUN","JUL","AUG","SEP","OCT","NOV","DEC"};
+static const char* dayNames[]   = {"SUN","MON","TUE","WED","THU","FRI","SAT"};
+
+static const struct {const char* name; const char* expr;} macros[] = {
+  {"@yearly","0 0 1 1 *"},{"@annually","0 0 1 1 *"},{"@monthly","0 0 1 * *"},
+  {"@weekly","0 0 * * 0"},{"@daily","0 0 * * *"},{"@midnight","0 0 * * *"},{"@hourly","0 * * * *"}
+};
+
+/**
+ *   Parse a value as a number or, where names is given, a case insensitive 3-letter name whose index is added to base.
+ */
+static bool parseValue(const char*& s, const char* names[], int count, int base, int& result) {
+  if( *s >= '0' && *s <= '9' ) {
+    result = 0;
+    while( *s >= '0' && *s <= '9' ) result = result*10 + (*s++ - '0');
+    return true;
+  }
+  for( int i=0; (names != NULL) && (i<count); i++ ) {
+    if( strncasecmp(s,names[i],3) == 0 ) {s += 3;result = base + i;return true;}
+  }
+  return false;
+}
+
+/**
+ *   Parse one field into a bit mask of values in [min,max]. any is set if the field starts with * (or ?).
+ */
+static bool parseField(const char*& s, int min, int max, const char* names[], int count, uint64_t& mask, bool& any) {
+  mask = 0;
+  any  = (*s == '*') || (*s == '?');
+  for( ;; ) {
+    int lo = min, hi = max, step = 1;
+    if( *s == '*' || *s == '?' ) s++;
+    else {
+      if( !parseValue(s,names,count,min,lo) ) return false;
+      hi = lo;
+      if( *s == '-' ) {s++;if( !parseValue(s,names,count,min,hi) ) return false;}
+    }
+    if( *s == '/' ) {
+      s++;
+      if( !parseValue(s,NULL,0,0,step) || step == 0 ) return false;
+      if( hi == lo ) hi = max;                                // a/n runs from a to the end of the range
+    }
+    if( lo < min || hi > max || lo > hi ) return false;
+    for( int v=lo; v<=hi; v+=step ) mask |= (1ULL<<v);
+    if( *s != ',' ) break;
+    s++;
+  }
+  return (*s == ' ') || (*s == '\t') || (*s == '\0');
+}
+
+static void skipSpace(const char*& s) {while( *s == ' ' || *s == '\t' ) s++;}
+
+bool CronSchedule::parse(const char* expr) {
+  _valid = false;
+  if( expr == NULL ) return false;
+  skipSpace(expr);
+  for( auto& m : macros ) {
+    if( strcasecmp(expr,m.name) == 0 ) {expr = m.expr;break;}
+  }
+
+  uint64_t mask;
+  bool     any;
+  if( !parseField(expr,0,59,NULL,0,mask,any) ) return false;
+  _minutes = mask;
+  skipSpace(expr);
+  if( !parseField(expr,0,23,NULL,0,mask,any) ) return false;
+  _hours = (uint32_t)mask;
+  skipSpace(expr);
+  if( !parseField(expr,1,31,NULL,0,mask,_anyDay) ) return false;
+  _days = (uint32_t)mask;
+  skipSpace(expr);
+  if( !parseField(expr,1,12,monthNames,12,mask,any) ) return false;
+  _months = (uint16_t)mask;
+  skipSpace(expr);
+  if( !parseField(expr,0,7,dayNames,7,mask,_anyDow) ) return false;
+  _weekdays = (uint8_t)((mask | (mask>>7)) & 0x7F);           // 7 is also Sunday
+  skipSpace(expr);
+  _valid = (*expr == '\0');
+  return _valid;
+}
+
+bool CronSchedule::matchDay(int dom, int dow) const {
+  bool d = (_days>>dom)&1;
+  bool w = (_weekdays>>dow)&1;
+  if( _anyDay && _anyDow ) return true;
+  if( _anyDay ) return w;
+  if( _anyDow ) return d;
+  return d || w;
+}
+
+/**
+ *   Walk local days from the local date of after, skipping whole months that do not match, then walk the hour and
+ *   minute masks of a matching day for the first local time whose UTC follows after.
+ */
+bool CronSchedule::next(const Instant& after, const TimeZone& tz, Instant& result) const {
+  if( !_valid ) return false;
+  int64_t afterSecs = after.secs();
+  int64_t local     = afterSecs + tz.offset(after);
+  int64_t startDay  = TimeZone::floorDiv(local,SECS_IN_DAY);
+  for( int64_t day=startDay; day<startDay+CRON_SEARCH_DAYS; day++ ) {
+    int y, m, d;
+    TimeZone::civilFromDays(day,y,m,d);
+    if( !((_months>>m)&1) ) {
+      day = ((m == 12)?(TimeZone::daysFromCivil(y+1,1,1)):(TimeZone::daysFromCivil(y,m+1,1))) - 1;
+      continue;
+    }
+    if( !matchDay(d,TimeZone::weekday(day)) ) continue;
+    for( int h=0; h<24; h++ ) {
+      if( !((_hours>>h)&1) ) continue;
+      for( int mi=0; mi<60; mi++ ) {
+        if( !((_minutes>>mi)&1) ) continue;
+        int64_t candidate = day*SECS_IN_DAY + h*3600 + mi*60;
+        if( candidate <= local ) continue;
+        int64_t utc = tz.toUTC(Instant(candidate)).secs();
+        if( utc <= afterSecs ) {                            // First occurrence of a repeated time has passed, try the second
+          utc = candidate - tz.standardOffset();
+          if( (utc <= afterSecs) || (tz.offset(Instant(utc)) != tz.standardOffset()) ) continue;
+        }
+        result = Instant(utc);
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+int CronScheduler::add(const char* expr, TimerHandler h) {
+  for( int i=0; i<CRON_SCHEDULER_SIZE; i++ ) {
+    Entry& e = _entries[i];
+    if( e.active ) continue;
+    if( !e.schedule.parse(expr) ) return -1;
+    e.handler = std::move(h);
+    e.active  = true;
+    arm(e,_clock.peekTime());
+    _wait     = 0;                                          // Recompute the earliest run on the next doDevice()
+    return i;
+  }
+  return -1;
+}
+
+void CronScheduler::remove(int id) {
+  if( id < 0 || id >= CRON_SCHEDULER_SIZE ) return;
+  _entries[id].active  = false;
+  _entries[id].handler = nullptr;
+}
+
+bool CronScheduler::next(int id, Instant& result) const {
+  if( id < 0 || id >= CRON_SCHEDULER_SIZE || !_entries[id].active || _entries[id].next == INT64_MAX ) return false;
+  result = Instant(_entries[id].next);
+  return true;
+}
+
+void CronScheduler::timeZone(const TimeZone& tz) {
+  _tz = tz;
+  Instant now = _clock.peekTime();
+  for( Entry& e : _entries ) if( e.active ) arm(e,now);
+  _wait = 0;
+}
+
+void CronScheduler::arm(Entry& e, const Instant& after) {
+  Instant result;
+  e.next = ((e.schedule.next(after,_tz,result))?(result.secs()):(INT64_MAX));
+}
+
+void CronScheduler::doDevice() {
+  unsigned int  syncs   = _clock.syncCount();
+  unsigned long current = LSC_MILLIS();
+  if( (syncs == _syncs) && (((uint32_t)(current - _checkMillis)) < _wait) ) return;
+
+  Instant now  = _clock.peekTime();
+  int64_t secs = now.secs();
+  if( syncs != _syncs ) {
+    int64_t expected = _checkSecs + (int64_t)(((uint32_t)(current - _checkMillis))/1000);
+    if( secs - expected > CRON_STEP_SECS ) {                 // Stepped forward, skip runs stepped over
+      for( Entry& e : _entries ) if( e.active && e.next <= secs ) arm(e,now);
+    }
+    _syncs = syncs;
+  }
+
+  for( Entry& e : _entries ) {
+    if( !e.active || e.next > secs ) continue;
+    arm(e,now);                                             // Coalesce missed runs into one
+    TimerHandler h = std::move(e.handler);                  // Handler may remove or replace its own entry
+    h();
+    if( e.active && !e.handler ) e.handler = std::move(h);
+  }
+  rewait(now);
+}
+
+unsigned long CronScheduler::remaining() {
+  if( _clock.syncCount() != _syncs ) return 0;
+  if( _wait == TIMER_NO_DEADLINE ) return TIMER_NO_DEADLINE;
+  unsigned long elapsed = (uint32_t)(LSC_MILLIS() - _checkMillis);
+  return ((elapsed >= _wait)?(0):(_wait - elapsed));
+}
+
+void CronScheduler::rewait(const Instant& now) {
+  int64_t earliest = INT64_MAX;
+  for( const Entry& e : _entries ) if( e.active && e.next < earliest ) earliest = e.next;
+  _checkMillis = LSC_MILLIS();
+  _checkSecs   = now.secs();
+  if( earliest == INT64_MAX ) {_wait = TIMER_NO_DEADLINE;return;}
+  Instant diff = Instant(earliest) - now;
+  if( diff.secs() < 0 ) {_wait = 0;return;}
+  uint64_t ms = (uint64_t)diff.secs()*1000 + (((uint64_t)diff.fraction()*1000)>>32) + 1;
+  _wait = ((ms > CRON_MAX_WAIT)?(CRON_MAX_WAIT):((unsigned long)ms));
+}
+
+} // End of namespace lsc
@@ -0,0 +1,147 @@
+
+/**
+ *
+ *  SystemClock Library
+ *  Copyright (C) 2024  Daniel L Toth
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or any
+ *  later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *  The author can be contacted at dan@leelanausoftware.com
+ *
+ */
+
+#ifndef CRON_SCHEDULE_H
+#define CRON_SCHEDULE_H
+
+#include <Arduino.h>
+#include "Instant.h"
+#include "TimeZone.h"
+#include "SystemClock.h"
+#include "Timer.h"
+
+#define CRON_SCHEDULER_SIZE  8                    // Number of schedules a CronScheduler can hold
+#define CRON_SEARCH_DAYS     (8*366+1)            // Days searched for the next match, long enough for Feb 29 on any weekday
+#define CRON_STEP_SECS       2                    // A forward clock step larger than this skips schedules stepped over
+#define CRON_MAX_WAIT        0x7FFFFFFFUL         // Longest wait in milliseconds reported by remaining()
+
+/** Leelanau Software Company namespace
+*
+*/
+namespace lsc {
+
+/**
+ *   CronSchedule is a wall-clock rule in 5-field cron syntax:
+ *      minute hour day-of-month month day-of-week
+ *   Each field is *, a value, a range a-b, or a list of these separated by commas, with an optional /step. Months and
+ *   weekdays may be given by 3-letter name (JAN, MON), and weekday 7 is Sunday. As in Vixie cron, when both day-of-month
+ *   and day-of-week are restricted a day matching either runs. The macros @yearly, @monthly, @weekly, @daily, and @hourly
+ *   are also accepted. For example:
+ *      "30 2 * * *"                 // Every day at 02:30
+ *      "0 9-17/2 * * MON-FRI"       // Weekdays at 9, 11, 13, 15, and 17 o'clock
+ *      "0 0 1,15 * *"               // Midnight on the 1st and 15th
+ *   The following methods are supported:
+ *      bool  parse(const char* expr)                                 // Parse expr, returning false if it is not valid
+ *      bool  valid()                                                 // True if the last parse succeeded
+ *      bool  next(const Instant& after, const TimeZone& tz, Instant& result)
+ *                                                                    // UTC of the first match strictly after UTC after, in tz
+ *
+ *   next() is evaluated in local time of tz. A time in the spring forward gap runs at the DST transition, and a time repeated
+ *   when clocks fall back runs once, at its first occurrence. next() returns false if no match occurs within CRON_SEARCH_DAYS.
+ */
+class CronSchedule {
+  public:
+  CronSchedule()                                               {}
+  CronSchedule(const char* expr)                               {parse(expr);}
+
+  bool           parse(const char* expr);
+  bool           valid()                       const           {return _valid;}
+  bool           next(const Instant& after, const TimeZone& tz, Instant& result) const;
+
+  private:
+  bool           matchDay(int dom, int dow)    const;
+
+  uint64_t       _minutes  = 0;                                // Bit n set for minute n
+  uint32_t       _hours    = 0;                                // Bit n set for hour n
+  uint32_t       _days     = 0;                                // Bit n set for day of month n
+  uint16_t       _months   = 0;                                // Bit n set for month n
+  uint8_t        _weekdays = 0;                                // Bit n set for weekday n, 0 is Sunday
+  bool           _anyDay   = true;                             // Day of month field is *
+  bool           _anyDow   = true;                             // Day of week field is *
+  bool           _valid    = false;
+};
+
+/**
+ *   CronScheduler runs handlers on CronSchedules against the UTC time of a SystemClock, in the given TimeZone.
+ *   The following methods are supported:
+ *      int           add(const char* expr, TimerHandler h)     // Run h on schedule expr; returns an id, or -1 if expr is invalid or full
+ *      void          remove(int id)                            // Remove the schedule with id
+ *      bool          next(int id, Instant& result)             // UTC of the next run of id
+ *      void          timeZone(const TimeZone& tz)              // Change time zone, recomputing all next runs
+ *      void          doDevice()                                // Called in Arduino loop() function to run due schedules
+ *      unsigned long remaining()                               // Milliseconds until doDevice() has work to do, TIMER_NO_DEADLINE if none
+ *
+ *   Next run times are kept in UTC and computed lazily, one schedule at a time, when that schedule runs. doDevice() reads
+ *   the clock only when the earliest run is due or the SystemClock has synchronized, so it costs a millis() comparison
+ *   otherwise. DST transitions need no special handling since they are part of the UTC run time. When NTP steps the clock
+ *   backward a schedule that already ran is not repeated; when it steps forward by more than CRON_STEP_SECS, schedules
+ *   stepped over are skipped rather than run late. A schedule missed because loop() was busy runs once when it is noticed.
+ *
+ *   Example:
+ *   SystemClock   sysClock;
+ *   CronScheduler cron(sysClock,TimeZone("EST5EDT,M3.2.0,M11.1.0"));
+ *   cron.add("30 2 * * *",[]{Serial.printf("Nightly backup\n");});
+ *
+ *   void loop() {
+ *     sysClock.doDevice();
+ *     cron.doDevice();
+ *   }
+ */
+class CronScheduler {
+  public:
+  CronScheduler(SystemClock& c, const TimeZone& tz = TimeZone()) : _clock(c), _tz(tz) {}
+
+  int            add(const char* expr, TimerHandler h);
+  void           remove(int id);
+  bool           next(int id, Instant& result) const;
+  void           timeZone(const TimeZone& tz);
+  const TimeZone& timeZone()                   const           {return _tz;}
+  void           doDevice();
+  unsigned long  remaining();
+
+  private:
+  CronScheduler(const CronScheduler&)            = delete;
+  CronScheduler& operator=(const CronScheduler&) = delete;
+
+  typedef struct Entry {
+    CronSchedule   schedule;
+    TimerHandler   handler;
+    int64_t        next   = 0;                                 // UTC seconds of next run
+    bool           active = false;                             // Entry holds a schedule
+  } Entry;
+
+  void           arm(Entry& e, const Instant& after);
+  void           rewait(const Instant& now);                   // Recompute _wait from the earliest next run
+
+  SystemClock&   _clock;
+  TimeZone       _tz;
+  Entry          _entries[CRON_SCHEDULER_SIZE];
+  unsigned int   _syncs      = 0;                              // SystemClock syncCount() at the last check
+  unsigned long  _checkMillis = 0;                             // millis() at the last check
+  unsigned long  _wait       = 0;                              // Milliseconds after _checkMillis the next run is due
+  int64_t        _checkSecs  = 0;                              // UTC seconds at the last check
+};
+
+} // End of namespace lsc
+
+#endif
@@ -0,0 +1,81 @@
+
+/**
+ *
+ *  SystemClock Library
+ *  Copyright (C) 2024  Daniel L Toth
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or any
+ *  later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *  The author can be contacted at dan@leelanausoftware.com
+ *
+ */
+
+#ifndef DEADLINE_H
+#define DEADLINE_H
+
+#include <Arduino.h>
+#include "Ticks.h"
+
+/** Leelanau Software Company namespace
+*
+*/
+namespace lsc {
+
+/**
+ *   Deadline is a millisecond interval on the millis() clock that stays correct across the 49.7 day rollover of a 32-bit
+ *   unsigned long. Rather than comparing millis() to an absolute limit, which misfires when start + duration wraps past
+ *   zero, every test is made on elapsed time, millis() - start, which modular subtraction keeps exact for any interval
+ *   shorter than 2^32 milliseconds. Differences are taken in uint32_t, so the test holds where unsigned long is 64 bits
+ *   and millis() still wraps at 2^32, as on a simulated device. Armed state is a flag, so a start time of 0 is as valid
+ *   as any other.
+ *   The following methods are supported:
+ *      void          start(unsigned long duration)                   // Arm for duration milliseconds from now
+ *      void          startAt(unsigned long start, unsigned long d)   // Arm for d milliseconds from millisecond timestamp start
+ *      void          clear()                                         // Disarm
+ *      bool          armed()                                         // True if armed
+ *      unsigned long begin()                                         // Millisecond timestamp the interval started
+ *      unsigned long duration()                                      // Length of the interval in milliseconds
+ *      unsigned long limit()                                         // Millisecond timestamp the interval ends, modulo 2^32
+ *      unsigned long elapsed(unsigned long now)                      // Milliseconds since begin()
+ *      bool          expired(unsigned long now)                      // True once now has passed limit()
+ *      unsigned long overrun(unsigned long now)                      // Milliseconds now is past limit(), 0 if not expired
+ *      unsigned long remaining(unsigned long now)                    // Milliseconds until expired(), ~0UL if not armed
+ *
+ *   Note: doDevice() style polling must observe an armed Deadline at least once every 2^32 - duration milliseconds.
+ */
+class Deadline {
+  public:
+  Deadline()                                                   {}
+
+  void           start(unsigned long duration)                 {startAt(LSC_MILLIS(),duration);}
+  void           startAt(unsigned long start, unsigned long d) {_start = start;_duration = d;_armed = true;}
+  void           clear()                                       {_armed = false;}
+  bool           armed()                       const           {return _armed;}
+  unsigned long  begin()                       const           {return _start;}
+  unsigned long  duration()                    const           {return _duration;}
+  unsigned long  limit()                       const           {return (uint32_t)(_start + _duration);}
+  unsigned long  elapsed(unsigned long now)    const           {return (uint32_t)(now - _start);}
+  bool           expired(unsigned long now)    const           {return _armed && (elapsed(now) > _duration);}
+  unsigned long  overrun(unsigned long now)    const           {return ((expired(now))?(elapsed(now)-_duration):(0));}
+  unsigned long  remaining(unsigned long now)  const           {return ((!_armed)?(~0UL):((elapsed(now)>_duration)?(0):(_duration-elapsed(now)+1)));}
+
+  private:
+  unsigned long  _start    = 0;                                // Millisecond timestamp of start
+  unsigned long  _duration = 0;                                // Milliseconds from start to limit
+  bool           _armed    = false;
+};
+
+} // End of namespace lsc
+
+#endif
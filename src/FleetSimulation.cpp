@@ -0,0 +1,256 @@
+/**
+ *
+ *  SystemClock Library
+ *  Copyright (C) 2024  Daniel L Toth
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or any
+ *  later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *  The author can be contacted at dan@leelanausoftware.com
+ *
+ */
+
+#include "FleetSimulation.h"
+
+#if defined(LSC_SIMULATION) && (defined(__linux__) || defined(ESP32))
+
+/** Leelanau Software Company namespace
+*
+*/
+namespace lsc {
+
+/**
+ *   The ring must span twice the longest wait in slots, plus the slot a query arrives in, and is rounded up to a power
+ *   of two so a slot is found by mask. A queue limit longer than FLEET_QUEUE_SLOTS/2 slots is shortened to fit. A second
+ *   is counted past seconds, for replies to queries sent just before the end.
+ */
+FleetServer::FleetServer(const ServerModel& m, double capacity, double queueLimit, double seconds, double rate, uint32_t burst) :
+      SimulatedServer(m),
+      _service((uint64_t)(1000000.0/((capacity>1)?(capacity):(1.0)))),
+      _slot((_service>1000)?(_service):(1000)),
+      _perSlot(_slot/_service),
+      _queueLimit((uint64_t)(((queueLimit>0)?(queueLimit):(0.0))*1000000.0)),
+      _limit(GCRA::interval(rate),GCRA::interval(rate)*((burst<1)?(0):(burst-1))),
+      _limited(rate > 0),
+      _seconds((uint32_t)(((seconds>0)?(ceil(seconds)):(0.0))) + 1) {
+  if( _queueLimit > _slot*(FLEET_QUEUE_SLOTS/2) ) _queueLimit = _slot*(FLEET_QUEUE_SLOTS/2);
+  uint64_t need  = 2*((_queueLimit + _slot - 1)/_slot) + 2;
+  uint32_t slots = 2;
+  while( (slots < need) && (slots < FLEET_QUEUE_SLOTS) ) slots <<= 1;
+  _slotMask = slots - 1;
+  _rates    = new std::atomic<uint32_t>[_seconds]();
+  _slots    = new std::atomic<uint64_t>[slots]();
+}
+
+/**
+ *   Queries are counted per second on arrival, whether or not they are answered, so the rate is the offered load.
+ */
+bool FleetServer::respond(double sent, SimRandom& random, double& t2, double& t3, double& arrival) {
+  _queries.fetch_add(1,std::memory_order_relaxed);
+  if( random.uniform() < _model.loss ) {_lost.fetch_add(1,std::memory_order_relaxed);return false;}
+  double out  = _model.delay + _model.asymmetry/2 + random.exponential(_model.jitter);
+  double back = _model.delay - _model.asymmetry/2 + random.exponential(_model.jitter);
+  if( random.uniform() < _model.outliers ) back += _model.outlierDelay;
+  double   at     = sent + out;
+  uint64_t arrive = (uint64_t)(at*1000000.0);
+  uint64_t done;
+  if( (at >= 0) && (at < _seconds) ) _rates[(uint32_t)at].fetch_add(1,std::memory_order_relaxed);
+  if( _limited && !_limit.tryAcquire(1,arrive) ) {_limitedCount.fetch_add(1,std::memory_order_relaxed);return false;}
+  if( !enqueue(arrive,done) ) {_overflows.fetch_add(1,std::memory_order_relaxed);return false;}
+  _queueing.record((uint32_t)(done - _service - arrive));
+  _answered.fetch_add(1,std::memory_order_relaxed);
+  t2      = at + _model.error;
+  t3      = done*1e-6 + _model.error;
+  arrival = done*1e-6 + back;
+  return true;
+}
+
+/**
+ *   A slot holds the queries served within it, one service time apart from its start; a query starts at that place or on
+ *   arrival, whichever is later, and is refused if that is more than the queue limit away. A slot word still holding an
+ *   older slot number is empty; the ring spans twice the longest wait, so a newer number means the slot is out of reach.
+ */
+bool FleetServer::enqueue(uint64_t arrive, uint64_t& done) {
+  for( uint64_t slot=arrive/_slot; ; slot++ ) {
+    std::atomic<uint64_t>& word  = _slots[slot&_slotMask];
+    uint64_t               state = word.load(std::memory_order_relaxed);
+    for( ;; ) {
+      if( (state>>24) > slot ) break;
+      uint64_t count = (((state>>24)==slot)?(state&0xFFFFFF):(0));
+      if( count >= _perSlot ) break;
+      uint64_t start = slot*_slot + count*_service;
+      start = ((start>arrive)?(start):(arrive));
+      if( start - arrive > _queueLimit ) return false;
+      if( word.compare_exchange_weak(state,(slot<<24)|(count+1),std::memory_order_relaxed,std::memory_order_relaxed) ) {
+        done = start + _service;
+        return true;
+      }
+    }
+    if( slot*_slot > arrive + _queueLimit ) return false;
+  }
+}
+
+/**
+ *   Rates are the server's per second counts, so intervals are summarized only within the server's seconds().
+ */
+void FleetReport::print(Print& out, FleetServer& server, double interval) const {
+  uint32_t span = (uint32_t)((seconds<server.seconds())?(seconds):(server.seconds()));
+  uint32_t peak = 0;
+  uint32_t when = 0;
+  for( uint32_t s=0; s<span; s++ ) if( server.rate(s) > peak ) {peak = server.rate(s);when = s;}
+  out.printf("Fleet of %u devices on %u threads, %.2f hours simulated in %.3f s\n",devices,threads,seconds/3600.0,wall);
+  out.printf("Server queries %llu: answered %llu, rate limited %llu, queue full %llu, lost %llu\n",(unsigned long long)server.queries(),
+             (unsigned long long)server.answered(),(unsigned long long)server.limited(),(unsigned long long)server.overflows(),(unsigned long long)server.lost());
+  out.printf("Request rate mean %.1f/s, peak %u/s at %u s\n",((seconds>0)?(server.queries()/seconds):(0.0)),peak,when);
+  out.printf("Queueing p50 %.3f ms, p99 %.3f ms, max %.3f ms\n",server.queueing().percentile(50)*1e-3,server.queueing().percentile(99)*1e-3,server.queueing().max()*1e-3);
+  out.printf("Converged %u of %u, after p50 %.3f s, p90 %.3f s, p99 %.3f s, max %.3f s\n",converged,devices,convergence.percentile(50)*1e-3,
+             convergence.percentile(90)*1e-3,convergence.percentile(99)*1e-3,convergence.max()*1e-3);
+  out.printf("Clock error before sync p50 %.6f s, p99 %.6f s, max %.6f s over %u syncs\n",error.percentile(50)*1e-6,error.percentile(99)*1e-6,error.max()*1e-6,error.count());
+  out.printf("Queries per device p50 %u, max %u\n",queries.percentile(50),queries.max());
+  if( interval < 1 ) return;
+  for( uint32_t begin=0; begin<span; begin+=(uint32_t)interval ) {
+    uint32_t end   = begin + (uint32_t)interval;
+    uint32_t total = 0;
+    uint32_t most  = 0;
+    for( uint32_t s=begin; (s<end) && (s<span); s++ ) {total += server.rate(s);if( server.rate(s) > most ) most = server.rate(s);}
+    out.printf("  %6u s: %7u queries, peak %6u/s\n",begin,total,most);
+  }
+}
+
+FleetSimulation::FleetSimulation(const FleetModel& model, FleetServer& server, double seconds, FleetReport& report) : _model(model), _server(server), _report(report) {
+  unsigned threads = ((model.threads==0)?(std::thread::hardware_concurrency()):(model.threads));
+  threads  = ((threads<1)?(1):((threads>FLEET_MAX_THREADS)?(FLEET_MAX_THREADS):(threads)));
+  _threads = ((model.devices<threads)?(((model.devices<1)?(1):(model.devices))):(threads));
+  _members = new Member*[model.devices];
+  SimRandom random(model.seed);
+  for( uint32_t i=0; i<model.devices; i++ ) {
+    OscillatorModel m = model.oscillator;
+    m.frequency      += model.frequencySpread*random.gaussian();
+    _members[i]       = new Member(server,m,random.next());
+    _members[i]->boot = _members[i]->next = ((model.bootSpread>0)?(random.uniform()*model.bootSpread):(0.0));
+  }
+  _end = seconds;
+}
+
+FleetSimulation::~FleetSimulation() {
+  for( uint32_t i=0; i<_model.devices; i++ ) delete _members[i];
+  delete[] _members;
+}
+
+void FleetSimulation::run(const FleetModel& model, FleetServer& server, double seconds, FleetReport& report) {
+  uint64_t        start = monotonicMicros();
+  FleetSimulation sim(model,server,seconds,report);
+  std::thread     workers[FLEET_MAX_THREADS];
+  for( unsigned t=1; t<sim._threads; t++ ) workers[t] = std::thread(&FleetSimulation::worker,&sim,t);
+  sim.worker(0);
+  for( unsigned t=1; t<sim._threads; t++ ) workers[t].join();
+  for( uint32_t i=0; i<model.devices; i++ ) {
+    report.queries.record(sim._members[i]->device.queries());
+    if( sim._members[i]->converged ) report.converged++;
+  }
+  report.devices += model.devices;
+  report.threads  = sim._threads;
+  report.seconds += seconds;
+  report.wall    += (monotonicMicros() - start)*1e-6;
+}
+
+/**
+ *   Thread t runs devices t, t+threads, ... from a heap ordered by next event. Each round it runs every event before the
+ *   window end, then publishes its earliest remaining event for the next barrier.
+ */
+void FleetSimulation::worker(unsigned t) {
+  uint32_t n    = (_model.devices > t)?((_model.devices - t + _threads - 1)/_threads):(0);
+  Member** heap = new Member*[((n<1)?(1):(n))];
+  for( uint32_t i=0; i<n; i++ ) heap[i] = _members[t + i*_threads];
+  for( uint32_t i=n/2; i-->0; ) sift(heap,n,i);
+  _next[t] = ((n>0)?(heap[0]->next):(_end));
+  while( barrier() ) {
+    while( (n > 0) && (heap[0]->next < _windowEnd) && (heap[0]->next < _end) ) {
+      step(*heap[0]);
+      sift(heap,n,0);
+    }
+    _next[t] = ((n>0)?(heap[0]->next):(_end));
+  }
+  SimulatedDevice::uninstall();
+  delete[] heap;
+}
+
+void FleetSimulation::sift(Member** heap, uint32_t n, uint32_t i) {
+  for( ;; ) {
+    uint32_t least = i;
+    uint32_t left  = 2*i + 1;
+    if( (left < n) && (heap[left]->next < heap[least]->next) ) least = left;
+    if( (left+1 < n) && (heap[left+1]->next < heap[least]->next) ) least = left + 1;
+    if( least == i ) return;
+    Member* m   = heap[i];
+    heap[i]     = heap[least];
+    heap[least] = m;
+    i           = least;
+  }
+}
+
+/**
+ *   The first event boots the device: the sync interval is set (its timer reading the device's ticks) and the clock is
+ *   synchronized. Later events are syncTimer expiries; the clock's error is taken just before each, its worst since the
+ *   last sync. remaining() is in device milliseconds, so the next event is a millisecond later to be sure it is due.
+ */
+void FleetSimulation::step(Member& m) {
+  m.device.install();
+  if( m.next > m.device.now() ) m.device.advance(m.next - m.device.now());
+  if( !m.booted ) {
+    m.booted = true;
+    m.clock.ntpSync(_model.syncMinutes);
+    m.clock.updateSysTime();
+    synced(m);
+  }
+  else {
+    double error = fabs(m.device.error(m.clock))*1e6;
+    m.clock.doDevice();
+    if( m.clock.syncCount() != m.syncs ) {
+      if( m.converged ) _report.error.record((uint32_t)((error>4294967295.0)?(4294967295.0):(error)));
+      synced(m);
+    }
+  }
+  unsigned long ms = m.clock.remaining();
+  m.next = ((ms==TIMER_NO_DEADLINE)?(_end):(m.device.now() + (ms+1)*1e-3));
+}
+
+void FleetSimulation::synced(Member& m) {
+  m.syncs = m.clock.syncCount();
+  if( m.converged || (m.clock.lastSample().status != 1) ) return;
+  m.converged = true;
+  _report.convergence.record((uint32_t)((m.device.now() - m.boot)*1000.0));
+}
+
+/**
+ *   The last thread to arrive starts the next round at the earliest pending event of any thread.
+ */
+bool FleetSimulation::barrier() {
+  std::unique_lock<std::mutex> lock(_mutex);
+  unsigned round = _round;
+  if( ++_waiting == _threads ) {
+    double next = _end;
+    for( unsigned t=0; t<_threads; t++ ) if( _next[t] < next ) next = _next[t];
+    _waiting   = 0;
+    _windowEnd = next + _model.window;
+    _done      = (next >= _end);
+    _round++;
+    _arrived.notify_all();
+  }
+  else _arrived.wait(lock,[this,round]{return _round != round;});
+  return !_done;
+}
+
+} // End of namespace lsc
+
+#endif
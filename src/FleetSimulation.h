@@ -0,0 +1,199 @@
+
+/**
+ *
+ *  SystemClock Library
+ *  Copyright (C) 2024  Daniel L Toth
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or any
+ *  later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *  The author can be contacted at dan@leelanausoftware.com
+ *
+ */
+
+#ifndef FLEET_SIMULATION_H
+#define FLEET_SIMULATION_H
+
+#if defined(LSC_SIMULATION) && (defined(__linux__) || defined(ESP32))
+
+#include <Arduino.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include "Simulation.h"
+#include "RateLimiter.h"
+#include "SystemClock.h"
+
+#define FLEET_MAX_THREADS    64                                        // Most worker threads a FleetSimulation runs
+#define FLEET_QUEUE_SLOTS    16384                                     // Most slots in a FleetServer queue ring, half of it the longest queue
+
+/** Leelanau Software Company namespace
+*
+*/
+namespace lsc {
+
+/**
+ *   FleetServer is a SimulatedServer with finite capacity, shared by every device of a fleet. Queries pass its network as
+ *   in SimulatedServer, then an optional GCRA rate limit (rate per second, bursts of burst), then a queue served at capacity
+ *   per second and holding at most queueLimit seconds of work. Queries over the rate limit or the queue limit are dropped
+ *   unanswered, as a busy server does, and time out at the client. T2 is stamped on arrival and T3 once served, after
+ *   1/capacity seconds of service in place of the model's processing, so queueing adds to round trip delay but, being
+ *   inside T2..T3, not to the offset. Arrivals are counted per second for the first seconds of virtual time, normally the
+ *   length of the FleetSimulation run, and the queue ring is sized to queueLimit, so a server takes 4 bytes per second
+ *   counted plus 8 bytes per queue slot: about 47 KB for 3 hours with a 200 ms queue.
+ *   The following methods are supported:
+ *      uint64_t  answered()                    // Queries answered
+ *      uint64_t  limited()                     // Queries dropped by the rate limit
+ *      uint64_t  overflows()                   // Queries dropped by a full queue
+ *      uint64_t  lost()                        // Queries or replies lost in the network
+ *      uint32_t  rate(uint32_t second)         // Queries arriving in the given second of virtual time, 0 past seconds()
+ *      uint32_t  seconds()                     // Seconds of virtual time counted by rate()
+ *      Histogram& queueing()                   // Microseconds answered queries waited in the queue
+ *
+ *   Devices on several threads query it concurrently, and a device's queries are sent in order but arrive out of order by
+ *   network jitter, so the queue is kept as a ring of slots in virtual time (a millisecond, or one service time if longer)
+ *   rather than a FIFO: a query takes the first slot at or after its arrival with room left, so the result does not depend
+ *   on the order queries are seen in. Each slot is a compare and swap on one atomic word, as is the limiter.
+ */
+class FleetServer : public SimulatedServer {
+  public:
+  FleetServer(const ServerModel& m, double capacity, double queueLimit, double seconds, double rate = 0.0, uint32_t burst = 1);
+  ~FleetServer()                                                       {delete[] _rates;delete[] _slots;}
+
+  bool           respond(double sent, SimRandom& random, double& t2, double& t3, double& arrival) override;
+  uint64_t       answered()                    const                   {return _answered.load(std::memory_order_relaxed);}
+  uint64_t       limited()                     const                   {return _limitedCount.load(std::memory_order_relaxed);}
+  uint64_t       overflows()                   const                   {return _overflows.load(std::memory_order_relaxed);}
+  uint64_t       lost()                        const                   {return _lost.load(std::memory_order_relaxed);}
+  uint32_t       rate(uint32_t second)         const                   {return ((second<_seconds)?(_rates[second].load(std::memory_order_relaxed)):(0));}
+  uint32_t       seconds()                     const                   {return _seconds;}
+  Histogram&     queueing()                                            {return _queueing;}
+
+  private:
+  bool           enqueue(uint64_t arrive, uint64_t& done);             // Take a place in the queue, false if it is full
+
+  uint64_t                 _service;                                   // Microseconds per query
+  uint64_t                 _slot;                                      // Microseconds per queue slot
+  uint64_t                 _perSlot;                                   // Queries served per slot
+  uint64_t                 _queueLimit;                                // Microseconds a query may wait
+  GCRA                     _limit;
+  bool                     _limited;                                   // True if the rate limit is on
+  std::atomic<uint64_t>    _answered{0};
+  std::atomic<uint64_t>    _limitedCount{0};
+  std::atomic<uint64_t>    _overflows{0};
+  std::atomic<uint64_t>    _lost{0};
+  uint32_t                 _seconds;                                   // Seconds counted in _rates
+  uint32_t                 _slotMask;                                  // Slots in the ring, a power of two, less one
+  std::atomic<uint32_t>*   _rates;                                     // Queries arriving per second
+  std::atomic<uint64_t>*   _slots;                                     // [40 bit slot number][24 bit queries served in it]
+  Histogram                _queueing;
+};
+
+/**
+ *   FleetModel describes a fleet: how many devices, how they boot (all within bootSpread seconds of time 0, 0 for all at
+ *   once, as after a power cut), how their oscillators vary (each device's frequency is oscillator.frequency plus a normal
+ *   variate of frequencySpread ppm), and their sync interval.
+ */
+typedef struct FleetModel {
+  uint32_t         devices         = 1000;
+  unsigned         threads         = 0;                                // Worker threads, 0 for one per core
+  double           bootSpread      = 0.0;
+  OscillatorModel  oscillator;
+  double           frequencySpread = 20.0;
+  unsigned int     syncMinutes     = 15;
+  double           window          = 0.05;                             // Seconds of virtual time the threads run between barriers
+  uint64_t         seed            = 1;
+} FleetModel;
+
+/**
+ *   FleetReport holds the fleet's view of a FleetSimulation: convergence time from boot to first answered sync, queries per
+ *   device, and each converged clock's error just before each later sync (its worst), with the server's own counts.
+ */
+class FleetReport {
+  public:
+  void           print(Print& out, FleetServer& server, double interval) const;   // Summary, and the peak request rate in each interval
+
+  Histogram      convergence;                                          // Milliseconds from boot to first answered sync
+  Histogram      error;                                                // Microseconds of clock error before each sync
+  Histogram      queries;                                              // NTP queries per device
+  uint32_t       devices     = 0;
+  uint32_t       converged   = 0;
+  unsigned       threads     = 0;
+  double         seconds     = 0.0;                                    // Virtual time simulated
+  double         wall        = 0.0;                                    // Real time taken
+};
+
+/**
+ *   FleetSimulation runs a fleet of SystemClocks in one process, each on its own SimulatedDevice, all querying one
+ *   FleetServer, spread over worker threads. Each device is driven by its events (boot, then each syncTimer expiry given by
+ *   SystemClock::remaining()), not by fixed steps, and the threads advance together through windows of virtual time, each
+ *   window starting at the earliest pending event, so idle time costs nothing and arrivals at the server are ordered to
+ *   within a window. With one thread a run replays exactly for a given seed; with more, queries in the same window reach
+ *   the server in whatever order the threads run, so queueing, and what follows from it, varies a little between runs.
+ *   Threads are std::thread, so a fleet runs on Linux or an ESP32, where memory, not time, limits its size: each device
+ *   holds a SimulatedDevice and a SystemClock, about 1 KB, besides the FleetServer's counts.
+ *
+ *   Example:
+ *      ServerModel     net;
+ *      FleetServer     server(net,5000.0,0.2,3*3600.0);       // 5000 queries per second, 200 ms queue, rates kept for 3 hours
+ *      FleetModel      fleet;
+ *      fleet.devices = 10000;                                 // All reboot at once
+ *      FleetReport     report;
+ *      FleetSimulation::run(fleet,server,3*3600.0,report);
+ *      report.print(Serial,server,fleet.syncMinutes*60.0);
+ */
+class FleetSimulation {
+  public:
+  static void    run(const FleetModel& model, FleetServer& server, double seconds, FleetReport& report);
+
+  private:
+  typedef struct Member {
+    Member(FleetServer& server, const OscillatorModel& m, uint64_t seed) : device(server,m,seed) {}
+    SimulatedDevice  device;
+    SystemClock      clock;
+    double           boot      = 0.0;
+    double           next      = 0.0;                                  // True time of the next event
+    bool             booted    = false;
+    bool             converged = false;
+    unsigned int     syncs     = 0;
+  } Member;
+
+  FleetSimulation(const FleetModel& model, FleetServer& server, double seconds, FleetReport& report);
+  ~FleetSimulation();
+
+  void           worker(unsigned t);
+  void           step(Member& m);                                      // Run m's next event
+  void           synced(Member& m);                                    // Record a sync of m
+  bool           barrier();                                            // Wait for every thread, false when the run is over
+  static void    sift(Member** heap, uint32_t n, uint32_t i);          // Restore the heap below i, earliest event first
+
+  const FleetModel&        _model;
+  FleetServer&             _server;
+  FleetReport&             _report;
+  double                   _end;
+  unsigned                 _threads;
+  Member**                 _members;
+  double                   _next[FLEET_MAX_THREADS];                   // Earliest event of each thread
+  double                   _windowEnd  = 0.0;
+  bool                     _done       = false;
+  unsigned                 _round      = 0;
+  unsigned                 _waiting    = 0;
+  std::mutex               _mutex;
+  std::condition_variable  _arrived;
+};
+
+} // End of namespace lsc
+
+#endif
+#endif
@@ -0,0 +1,83 @@
+/**
+ *
+ *  SystemClock Library
+ *  Copyright (C) 2024  Daniel L Toth
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or any
+ *  later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *  The author can be contacted at dan@leelanausoftware.com
+ *
+ */
+
+#include "HLC.h"
+
+/** Leelanau Software Company namespace
+*
+*/
+namespace lsc {
+
+/**
+ *   Era is resolved against ref exactly as NTPTime resolves server era; if the era offsets differ by more than 68 years
+ *   the timestamps straddle an era boundary.
+ */
+Instant HLCTimestamp::toInstant(const Instant& ref) const {
+  uint32_t secs     = (uint32_t)(_physical>>16);
+  uint32_t fraction = (uint32_t)(_physical&0xFFFF)<<16;
+  int64_t  diff     = (int64_t)ref.eraOffset() - (int64_t)secs;
+  int32_t  era      = ref.era();
+  if( diff > SECS_IN_68_YEARS ) era += 1;
+  else if( diff < -SECS_IN_68_YEARS ) era -= 1;
+  Instant result;
+  result.initialize(era,secs,fraction);
+  return result;
+}
+
+/**
+ *   Send or local event. Since the logical counter occupies the low order bits, the HLC rules
+ *      l' = max(l,pt); c' = ((l'==l)?(c+1):(0))
+ *   reduce to a single comparison on encoded values.
+ */
+uint64_t HLC::now() {
+  uint64_t pt  = physicalTime();
+  uint64_t old = _last.load(std::memory_order_relaxed);
+  uint64_t next;
+  do {
+    next = ((pt > old)?(pt):(old+1));
+  } while( !_last.compare_exchange_weak(old,next,std::memory_order_acq_rel,std::memory_order_relaxed) );
+  return next;
+}
+
+/**
+ *   Receive event. With m = max(l,remote) on encoded values, the HLC merge rules reduce to
+ *      result = ((pt > m)?(pt):(m+1))
+ *   A remote timestamp leading local physical time by more than maxDrift() is rejected and 0 is returned without
+ *   modifying the clock.
+ */
+uint64_t HLC::update(uint64_t remote) {
+  uint64_t pt      = physicalTime();
+  uint64_t limit   = ((uint64_t)_maxDrift<<16)/1000;
+  uint64_t rPhys   = remote>>HLC_LOGICAL_BITS;
+  uint64_t ptPhys  = pt>>HLC_LOGICAL_BITS;
+  if( (rPhys > ptPhys) && ((rPhys-ptPhys) > limit) ) return 0;
+
+  uint64_t old = _last.load(std::memory_order_relaxed);
+  uint64_t next;
+  do {
+    uint64_t m = ((old > remote)?(old):(remote));
+    next = ((pt > m)?(pt):(m+1));
+  } while( !_last.compare_exchange_weak(old,next,std::memory_order_acq_rel,std::memory_order_relaxed) );
+  return next;
+}
+
+} // End of namespace lsc
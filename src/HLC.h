@@ -0,0 +1,120 @@
+
+/**
+ *
+ *  SystemClock Library
+ *  Copyright (C) 2024  Daniel L Toth
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or any
+ *  later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *  The author can be contacted at dan@leelanausoftware.com
+ *
+ */
+
+#ifndef HLC_H
+#define HLC_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "Instant.h"
+#include "SystemClock.h"
+
+#define HLC_LOGICAL_BITS   16                              // Low order bits of an encoded HLC timestamp used for the logical counter
+#define HLC_LOGICAL_MASK   0xFFFFULL
+#define HLC_MAX_DRIFT      60000UL                         // Default limit in milliseconds a remote timestamp may lead local physical time
+
+/** Leelanau Software Company namespace
+*
+*/
+namespace lsc {
+
+/**
+ *   HLCTimestamp is a Hybrid Logical Clock timestamp consisting of a 48-bit physical time and a 16-bit logical counter, packed
+ *   into a single 64-bit integer as:
+ *      [32 bit NTP era offset][16 high order bits of NTP fraction][16 bit logical counter]
+ *   The physical part is therefore NTP time with a resolution of 2**-16 seconds (about 15 microseconds), and the packed
+ *   value orders exactly as (physical,logical) so encoded timestamps can be compared as plain unsigned integers.
+ *   Era is not carried in the encoding, so converting back to an Instant requires a reference Instant within 68 years,
+ *   in the same way NTPTime resolves era for server timestamps.
+ */
+class HLCTimestamp {
+  public:
+  HLCTimestamp()                                               {}
+  HLCTimestamp(uint64_t physical, uint16_t logical)            {_physical=physical&PHYSICAL_MASK;_logical=logical;}
+  HLCTimestamp(const Instant& t, uint16_t logical=0)           {_physical=toPhysical(t);_logical=logical;}
+
+  uint64_t             physical()      const                   {return _physical;}           // 48-bit physical time
+  uint16_t             logical()       const                   {return _logical;}            // 16-bit logical counter
+  uint64_t             encode()        const                   {return (_physical<<HLC_LOGICAL_BITS)|_logical;}
+  Instant              toInstant(const Instant& ref) const;                                  // Physical time as Instant, era taken from ref
+
+  static HLCTimestamp  decode(uint64_t hlc)                    {return HLCTimestamp(hlc>>HLC_LOGICAL_BITS,(uint16_t)(hlc&HLC_LOGICAL_MASK));}
+  static uint64_t      toPhysical(const Instant& t)            {return ((uint64_t)t.eraOffset()<<16)|(t.fraction()>>16);}
+
+  private:
+  static const uint64_t PHYSICAL_MASK = 0xFFFFFFFFFFFFULL;
+
+  uint64_t       _physical = 0;
+  uint16_t       _logical  = 0;
+};
+
+/**
+ *   HLC is a Hybrid Logical Clock (Kulkarni et al.) driven by SystemClock. Timestamps track NTP synchronized time as closely
+ *   as possible while guaranteeing that every timestamp issued is strictly greater than any timestamp previously issued or
+ *   received, so causally related events across nodes are ordered even when physical clocks disagree.
+ *   The following methods are supported:
+ *      uint64_t  now()                    // Timestamp a local or send event
+ *      uint64_t  update(uint64_t remote)  // Merge a timestamp received from another node, returns 0 if remote is rejected
+ *      uint64_t  last()                   // Last timestamp issued or merged
+ *      void      maxDrift(unsigned long)  // Milliseconds a remote timestamp may lead local physical time before it is rejected
+ *
+ *   State is a single encoded timestamp held in an atomic. now() and update() are lock-free compare and swap loops, and
+ *   last() is a single atomic load and therefore wait-free. Physical time is read with SystemClock::peekTime(), which never
+ *   synchronizes with NTP and reads the time the loop last published under a sequence lock, so HLC may be used from any
+ *   thread while SystemClock::doDevice() runs in the application loop. peekTime() retries if it overlaps a publish, so a
+ *   reader may spin for the few instructions of a publish; now() and update() are lock-free only between publishes.
+ *
+ *   Example:
+ *      SystemClock c;
+ *      HLC         hlc(c);
+ *      uint64_t    sent = hlc.now();                  // Stamp an outgoing message
+ *      ...
+ *      uint64_t    rcvd = hlc.update(msg.hlc);        // Merge the timestamp of an incoming message
+ *      Instant     when = HLCTimestamp::decode(rcvd).toInstant(c.sysTime());
+ *
+ *   Note:
+ *      1. When the logical counter overflows it carries into the physical part, advancing HLC by 2**-16 seconds.
+ *      2. HLC is built on std::atomic<uint64_t>, which is lock-free on 64-bit hosts; on 32-bit ESP cores the
+ *         toolchain may implement 64-bit atomics with a short critical section.
+ */
+class HLC {
+  public:
+  HLC(SystemClock& c) : _clock(c)                              {}
+
+  uint64_t       now();
+  uint64_t       update(uint64_t remote);
+  uint64_t       last()                        const           {return _last.load(std::memory_order_acquire);}
+  void           maxDrift(unsigned long millis)                {_maxDrift = millis;}
+  unsigned long  maxDrift()                    const           {return _maxDrift;}
+
+  private:
+  uint64_t       physicalTime()                const           {return HLCTimestamp::toPhysical(_clock.peekTime())<<HLC_LOGICAL_BITS;}
+
+  SystemClock&            _clock;
+  std::atomic<uint64_t>   _last{0};                            // Last encoded timestamp issued or merged
+  unsigned long           _maxDrift = HLC_MAX_DRIFT;
+};
+
+} // End of namespace lsc
+
+#endif
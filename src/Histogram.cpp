@@ -0,0 +1,102 @@
+/**
+ *
+ *  SystemClock Library
+ *  Copyright (C) 2024  Daniel L Toth
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or any
+ *  later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *  The author can be contacted at dan@leelanausoftware.com
+ *
+ */
+
+#include "Histogram.h"
+
+/** Leelanau Software Company namespace
+*
+*/
+namespace lsc {
+
+/**
+ *   For v of at least HISTOGRAM_SUB_COUNT with highest bit e, the bucket is the power (e - HISTOGRAM_SUB_BITS + 1) in the
+ *   high bits and the HISTOGRAM_SUB_BITS bits below e in the low bits.
+ */
+int Histogram::index(uint32_t v) {
+  if( v < HISTOGRAM_SUB_COUNT ) return (int)v;
+  int e = 31 - __builtin_clz(v);
+  return ((e-HISTOGRAM_SUB_BITS+1)<<HISTOGRAM_SUB_BITS) + (int)((v>>(e-HISTOGRAM_SUB_BITS)) & (HISTOGRAM_SUB_COUNT-1));
+}
+
+uint32_t Histogram::lowest(int i) {
+  if( i < HISTOGRAM_SUB_COUNT ) return (uint32_t)i;
+  int shift = (i>>HISTOGRAM_SUB_BITS) - 1;
+  return (uint32_t)(HISTOGRAM_SUB_COUNT + (i&(HISTOGRAM_SUB_COUNT-1))) << shift;
+}
+
+void Histogram::record(uint32_t v) {
+  _buckets[index(v)].fetch_add(1,std::memory_order_relaxed);
+  _sum.fetch_add(v,std::memory_order_relaxed);
+  if( v < _min.load(std::memory_order_relaxed) ) lower(v);
+  if( v > _max.load(std::memory_order_relaxed) ) raise(v);
+  _count.fetch_add(1,std::memory_order_relaxed);
+}
+
+void Histogram::lower(uint32_t v) {
+  uint32_t current = _min.load(std::memory_order_relaxed);
+  while( (v < current) && !_min.compare_exchange_weak(current,v,std::memory_order_relaxed) ) {}
+}
+
+void Histogram::raise(uint32_t v) {
+  uint32_t current = _max.load(std::memory_order_relaxed);
+  while( (v > current) && !_max.compare_exchange_weak(current,v,std::memory_order_relaxed) ) {}
+}
+
+/**
+ *   The rank of the p'th percentile is rounded up, so percentile(100) is the bucket holding max() and percentile(0) the
+ *   bucket holding min(). Reporting the bucket's upper bound overstates by at most the bucket width.
+ */
+uint32_t Histogram::percentile(double p) const {
+  uint32_t n = count();
+  if( n == 0 ) return 0;
+  p = ((p<0)?(0):((p>100)?(100):(p)));
+  uint64_t rank = (uint64_t)(p*n/100.0 + 0.999999);
+  if( rank < 1 ) rank = 1;
+  uint64_t seen = 0;
+  for( int i=0; i<HISTOGRAM_BUCKETS; i++ ) {
+    seen += bucket(i);
+    if( seen >= rank ) {uint32_t h = highest(i);return ((h<max())?(h):(max()));}
+  }
+  return max();
+}
+
+void Histogram::merge(const Histogram& h) {
+  if( h.count() == 0 ) return;
+  for( int i=0; i<HISTOGRAM_BUCKETS; i++ ) {
+    uint32_t c = h.bucket(i);
+    if( c != 0 ) _buckets[i].fetch_add(c,std::memory_order_relaxed);
+  }
+  _sum.fetch_add(h.sum(),std::memory_order_relaxed);
+  lower(h.min());
+  raise(h.max());
+  _count.fetch_add(h.count(),std::memory_order_relaxed);
+}
+
+void Histogram::reset() {
+  for( int i=0; i<HISTOGRAM_BUCKETS; i++ ) _buckets[i].store(0,std::memory_order_relaxed);
+  _sum.store(0,std::memory_order_relaxed);
+  _min.store(0xFFFFFFFF,std::memory_order_relaxed);
+  _max.store(0,std::memory_order_relaxed);
+  _count.store(0,std::memory_order_relaxed);
+}
+
+} // End of namespace lsc
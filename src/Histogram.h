@@ -0,0 +1,103 @@
+
+/**
+ *
+ *  SystemClock Library
+ *  Copyright (C) 2024  Daniel L Toth
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or any
+ *  later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *  The author can be contacted at dan@leelanausoftware.com
+ *
+ */
+
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <Arduino.h>
+#include <atomic>
+
+#define HISTOGRAM_SUB_BITS   3                                          // log2 of linear sub-buckets per power of two
+#define HISTOGRAM_SUB_COUNT  (1<<HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_BUCKETS    ((33-HISTOGRAM_SUB_BITS)<<HISTOGRAM_SUB_BITS)     // Buckets covering every 32-bit value
+
+/** Leelanau Software Company namespace
+*
+*/
+namespace lsc {
+
+/**
+ *   Histogram counts 32-bit values in fixed log-linear buckets: values below HISTOGRAM_SUB_COUNT have a bucket each, and
+ *   every power of two above is split into HISTOGRAM_SUB_COUNT equal buckets, so a bucket is never wider than 1/8 of its
+ *   lower bound. The full 32-bit range takes HISTOGRAM_BUCKETS (240) counters and no configuration, and a record costs a
+ *   count-leading-zeros and a few relaxed atomic adds, cheap enough to leave enabled in production.
+ *   The following methods are supported:
+ *      void      record(uint32_t v)            // Count one value
+ *      uint32_t  count()                       // Values recorded
+ *      uint64_t  sum()                         // Sum of values recorded
+ *      uint32_t  min()                         // Smallest value recorded, 0 if none
+ *      uint32_t  max()                         // Largest value recorded
+ *      double    mean()                        // Average value recorded, 0 if none
+ *      uint32_t  percentile(double p)          // Upper bound of the bucket holding the p'th percentile (0 to 100), at most max()
+ *      uint32_t  bucket(int i)                 // Values counted in bucket i
+ *      void      merge(const Histogram& h)     // Add the counts of h to this Histogram
+ *      void      reset()                       // Forget all values
+ *      static int      index(uint32_t v)       // Bucket counting v
+ *      static uint32_t lowest(int i)           // Smallest value counted in bucket i
+ *      static uint32_t highest(int i)          // Largest value counted in bucket i
+ *
+ *   Any number of threads may record() concurrently with readers; a reader sees each counter exactly but may see a
+ *   record() partly applied, so count() and the buckets can briefly disagree by the records in flight. reset() and
+ *   merge() are not atomic as a whole.
+ *
+ *   Example:
+ *      Histogram rtt;
+ *      rtt.record(micros() - sent);
+ *      Serial.printf("RTT p50 %u p99 %u max %u us\n",rtt.percentile(50),rtt.percentile(99),rtt.max());
+ */
+class Histogram {
+  public:
+  Histogram()                                                  {reset();}
+
+  void           record(uint32_t v);
+  uint32_t       count()                       const           {return _count.load(std::memory_order_relaxed);}
+  uint64_t       sum()                         const           {return _sum.load(std::memory_order_relaxed);}
+  uint32_t       min()                         const           {return ((count()==0)?(0):(_min.load(std::memory_order_relaxed)));}
+  uint32_t       max()                         const           {return _max.load(std::memory_order_relaxed);}
+  double         mean()                        const           {uint32_t n = count();return ((n==0)?(0.0):((double)sum()/n));}
+  uint32_t       percentile(double p)          const;
+  uint32_t       bucket(int i)                 const           {return _buckets[i].load(std::memory_order_relaxed);}
+  void           merge(const Histogram& h);
+  void           reset();
+
+  static int      index(uint32_t v);
+  static uint32_t lowest(int i);
+  static uint32_t highest(int i)                               {return ((i<HISTOGRAM_SUB_COUNT)?((uint32_t)i):(lowest(i) + ((1UL<<((i>>HISTOGRAM_SUB_BITS)-1))-1)));}
+
+  private:
+  Histogram(const Histogram&)            = delete;
+  Histogram& operator=(const Histogram&) = delete;
+
+  void           lower(uint32_t v);                            // Lower _min to v
+  void           raise(uint32_t v);                            // Raise _max to v
+
+  std::atomic<uint32_t>  _buckets[HISTOGRAM_BUCKETS];
+  std::atomic<uint32_t>  _count;
+  std::atomic<uint64_t>  _sum;
+  std::atomic<uint32_t>  _min;
+  std::atomic<uint32_t>  _max;
+};
+
+} // End of namespace lsc
+
+#endif
@@ -0,0 +1,122 @@
+
+/**
+ *
+ *  SystemClock Library
+ *  Copyright (C) 2024  Daniel L Toth
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or any
+ *  later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *  The author can be contacted at dan@leelanausoftware.com
+ *
+ */
+
+#ifndef INPLACE_FUNCTION_H
+#define INPLACE_FUNCTION_H
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#define INPLACE_FUNCTION_SIZE  (4*sizeof(void*))     // Default storage in bytes, large enough to hold a std::function
+
+/** Leelanau Software Company namespace
+*
+*/
+namespace lsc {
+
+template<typename Signature, size_t Capacity = INPLACE_FUNCTION_SIZE>
+class InplaceFunction;
+
+/**
+ *   InplaceFunction is a move-only replacement for std::function that stores its callable in a fixed buffer of Capacity
+ *   bytes inside the object, and never allocates from the heap. A callable that does not fit is a compile time error
+ *   rather than a silent heap allocation, so capacity is sized to the largest lambda capture a caller needs.
+ *   The following methods are supported:
+ *      InplaceFunction()                  // Empty function
+ *      InplaceFunction(F f)               // Store callable f, which must fit in Capacity bytes; an empty std::function or a
+ *                                         // null function pointer gives an empty function
+ *      R        operator()(Args... args)  // Invoke the callable; an empty function does nothing and returns R()
+ *      explicit operator bool()           // True if a callable is stored
+ *
+ *   Invocation is one indirect call through a per-type operations table. Because an empty function points to a table
+ *   whose invoke does nothing, operator() never has to test for empty.
+ *
+ *   Example:
+ *      InplaceFunction<void(int),16> f = [this](int i){count += i;};
+ *      f(2);
+ */
+template<typename R, typename... Args, size_t Capacity>
+class InplaceFunction<R(Args...),Capacity> {
+  public:
+  InplaceFunction()                                            {}
+  InplaceFunction(std::nullptr_t)                              {}
+  InplaceFunction(InplaceFunction&& f)                         {f._ops->move(_storage,f._storage);_ops = f._ops;f._ops = &EMPTY;}
+  ~InplaceFunction()                                           {_ops->destroy(_storage);}
+
+  template<typename F, typename T = typename std::decay<F>::type,
+           typename = typename std::enable_if<!std::is_same<T,InplaceFunction>::value && std::is_invocable_r<R,T&,Args...>::value>::type>
+  InplaceFunction(F&& f) {
+    static_assert(sizeof(T) <= Capacity, "InplaceFunction: callable too large, increase Capacity");
+    static_assert(alignof(T) <= alignof(std::max_align_t), "InplaceFunction: callable alignment not supported");
+    if constexpr( std::is_constructible<bool,T&>::value ) {if( !static_cast<bool>(f) ) return;}
+    new (_storage) T(std::forward<F>(f));
+    _ops = &Callable<T>::OPS;
+  }
+
+  InplaceFunction& operator=(InplaceFunction&& f)              {if(this != &f) {_ops->destroy(_storage);f._ops->move(_storage,f._storage);_ops = f._ops;f._ops = &EMPTY;}return *this;}
+  InplaceFunction& operator=(std::nullptr_t)                   {_ops->destroy(_storage);_ops = &EMPTY;return *this;}
+  template<typename F>
+  InplaceFunction& operator=(F&& f)                            {*this = InplaceFunction(std::forward<F>(f));return *this;}
+
+  R              operator()(Args... args)                      {return _ops->invoke(_storage,std::forward<Args>(args)...);}
+  explicit       operator bool()               const           {return _ops != &EMPTY;}
+
+  InplaceFunction(const InplaceFunction&)            = delete;
+  InplaceFunction& operator=(const InplaceFunction&) = delete;
+
+  private:
+  typedef struct Ops {
+    R     (*invoke)(void* obj, Args&&... args);
+    void  (*move)(void* dst, void* src);                       // Move construct into dst and destroy src
+    void  (*destroy)(void* obj);
+  } Ops;
+
+  template<typename T>
+  struct Callable {
+    static R     invoke(void* obj, Args&&... args)             {return (*static_cast<T*>(obj))(std::forward<Args>(args)...);}
+    static void  move(void* dst, void* src)                    {new (dst) T(std::move(*static_cast<T*>(src)));static_cast<T*>(src)->~T();}
+    static void  destroy(void* obj)                            {static_cast<T*>(obj)->~T();}
+    static constexpr Ops OPS = {invoke,move,destroy};
+  };
+
+  static R       emptyInvoke(void*, Args&&...)                 {return R();}
+  static void    emptyMove(void*, void*)                       {}
+  static void    emptyDestroy(void*)                           {}
+  static constexpr Ops EMPTY = {emptyInvoke,emptyMove,emptyDestroy};
+
+  alignas(std::max_align_t) unsigned char  _storage[Capacity];
+  const Ops*                               _ops = &EMPTY;
+};
+
+template<typename R, typename... Args, size_t Capacity>
+constexpr typename InplaceFunction<R(Args...),Capacity>::Ops InplaceFunction<R(Args...),Capacity>::EMPTY;
+
+template<typename R, typename... Args, size_t Capacity>
+template<typename T>
+constexpr typename InplaceFunction<R(Args...),Capacity>::Ops InplaceFunction<R(Args...),Capacity>::Callable<T>::OPS;
+
+} // End of namespace lsc
+
+#endif
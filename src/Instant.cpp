@@ -242,6 +242,20 @@ void Instant::printDateTime(char buffer[], unsigned int buffLen) const {
   Instant::printDateTime(d,t,buffer,buffLen);
 }
 
+/**
+ *   The fraction is truncated, not rounded, so the printed time never runs ahead into the next second.
+ */
+void Instant::printISO(char buffer[], unsigned int buffLen, int digits) const {
+  Date d = toDate();
+  Time t = toTime();
+  digits = ((digits<0)?(0):((digits>9)?(9):(digits)));
+  if( digits == 0 ) {snprintf(buffer,buffLen,"%04d-%02d-%02dT%02d:%02d:%02dZ",d.year,d.month,d.day,t.hour,t.min,t.sec);return;}
+  uint64_t scale = 1;
+  for( int i=0; i<digits; i++ ) scale *= 10;
+  unsigned long part = (unsigned long)(((uint64_t)fraction()*scale)>>32);
+  snprintf(buffer,buffLen,"%04d-%02d-%02dT%02d:%02d:%02d.%0*luZ",d.year,d.month,d.day,t.hour,t.min,t.sec,digits,part);
+}
+
 void Instant::printTime(const Time& t, char buffer[], unsigned int buffLen) {
   snprintf(buffer,buffLen,"%02d:%02d:%02d",t.hour,t.min,t.sec);
 }
@@ -136,6 +136,7 @@ class Instant {
   void           printTime(char buffer[], unsigned int buffLen)               const;   // Format Instant to Time only into input buffer
   void           printDate(char buffer[], unsigned int buffLen)               const;   // Format Instant to Date only into inpur buffer
   void           printElapsedTime(const Instant& ref,char buffer[], int size) const;   // Print elapsed time between this Instant and ref as xx Days, hh:mm:ss
+  void           printISO(char buffer[], unsigned int buffLen, int digits=3)  const;   // Format as ISO 8601 UTC, yyyy-mm-ddThh:mm:ss.fffZ with digits (0 to 9) of fraction
 
   static const char* MONTHS[12];
 
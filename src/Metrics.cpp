@@ -0,0 +1,230 @@
+/**
+ *
+ *  SystemClock Library
+ *  Copyright (C) 2024  Daniel L Toth
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or any
+ *  later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *  The author can be contacted at dan@leelanausoftware.com
+ *
+ */
+
+#include <math.h>
+#include <stdarg.h>
+#include "Metrics.h"
+
+/** Leelanau Software Company namespace
+*
+*/
+namespace lsc {
+
+/**
+ *   Format one line into a stack buffer and write it, so no Print::printf() implementation gets the chance to allocate
+ *   for a long line. Lines longer than METRICS_LINE_SIZE are truncated.
+ */
+static size_t emit(Print& out, const char* fmt, ...) __attribute__((format(printf,2,3)));
+static size_t emit(Print& out, const char* fmt, ...) {
+  char    line[METRICS_LINE_SIZE];
+  va_list args;
+  va_start(args,fmt);
+  int n = vsnprintf(line,sizeof(line),fmt,args);
+  va_end(args);
+  if( n <= 0 ) return 0;
+  if( (size_t)n >= sizeof(line) ) n = sizeof(line)-1;
+  return out.write((const uint8_t*)line,n);
+}
+
+/**
+ *   OpenMetrics spells the special values NaN, +Inf and -Inf.
+ */
+static const char* special(double v) {
+  if( isnan(v) ) return "NaN";
+  if( isinf(v) ) return ((v>0)?("+Inf"):("-Inf"));
+  return NULL;
+}
+
+static size_t value(Print& out, const char* name, const char* suffix, const char* open, const char* labels, const char* close, double v) {
+  const char* s = special(v);
+  if( s != NULL ) return emit(out,"%s%s%s%s%s %s\n",name,suffix,open,labels,close,s);
+  return emit(out,"%s%s%s%s%s %.9g\n",name,suffix,open,labels,close,v);
+}
+
+/**
+ *   Print that fills a character buffer, counting what did not fit.
+ */
+class BufferPrint : public Print {
+  public:
+  BufferPrint(char* buf, size_t len) : _buf(buf), _len(len) {}
+
+  size_t write(uint8_t c) override                             {return write(&c,1);}
+  size_t write(const uint8_t* b, size_t n) override {
+    for( size_t i=0; i<n; i++, _size++ ) if( _size+1 < _len ) _buf[_size] = (char)b[i];
+    if( _len > 0 ) _buf[((_size<_len)?(_size):(_len-1))] = '\0';
+    return n;
+  }
+  size_t size()                                const           {return _size;}
+
+  private:
+  char*          _buf;
+  size_t         _len;
+  size_t         _size = 0;
+};
+
+bool Metrics::add(const char* name, const char* help, const char* labels, MetricType type, const void* value, double scale) {
+  int n = _size.load(std::memory_order_relaxed);
+  if( n >= METRICS_MAX ) return false;
+  _metrics[n] = {name,help,labels,type,value,scale};
+  _size.store(n+1,std::memory_order_release);
+  return true;
+}
+
+/**
+ *   Families are written in order of first registration, each with all of its series, however they were interleaved.
+ */
+size_t Metrics::write(Print& out) const {
+  int    n      = size();
+  size_t result = 0;
+  for( int i=0; i<n; i++ ) {
+    bool seen = false;
+    for( int j=0; (j<i) && !seen; j++ ) seen = (strcmp(_metrics[j].name,_metrics[i].name) == 0);
+    if( !seen ) result += family(out,i,n);
+  }
+  result += emit(out,"# EOF\n");
+  return result;
+}
+
+size_t Metrics::write(char* buf, size_t len) const {
+  BufferPrint out(buf,len);
+  write(out);
+  return out.size();
+}
+
+size_t Metrics::family(Print& out, int first, int n) const {
+  static const char* types[] = {"counter","gauge","histogram"};
+  const Metric& m      = _metrics[first];
+  size_t        result = 0;
+  result += emit(out,"# TYPE %s %s\n",m.name,types[m.type]);
+  if( m.help != NULL ) result += emit(out,"# HELP %s %s\n",m.name,m.help);
+  for( int i=first; i<n; i++ ) {
+    if( strcmp(_metrics[i].name,m.name) == 0 ) result += sample(out,_metrics[i]);
+  }
+  return result;
+}
+
+/**
+ *   A Histogram is summed over each power of two of its log-linear buckets, which begin and end on them, so the written
+ *   buckets are exact. Buckets end at the power of two holding max(), and le of each is the power of two above it, the bound
+ *   on values truncated to integer units when recorded.
+ */
+size_t Metrics::sample(Print& out, const Metric& m) const {
+  const char* labels = ((m.labels==NULL)?(""):(m.labels));
+  const char* open   = ((m.labels==NULL)?(""):("{"));
+  const char* close  = ((m.labels==NULL)?(""):("}"));
+  const char* sep    = ((m.labels==NULL)?(""):(","));
+  switch( m.type ) {
+    case METRIC_COUNTER:
+      return emit(out,"%s_total%s%s%s %llu\n",m.name,open,labels,close,(unsigned long long)((const Counter*)m.value)->value());
+    case METRIC_GAUGE:
+      return value(out,m.name,"",open,labels,close,((const Gauge*)m.value)->value());
+    case METRIC_HISTOGRAM: {
+      const Histogram* h      = (const Histogram*)m.value;
+      int              last   = Histogram::index(h->max()) | (HISTOGRAM_SUB_COUNT-1);
+      uint64_t         count  = 0;
+      size_t           result = 0;
+      for( int i=0; i<=last; i++ ) {
+        count += h->bucket(i);
+        if( (i&(HISTOGRAM_SUB_COUNT-1)) != (HISTOGRAM_SUB_COUNT-1) ) continue;
+        result += emit(out,"%s_bucket{%s%sle=\"%.9g\"} %llu\n",m.name,labels,sep,((double)Histogram::highest(i)+1)*m.scale,(unsigned long long)count);
+      }
+      result += emit(out,"%s_bucket{%s%sle=\"+Inf\"} %llu\n",m.name,labels,sep,(unsigned long long)count);
+      result += emit(out,"%s_count%s%s%s %llu\n",m.name,open,labels,close,(unsigned long long)count);
+      result += value(out,m.name,"_sum",open,labels,close,h->sum()*m.scale);
+      return result;
+    }
+  }
+  return 0;
+}
+
+NTPMetrics::NTPMetrics(Metrics& registry) : _registry(registry) {
+  _registry.add("clock_offset_seconds","Absolute clock offset corrected at each NTP sync.",_offset,1e-6);
+  _registry.add("clock_frequency_ppm","Frequency error of the oscillator in parts per million, positive when fast.",_frequency);
+  _registry.add("clock_syncs","Times system time has been set.",_syncs);
+}
+
+/**
+ *   A server is registered on its first sample, while slots remain.
+ */
+NTPMetrics::Server* NTPMetrics::server(const IPAddress& address) {
+  for( int i=0; i<_serverCount; i++ ) if( _servers[i].address == address ) return &_servers[i];
+  if( _serverCount >= NTP_METRICS_SERVERS ) return NULL;
+  Server* s  = &_servers[_serverCount++];
+  s->address = address;
+  snprintf(s->labels,sizeof(s->labels),"server=\"%u.%u.%u.%u\"",address[0],address[1],address[2],address[3]);
+  _registry.add("ntp_queries","NTP queries sent.",s->queries,s->labels);
+  _registry.add("ntp_responses","NTP queries answered.",s->responses,s->labels);
+  _registry.add("ntp_timeouts","NTP queries that timed out.",s->timeouts,s->labels);
+  _registry.add("ntp_errors","NTP queries that could not be sent.",s->errors,s->labels);
+  _registry.add("ntp_offset_seconds","Clock offset of the last NTP response.",s->offset,s->labels);
+  _registry.add("ntp_delay_seconds","Round trip delay of the last NTP response.",s->delay,s->labels);
+  _registry.add("ntp_jitter_seconds","RMS difference of successive NTP offsets.",s->jitter,s->labels);
+  _registry.add("ntp_stratum","Stratum of the last NTP response.",s->stratum,s->labels);
+  _registry.add("ntp_rtt_seconds","Round trip delay of NTP responses.",s->rtt,1e-6,s->labels);
+  return s;
+}
+
+/**
+ *   Jitter is averaged with weight 1/4 per sample, the NTP clock filter's choice. A failed query steps the clock by 0, so
+ *   it leaves the frequency chain intact; any other step between syncs (seen as syncCount() moving by more than one) breaks it.
+ */
+void NTPMetrics::record(const NTPSample& sample, unsigned int syncCount) {
+  bool chained   = _chained && (syncCount == _lastSyncCount+1);
+  _lastSyncCount = syncCount;
+  _syncs.set(syncCount);
+  _chained       = chained;
+
+  Server* s = server(sample.server);
+  if( s != NULL ) {
+    s->queries.inc();
+    if( sample.status == -3 ) s->timeouts.inc();
+    else if( sample.status != 1 ) s->errors.inc();
+  }
+  if( sample.status != 1 ) return;
+
+  double offset = sample.offset.sysTimed();
+  double delay  = sample.delay.sysTimed();
+  if( s != NULL ) {
+    double diff = offset - s->lastOffset;
+    s->variance = ((s->answered)?(s->variance + (diff*diff - s->variance)/4):(0.0));
+    s->responses.inc();
+    s->offset.set(offset);
+    s->delay.set(delay);
+    s->jitter.set(sqrt(s->variance));
+    s->stratum.set(sample.stratum);
+    s->rtt.record((uint32_t)((delay<0)?(0):((delay>4294.0)?(4294967295.0):(delay*1e6))));
+    s->lastOffset = offset;
+    s->answered   = true;
+  }
+
+  double magnitude = fabs(offset)*1e6;
+  _offset.record((uint32_t)((magnitude>4294967295.0)?(4294967295.0):(magnitude)));
+  Instant corrected = sample.t4 + sample.offset;
+  if( chained ) {
+    double elapsed = (sample.t4 - _lastSync).sysTimed();
+    if( elapsed > 0 ) _frequency.set(-offset/elapsed*1e6);
+  }
+  _lastSync = corrected;
+  _chained  = true;
+}
+
+} // End of namespace lsc
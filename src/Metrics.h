@@ -0,0 +1,185 @@
+
+/**
+ *
+ *  SystemClock Library
+ *  Copyright (C) 2024  Daniel L Toth
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or any
+ *  later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *  The author can be contacted at dan@leelanausoftware.com
+ *
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "Histogram.h"
+#include "NTPTime.h"
+
+#define METRICS_MAX          48                 // Metrics a registry holds
+#define METRICS_LINE_SIZE    192                // Longest line written, formatted on the stack
+#define NTP_METRICS_SERVERS  2                  // Time servers NTPMetrics keeps separate figures for
+#define METRICS_CONTENT_TYPE "application/openmetrics-text; version=1.0.0; charset=utf-8"
+
+/** Leelanau Software Company namespace
+*
+*/
+namespace lsc {
+
+/**
+ *   Counter is a monotonically increasing count and Gauge a value that may go up and down, each a single relaxed atomic
+ *   so they may be updated from any thread while a registry is being written.
+ */
+class Counter {
+  public:
+  void           inc(uint64_t n = 1)                           {_value.fetch_add(n,std::memory_order_relaxed);}
+  uint64_t       value()                       const           {return _value.load(std::memory_order_relaxed);}
+  void           reset()                                       {_value.store(0,std::memory_order_relaxed);}
+
+  private:
+  std::atomic<uint64_t>  _value{0};
+};
+
+class Gauge {
+  public:
+  void           set(double v)                                 {_value.store(v,std::memory_order_relaxed);}
+  double         value()                       const           {return _value.load(std::memory_order_relaxed);}
+
+  private:
+  std::atomic<double>    _value{0.0};
+};
+
+enum MetricType {METRIC_COUNTER, METRIC_GAUGE, METRIC_HISTOGRAM};
+
+typedef struct Metric {
+  const char*    name;                          // Metric family name, without the _total suffix of a counter
+  const char*    help;                          // Help text for the family
+  const char*    labels;                        // Label set without braces, e.g. server="10.0.0.1", or NULL
+  MetricType     type;
+  const void*    value;                         // Counter, Gauge, or Histogram
+  double         scale;                         // Histogram values are multiplied by scale when written
+} Metric;
+
+/**
+ *   Metrics is a fixed registry of up to METRICS_MAX Counters, Gauges and Histograms, written as OpenMetrics text for a
+ *   Prometheus style scraper. A family is one name; register it several times with different labels for one series per
+ *   label set, and the series are written together under one TYPE and HELP. The registry holds pointers only: metrics,
+ *   names, help and labels must outlive it.
+ *   The following methods are supported:
+ *      bool      add(name,help,Counter&,labels)               // Register a counter, false if the registry is full
+ *      bool      add(name,help,Gauge&,labels)                 // Register a gauge
+ *      bool      add(name,help,Histogram&,scale,labels)       // Register a histogram, values written multiplied by scale
+ *      int       size()                        // Metrics registered
+ *      size_t    write(Print& out)             // Write every metric as OpenMetrics text, returning bytes written
+ *      size_t    write(char* buf, size_t len)  // Write into buf, always terminated, returning the length the full text needs
+ *
+ *   Writing allocates nothing: each line is formatted into a stack buffer and handed to out.write(). A Histogram is written
+ *   with cumulative buckets at each power of two it has reached, so its buckets appear as larger values are recorded.
+ *   Registration is by a single thread; any thread may write, and metrics registered while writing may or may not appear.
+ *
+ *   Example:
+ *      Metrics   registry;
+ *      Counter   requests;
+ *      Histogram latency;
+ *      registry.add("http_requests","HTTP requests served.",requests);
+ *      registry.add("http_latency_seconds","HTTP request latency.",latency,1e-6);     // latency recorded in microseconds
+ *      registry.write(Serial);
+ */
+class Metrics {
+  public:
+  bool           add(const char* name, const char* help, Counter& c, const char* labels = NULL)   {return add(name,help,labels,METRIC_COUNTER,&c,1.0);}
+  bool           add(const char* name, const char* help, Gauge& g, const char* labels = NULL)     {return add(name,help,labels,METRIC_GAUGE,&g,1.0);}
+  bool           add(const char* name, const char* help, Histogram& h, double scale, const char* labels = NULL) {return add(name,help,labels,METRIC_HISTOGRAM,&h,scale);}
+  int            size()                        const           {return _size.load(std::memory_order_acquire);}
+  size_t         write(Print& out)             const;
+  size_t         write(char* buf, size_t len)  const;
+
+  private:
+  bool           add(const char* name, const char* help, const char* labels, MetricType type, const void* value, double scale);
+  size_t         family(Print& out, int first, int n) const;  // Write the family named by _metrics[first]
+  size_t         sample(Print& out, const Metric& m) const;
+
+  Metric                 _metrics[METRICS_MAX];
+  std::atomic<int>       _size{0};
+};
+
+/**
+ *   NTPMetrics keeps the health of NTP synchronization in a Metrics registry. Give it to SystemClock::setMetrics() and
+ *   each sync records its NTPSample; figures are per time server, for up to NTP_METRICS_SERVERS servers (later servers
+ *   are not recorded). The families registered are:
+ *      ntp_queries_total{server}             // Queries sent
+ *      ntp_responses_total{server}           // Queries answered
+ *      ntp_timeouts_total{server}            // Queries that timed out
+ *      ntp_errors_total{server}              // Queries that could not be sent
+ *      ntp_offset_seconds{server}            // Clock offset of the last response
+ *      ntp_delay_seconds{server}             // Round trip delay of the last response
+ *      ntp_jitter_seconds{server}            // RMS of successive offset differences, exponentially averaged
+ *      ntp_stratum{server}                   // Stratum of the last response
+ *      ntp_rtt_seconds{server}               // Histogram of round trip delay
+ *      clock_offset_seconds                  // Histogram of absolute clock offset corrected at each sync
+ *      clock_frequency_ppm                   // Frequency error of the oscillator, positive when fast
+ *      clock_syncs                           // SystemClock::syncCount()
+ *
+ *   Frequency is the offset corrected at a sync over the time since the previous one, so it is only computed when no other
+ *   step (initialize(), reset()) came between them. record() is called from the syncing thread only.
+ *
+ *   Example:
+ *      Metrics     registry;
+ *      NTPMetrics  ntpMetrics(registry);
+ *      sysClock.setMetrics(&ntpMetrics);
+ *      server.on("/metrics",[]{handleMetrics();});      // Streams registry.write() as chunked content, see examples/SystemClock
+ */
+class NTPMetrics {
+  public:
+  NTPMetrics(Metrics& registry);
+
+  void           record(const NTPSample& sample, unsigned int syncCount);
+  Metrics&       registry()                                    {return _registry;}
+
+  private:
+  typedef struct Server {
+    IPAddress    address;
+    char         labels[32];
+    Counter      queries;
+    Counter      responses;
+    Counter      timeouts;
+    Counter      errors;
+    Gauge        offset;
+    Gauge        delay;
+    Gauge        jitter;
+    Gauge        stratum;
+    Histogram    rtt;
+    double       lastOffset = 0.0;
+    double       variance   = 0.0;            // Exponential average of squared offset differences
+    bool         answered   = false;          // True once a response has been recorded
+  } Server;
+
+  Server*        server(const IPAddress& address);
+
+  Metrics&       _registry;
+  Server         _servers[NTP_METRICS_SERVERS];
+  int            _serverCount = 0;
+  Histogram      _offset;
+  Gauge          _frequency;
+  Gauge          _syncs;
+  Instant        _lastSync;                    // Corrected time of the last answered sync
+  bool           _chained       = false;       // True while no step has come since _lastSync
+  unsigned int   _lastSyncCount = 0;           // syncCount() after the last record()
+};
+
+} // End of namespace lsc
+
+#endif
@@ -23,6 +23,14 @@
 
 #include <math.h>
 #include "NTPTime.h"
+#include "Probes.h"
+
+#ifdef LSC_SIMULATION
+#include "Simulation.h"
+typedef lsc::SimulatedUDP NTPChannel;                                 // Queries go to the thread's SimulatedDevice
+#else
+typedef WiFiUDP NTPChannel;
+#endif
 
 /** Leelanau Software Company namespace 
 *  
@@ -34,6 +42,9 @@ int           NTPTime::NTP_PORT    = 123;
 unsigned long NTPTime::NTP_TIMEOUT = 2000;
 
 IPAddress NTPTime::getTimeServerAddress() {
+#ifdef LSC_SIMULATION
+  return IPAddress(127,0,1,123);                                      // Simulated servers need no name resolution
+#endif
   IPAddress result;
   int err = WiFi.hostByName("time.google.com", result);
   if( err != 1 ) {
@@ -59,7 +70,7 @@ IPAddress NTPTime::getTimeServerAddress() {
  *     int      LI           - Leap Indicator
  *     int      VER          - NTP Version
  *     int      MODE         - Mode (Client = 3, Server = 4)
- *     int      STRATUM      - Stratum (0 = KoD, 1 = Primary Server, 2.. Secondary)
+ *     int      STRATUM      - Stratum (0 = KoD, 1 = Primary Server, 2.. Secondary), returned in stratum if not NULL
  *     int      POLL         - Poll Interval (Log base2)
  *     int      PRECISION    - Clock Precision (Log base2)
  *
@@ -69,7 +80,7 @@ IPAddress NTPTime::getTimeServerAddress() {
  *     status -3: Time limit exceeded waiting for NTP response
  *  On error, return values are initialized to 0;
  */
-int  NTPTime::getNTPTimestamp(uint32_t& rcvSecs, uint32_t& rcvFraction, uint32_t& tsmSecs, uint32_t& tsmFraction, unsigned long timeout, IPAddress timeServer, int port ) {
+int  NTPTime::getNTPTimestamp(uint32_t& rcvSecs, uint32_t& rcvFraction, uint32_t& tsmSecs, uint32_t& tsmFraction, unsigned long timeout, IPAddress timeServer, int port, int* stratum ) {
 
 /** Return values
  */
@@ -91,7 +102,7 @@ int  NTPTime::getNTPTimestamp(uint32_t& rcvSecs, uint32_t& rcvFraction, uint32_t
 /** Set up the UDP channel
  *    
  */ 
-  WiFiUDP udpChannel;
+  NTPChannel udpChannel;
   int status = udpChannel.begin(0);
   if( status != 1 ) {
     Serial.printf("Error initializing UDP channel (on udpChannel.begin)\n");
@@ -135,18 +146,20 @@ int  NTPTime::getNTPTimestamp(uint32_t& rcvSecs, uint32_t& rcvFraction, uint32_t
     status = -2;
   }
   else {
+    LSC_PROBE(ntp_query_send,(uint32_t)timeServer,port);
 
 
 /**
  *   Read NTP Response
  */
-    unsigned long beginWait  = millis();
+    unsigned long beginWait  = LSC_MILLIS();
     bool          done       = false;
-    while (((millis() - beginWait) < timeout) && !done) {
+    while ((((uint32_t)(LSC_MILLIS() - beginWait)) < timeout) && !done) {
       int size = udpChannel.parsePacket();
       if (size >= NTP_PACKET_SIZE) {
 
         udpChannel.read(packetBuffer, NTP_PACKET_SIZE);  // read packet into the buffer
+        LSC_PROBE(ntp_reply_receive,(uint32_t)timeServer,(int)packetBuffer[1],(uint32_t)(LSC_MILLIS()-beginWait));
 
 /**
  *    Parse the header: Leap Indicator (2 bits), Version (3 bits), Mode (3 bits), Stratum (8 bits), Poll (8 bits), Precision (8 bits), and RefID (char[5])
@@ -204,8 +217,12 @@ int  NTPTime::getNTPTimestamp(uint32_t& rcvSecs, uint32_t& rcvFraction, uint32_t
 
       }
     }
-    if( !done ) status = -3;
+    if( !done ) {
+      status = -3;
+      LSC_PROBE(ntp_query_timeout,(uint32_t)timeServer,LSC_MILLIS()-beginWait);
+    }
   }
+  if( stratum != NULL ) *stratum = STRATUM;
 
 /** 
  *  Tear down the UDP channel
@@ -221,13 +238,20 @@ Timestamp NTPTime::updateSysTime( Instant& clockOffset, const Timestamp& ref, un
   return t4;
 }
 
+Timestamp NTPTime::updateSysTime( NTPSample& sample, const Timestamp& ref, unsigned long timeout, IPAddress timeServer, int port ) {
+  Timestamp t1,t2,t3,t4;
+  Instant clockOffset = NTPTime::getNTPOffset(t1,t2,t3,t4,ref,timeout,timeServer,port,&sample);
+  t4 += clockOffset;
+  return t4;
+}
+
 Instant NTPTime::ntpClockOffset(const Timestamp& ref, unsigned long timeout, IPAddress timeServer, int port) {
   Timestamp t1,t2,t3,t4;
   Instant result = NTPTime::getNTPOffset(t1,t2,t3,t4,ref,timeout,timeServer,port);
   return result;
 }
 
-Instant NTPTime::getNTPOffset(Timestamp& t1, Timestamp& t2, Timestamp& t3, Timestamp& t4, const Timestamp& ref, unsigned long timeout, IPAddress timeServer, int port) {
+Instant NTPTime::getNTPOffset(Timestamp& t1, Timestamp& t2, Timestamp& t3, Timestamp& t4, const Timestamp& ref, unsigned long timeout, IPAddress timeServer, int port, NTPSample* sample) {
   uint32_t rcvSecs, rcvFraction, tsmSecs, tsmFraction;
   Instant zero, T2, T3;
 
@@ -237,7 +261,8 @@ Instant NTPTime::getNTPOffset(Timestamp& t1, Timestamp& t2, Timestamp& t3, Times
   t1 = Timestamp::stampTime(ref);
   t2.initialize(zero);
 
-  int status = getNTPTimestamp(rcvSecs, rcvFraction, tsmSecs, tsmFraction, timeout, timeServer, port);
+  int stratum = 0;
+  int status  = getNTPTimestamp(rcvSecs, rcvFraction, tsmSecs, tsmFraction, timeout, timeServer, port, &stratum);
 
 /**
 *  Stamp millis after NTP call, t3 initialized to zero Instant
@@ -311,6 +336,19 @@ Instant NTPTime::getNTPOffset(Timestamp& t1, Timestamp& t2, Timestamp& t3, Times
 **/
 
   Instant clockOffset = ((T2-T1)+(T3-T4))/2;
+  if( LSC_PROBE_ENABLED(ntp_offset) ) LSC_PROBE(ntp_offset,status,(int64_t)(clockOffset.sysTimed()*1e9),(int64_t)(((T4-T1)-(T3-T2)).sysTimed()*1e9));
+  if( sample != NULL ) {
+    sample->server  = timeServer;
+    sample->port    = port;
+    sample->status  = status;
+    sample->stratum = stratum;
+    sample->t1      = T1;
+    sample->t2      = T2;
+    sample->t3      = T3;
+    sample->t4      = T4;
+    sample->offset  = clockOffset;
+    sample->delay   = (T4-T1)-(T3-T2);
+  }
   return clockOffset;
 }
 
@@ -41,6 +41,23 @@
 */
 namespace lsc {
 
+/**
+ *   NTPSample is the complete record of one NTP query: the four timestamps, the offset and round trip delay computed from
+ *   them, and the status and stratum of the response. On error (status != 1) T2 = T1 and T3 = T4, so offset and delay are 0.
+ */
+typedef struct NTPSample {
+  IPAddress  server;                      // Time server queried
+  int        port     = 0;                // Time server port
+  int        status   = 0;                // getNTPTimestamp() status, 1 on success
+  int        stratum  = 0;                // Server stratum (0 = KoD, 1 = Primary Server, 2.. Secondary)
+  Instant    t1;                          // Request sent, client clock
+  Instant    t2;                          // Request received, server clock
+  Instant    t3;                          // Response sent, server clock
+  Instant    t4;                          // Response received, client clock
+  Instant    offset;                      // Clock offset ((T2-T1)+(T3-T4))/2
+  Instant    delay;                       // Round trip delay (T4-T1)-(T3-T2)
+} NTPSample;
+
 /** 
  *   Background:
  *   Network Time Protocol (NTP) is used for synchronizing clocks over the Internet. The wire protocol provides an unsigned 
@@ -149,6 +166,7 @@ class NTPTime {
  *            Timestamp&       t2         - Timestamp request was received on the NTP server
  *            Timestamp&       t3         - Timestamp response was sent on the NTP server
  *            Timestamp&       t4         - Timestamp NTP response was received
+ *            int*             stratum    - Stratum of the responding server, if not NULL
  *   Returns 1 on success otherwise:
  *     status -1: Error initializing udp channel on begin()
  *     status -2: Error writing udp packet to the channel
@@ -156,7 +174,7 @@ class NTPTime {
  *
  *  On error, return values are initialized to 0
  */
-    static int        getNTPTimestamp(uint32_t& rcvSecs, uint32_t& rcvFraction, uint32_t& tsmSecs, uint32_t& tsmFraction, unsigned long timeout = NTP_TIMEOUT, IPAddress timeServer = NTP_SERVER, int port = NTP_PORT);
+    static int        getNTPTimestamp(uint32_t& rcvSecs, uint32_t& rcvFraction, uint32_t& tsmSecs, uint32_t& tsmFraction, unsigned long timeout = NTP_TIMEOUT, IPAddress timeServer = NTP_SERVER, int port = NTP_PORT, int* stratum = NULL);
 
 /**
  *    Calculate NTP clock offset based on the input timestamp and return a Timestamp updated with NTP clock offset, and
@@ -170,6 +188,12 @@ class NTPTime {
  */
     static Timestamp   updateSysTime(Instant& ofst, const Timestamp& ref, unsigned long timeout = NTP_TIMEOUT, IPAddress timeServer = NTP_SERVER, int port = NTP_PORT );
 
+/**
+ *    As above, returning the complete NTPSample of the query rather than only the clock offset.
+ *   Output:  NTPSample&       sample     - Timestamps, offset, delay, status and stratum of the query
+ */
+    static Timestamp   updateSysTime(NTPSample& sample, const Timestamp& ref, unsigned long timeout = NTP_TIMEOUT, IPAddress timeServer = NTP_SERVER, int port = NTP_PORT );
+
 /**
  *   Calculate the NTP clock offset from the internal millisecond timer using the input UTC Timestamp ref as a template. 
  *   Note that the input ref Timestamp is used only as an initialized template, and once synchronized to NTP is used
@@ -209,6 +233,7 @@ class NTPTime {
  *            Timestamp&       t2         - Timestamp request was received on the NTP server
  *            Timestamp&       t3         - Timestamp response was sent on the NTP server
  *            Timestamp&       t4         - Timestamp NTP response was received
+ *            NTPSample*       sample     - Complete record of the query, if not NULL
  *   Returns: NTP clock offset as Instant
  *
  *   Note that the Timestamp Instants of T2 and T3 come from the NTP server but their actual millisecond timestamps come 
@@ -217,7 +242,7 @@ class NTPTime {
  *   Updated system time can then be computed as: Timestamp sysTime = t4 + clockOffset
  *   On error, clock offset is set to Instant(0,0) so t4 will not be affected by applying the offset.
  */
-    static Instant     getNTPOffset(Timestamp& t1,  Timestamp& t2,  Timestamp& t3,  Timestamp& t4, const Timestamp& ref, unsigned long timeout = NTP_TIMEOUT, IPAddress timeServer = NTP_SERVER, int port = NTP_PORT);
+    static Instant     getNTPOffset(Timestamp& t1,  Timestamp& t2,  Timestamp& t3,  Timestamp& t4, const Timestamp& ref, unsigned long timeout = NTP_TIMEOUT, IPAddress timeServer = NTP_SERVER, int port = NTP_PORT, NTPSample* sample = NULL);
 
     static IPAddress       NTP_SERVER;
     static int             NTP_PORT;
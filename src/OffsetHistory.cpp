@@ -0,0 +1,264 @@
+/**
+ *
+ *  SystemClock Library
+ *  Copyright (C) 2024  Daniel L Toth
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or any
+ *  later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *  The author can be contacted at dan@leelanausoftware.com
+ *
+ */
+
+#include <string.h>
+#include "OffsetHistory.h"
+
+#define CHUNK_BITS     (OFFSET_HISTORY_CHUNK_SIZE*8)
+#define HEADER_BITS    128                                             // [time i64][offset f32][delay f32]
+#define NO_WINDOW      0xFF                                            // No XOR window written yet
+
+/** Leelanau Software Company namespace
+*
+*/
+namespace lsc {
+
+/**
+ *   Bits are packed most significant first. A NULL data only counts them, so an encoding can be sized before it is written.
+ */
+static void putBits(uint8_t* data, uint32_t& bit, uint64_t v, int n) {
+  for( int i=n-1; i>=0; i--, bit++ ) {
+    if( data == NULL ) continue;
+    uint8_t mask = 0x80 >> (bit&7);
+    if( (v>>i)&1 ) data[bit>>3] |= mask;
+    else data[bit>>3] &= ~mask;
+  }
+}
+
+static uint64_t getBits(const uint8_t* data, uint32_t& bit, int n) {
+  uint64_t v = 0;
+  for( int i=0; i<n; i++, bit++ ) v = (v<<1) | ((data[bit>>3]>>(7-(bit&7)))&1);
+  return v;
+}
+
+static int64_t signExtend(uint64_t v, int n)                           {return (int64_t)(v<<(64-n))>>(64-n);}
+static uint32_t floatBits(double v)                                    {float f = (float)v;uint32_t b;memcpy(&b,&f,4);return b;}
+static double   bitsFloat(uint32_t b)                                  {float f;memcpy(&f,&b,4);return f;}
+
+/**
+ *   Gorilla value encoding: '0' for a repeated value, '10' and the meaningful bits if they fall within the previous
+ *   window, otherwise '11', 5 bits of leading zeros, 5 bits of length-1, and the meaningful bits, opening a new window.
+ */
+static void putXor(uint8_t* data, uint32_t& bit, uint32_t prev, uint32_t v, uint8_t& lead, uint8_t& trail) {
+  uint32_t x = prev ^ v;
+  if( x == 0 ) {putBits(data,bit,0,1);return;}
+  int l = __builtin_clz(x);
+  int t = __builtin_ctz(x);
+  if( (lead != NO_WINDOW) && (l >= lead) && (t >= trail) ) {
+    putBits(data,bit,2,2);
+    putBits(data,bit,x>>trail,32-lead-trail);
+    return;
+  }
+  putBits(data,bit,3,2);
+  putBits(data,bit,l,5);
+  putBits(data,bit,32-l-t-1,5);
+  putBits(data,bit,x>>t,32-l-t);
+  lead  = l;
+  trail = t;
+}
+
+static uint32_t getXor(const uint8_t* data, uint32_t& bit, uint32_t prev, uint8_t& lead, uint8_t& trail) {
+  if( getBits(data,bit,1) == 0 ) return prev;
+  if( getBits(data,bit,1) == 1 ) {
+    lead  = (uint8_t)getBits(data,bit,5);
+    trail = (uint8_t)(32 - lead - (getBits(data,bit,5)+1));
+  }
+  return prev ^ ((uint32_t)getBits(data,bit,32-lead-trail)<<trail);
+}
+
+/**
+ *   Times are encoded as the change in delta since the previous sample: '0' for none, then '10', '110', '1110' and '1111'
+ *   prefixes for 7, 9, 12 and 40 bit two's complement changes. A change beyond 40 bits (17 years) cannot be encoded.
+ */
+bool OffsetHistory::encode(uint8_t* data, uint32_t& bit, uint32_t limit, State& st, int64_t time, uint32_t offset, uint32_t delay) {
+  int64_t delta = time - st.time;
+  int64_t dod   = delta - st.delta;
+  if( dod == 0 ) putBits(data,bit,0,1);
+  else if( (dod >= -64) && (dod < 64) )     {putBits(data,bit,2,2);putBits(data,bit,(uint64_t)dod,7);}
+  else if( (dod >= -256) && (dod < 256) )   {putBits(data,bit,6,3);putBits(data,bit,(uint64_t)dod,9);}
+  else if( (dod >= -2048) && (dod < 2048) ) {putBits(data,bit,14,4);putBits(data,bit,(uint64_t)dod,12);}
+  else if( (dod >= -(1LL<<39)) && (dod < (1LL<<39)) ) {putBits(data,bit,15,4);putBits(data,bit,(uint64_t)dod,40);}
+  else return false;
+  putXor(data,bit,st.offset,offset,st.offsetLead,st.offsetTrail);
+  putXor(data,bit,st.delay,delay,st.delayLead,st.delayTrail);
+  st.time   = time;
+  st.delta  = delta;
+  st.offset = offset;
+  st.delay  = delay;
+  return bit <= limit;
+}
+
+/**
+ *   The sample is sized with a dry run on a copy of the state, and starts a new chunk if it does not fit.
+ */
+bool OffsetHistory::append(const Instant& time, double offset, double delay) {
+  int64_t  t = toMillis(time);
+  uint32_t o = floatBits(offset);
+  uint32_t d = floatBits(delay);
+  if( (_size > 0) && (t < _state.time) ) return false;
+  if( _count > 0 ) {
+    int    s   = slot(_count-1);
+    Chunk& c   = _chunks[s];
+    State  dry = _state;
+    uint32_t bit = c.bits;
+    if( (c.count < 0xFFFF) && encode(NULL,bit,CHUNK_BITS,dry,t,o,d) ) {
+      bit = c.bits;
+      encode(_data[s],bit,CHUNK_BITS,_state,t,o,d);
+      c.bits  = bit;
+      c.last  = t;
+      c.count++;
+      _size++;
+      return true;
+    }
+  }
+  start(t,o,d);
+  return true;
+}
+
+void OffsetHistory::start(int64_t time, uint32_t offset, uint32_t delay) {
+  if( _count == OFFSET_HISTORY_CHUNKS ) {
+    _dropped += _chunks[_oldest].count;
+    _size    -= _chunks[_oldest].count;
+    _oldest   = (_oldest+1)%OFFSET_HISTORY_CHUNKS;
+    _count--;
+  }
+  int      s   = slot(_count++);
+  uint32_t bit = 0;
+  putBits(_data[s],bit,(uint64_t)time,64);
+  putBits(_data[s],bit,offset,32);
+  putBits(_data[s],bit,delay,32);
+  _chunks[s] = {time,time,1,(uint16_t)bit};
+  _state     = {time,0,offset,delay,NO_WINDOW,NO_WINDOW,NO_WINDOW,NO_WINDOW};
+  _size++;
+}
+
+void OffsetHistory::reset() {
+  _oldest  = 0;
+  _count   = 0;
+  _size    = 0;
+  _dropped = 0;
+  _state   = {0,0,0,0,NO_WINDOW,NO_WINDOW,NO_WINDOW,NO_WINDOW};
+}
+
+size_t OffsetHistory::bytes() const {
+  size_t result = 0;
+  for( int i=0; i<_count; i++ ) result += (_chunks[slot(i)].bits + 7)/8;
+  return result;
+}
+
+/**
+ *   Chunks are in time order, so those ending before from are skipped undecoded and the scan ends at the first sample past to.
+ */
+bool OffsetHistory::Cursor::next(OffsetSample& s) {
+  for( ;; ) {
+    if( (_chunk < 0) || (_decoded >= _history._chunks[_history.slot(_chunk)].count) ) {
+      do {
+        if( ++_chunk >= _history._count ) return false;
+      } while( _history._chunks[_history.slot(_chunk)].last < _from );
+      _decoded = 0;
+      _bit     = 0;
+    }
+    int64_t  time;
+    uint32_t offset, delay;
+    decode(time,offset,delay);
+    if( time < _from ) continue;
+    if( time > _to ) {_chunk = _history._count;return false;}
+    s.time   = fromMillis(time);
+    s.offset = bitsFloat(offset);
+    s.delay  = bitsFloat(delay);
+    return true;
+  }
+}
+
+void OffsetHistory::Cursor::decode(int64_t& time, uint32_t& offset, uint32_t& delay) {
+  const uint8_t* data = _history._data[_history.slot(_chunk)];
+  if( _decoded++ == 0 ) {
+    int64_t  t = (int64_t)getBits(data,_bit,64);
+    uint32_t o = (uint32_t)getBits(data,_bit,32);
+    uint32_t d = (uint32_t)getBits(data,_bit,32);
+    _state = {t,0,o,d,NO_WINDOW,NO_WINDOW,NO_WINDOW,NO_WINDOW};
+  }
+  else {
+    int64_t dod = 0;
+    if( getBits(data,_bit,1) == 1 ) {
+      if( getBits(data,_bit,1) == 0 ) dod = signExtend(getBits(data,_bit,7),7);
+      else if( getBits(data,_bit,1) == 0 ) dod = signExtend(getBits(data,_bit,9),9);
+      else if( getBits(data,_bit,1) == 0 ) dod = signExtend(getBits(data,_bit,12),12);
+      else dod = signExtend(getBits(data,_bit,40),40);
+    }
+    _state.delta += dod;
+    _state.time  += _state.delta;
+    _state.offset = getXor(data,_bit,_state.offset,_state.offsetLead,_state.offsetTrail);
+    _state.delay  = getXor(data,_bit,_state.delay,_state.delayLead,_state.delayTrail);
+  }
+  time   = _state.time;
+  offset = _state.offset;
+  delay  = _state.delay;
+}
+
+/**
+ *   Buckets are seconds wide from from; each bucket holding samples yields one with the mean time, offset and delay.
+ */
+size_t OffsetHistory::downsample(const Instant& from, const Instant& to, uint32_t seconds, OffsetSample* out, size_t max) const {
+  int64_t      start  = toMillis(from);
+  int64_t      width  = (int64_t)((seconds<1)?(1):(seconds))*1000;
+  int64_t      bucket = -1;
+  int64_t      times  = 0;
+  double       offset = 0.0;
+  double       delay  = 0.0;
+  uint32_t     n      = 0;
+  size_t       result = 0;
+  OffsetSample s;
+  Cursor       c      = scan(from,to);
+  for( bool more = c.next(s); result < max; more = c.next(s) ) {
+    int64_t t = (more)?(toMillis(s.time)):(0);
+    if( (n > 0) && (!more || ((t - start)/width != bucket)) ) {
+      out[result].time   = fromMillis(start + bucket*width + times/n);
+      out[result].offset = offset/n;
+      out[result].delay  = delay/n;
+      result++;
+      n = 0;
+    }
+    if( !more ) break;
+    if( n == 0 ) {bucket = (t - start)/width;times = 0;offset = 0.0;delay = 0.0;}
+    times  += t - (start + bucket*width);
+    offset += s.offset;
+    delay  += s.delay;
+    n++;
+  }
+  return result;
+}
+
+/**
+ *   The CSV read by the host tool in extras/AllanDeviation.
+ */
+void OffsetHistory::write(Print& out) const {
+  OffsetSample s;
+  Cursor       c = scan();
+  out.printf("time,offset,delay\n");
+  while( c.next(s) ) {
+    int64_t ms = toMillis(s.time);
+    out.printf("%lld.%03d,%.9g,%.9g\n",(long long)(ms/1000),(int)(ms%1000),s.offset,s.delay);
+  }
+}
+
+} // End of namespace lsc
@@ -0,0 +1,154 @@
+
+/**
+ *
+ *  SystemClock Library
+ *  Copyright (C) 2024  Daniel L Toth
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or any
+ *  later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *  The author can be contacted at dan@leelanausoftware.com
+ *
+ */
+
+#ifndef OFFSET_HISTORY_H
+#define OFFSET_HISTORY_H
+
+#include <Arduino.h>
+#include "Instant.h"
+#include "NTPTime.h"
+
+#define OFFSET_HISTORY_CHUNK_SIZE  256                                  // Bytes per compressed chunk
+#define OFFSET_HISTORY_CHUNKS      16                                   // Chunks kept, the oldest overwritten when all are full
+
+/** Leelanau Software Company namespace
+*
+*/
+namespace lsc {
+
+/**
+ *   OffsetSample is one synchronization: the UTC time it set, the clock offset it corrected, and the round trip delay.
+ */
+typedef struct OffsetSample {
+  Instant        time;
+  double         offset    = 0.0;                                      // Seconds
+  double         delay     = 0.0;                                      // Seconds
+} OffsetSample;
+
+/**
+ *   OffsetHistory keeps a long series of OffsetSamples in a fixed OFFSET_HISTORY_CHUNKS*OFFSET_HISTORY_CHUNK_SIZE bytes,
+ *   compressed as in Facebook's Gorilla time series store: times (in milliseconds) as a delta of deltas, so syncs on a
+ *   regular interval cost a bit or a byte, and offset and delay (as 32-bit floats, about 7 significant digits) XOR'd with
+ *   the previous value and stored as only their meaningful bits. Each chunk starts with a full sample and records the span
+ *   of times it holds, so a range scan decodes only the chunks overlapping the range. When every chunk is full the oldest
+ *   is overwritten, so the newest history is always kept.
+ *   The following methods are supported:
+ *      bool      append(const Instant& time, double offset, double delay)   // Add a sample, false if time is before the last sample
+ *      bool      append(const NTPSample& s)    // Add an answered NTP query, sampled at its corrected T4
+ *      Cursor    scan(const Instant& from, const Instant& to)               // Iterate samples with from <= time <= to, oldest first
+ *      Cursor    scan()                        // Iterate every sample
+ *      size_t    downsample(from,to,seconds,out,max)   // Average samples in buckets of seconds into out, returning buckets written
+ *      void      write(Print& out)             // Export every sample as CSV lines of NTP seconds, offset and delay
+ *      uint32_t  size()                        // Samples held
+ *      uint32_t  dropped()                     // Samples overwritten
+ *      size_t    bytes()                       // Compressed bytes in use
+ *      void      reset()                       // Forget all samples
+ *
+ *   Appends and reads are made from one thread; a Cursor is invalidated by a later append().
+ *
+ *   Example:
+ *      OffsetHistory history;
+ *      ...
+ *      sysClock.updateSysTime();
+ *      history.append(sysClock.lastSample());
+ *      ...
+ *      OffsetSample hourly[24*7];
+ *      size_t n = history.downsample(weekAgo,sysClock.peekTime(),3600,hourly,24*7);
+ */
+class OffsetHistory {
+  private:
+
+/**
+ *   Encoder and decoder state, advanced identically by both: the previous time and delta, the previous values, and the
+ *   XOR window (leading and trailing zero bits) last written for each value.
+ */
+  typedef struct State {
+    int64_t      time;
+    int64_t      delta;
+    uint32_t     offset;
+    uint32_t     delay;
+    uint8_t      offsetLead;
+    uint8_t      offsetTrail;
+    uint8_t      delayLead;
+    uint8_t      delayTrail;
+  } State;
+
+  typedef struct Chunk {
+    int64_t      first;                                                // Time of the first and last samples, milliseconds
+    int64_t      last;
+    uint16_t     count;                                                // Samples in the chunk
+    uint16_t     bits;                                                 // Bits written
+  } Chunk;
+
+  public:
+  class Cursor {
+    public:
+    bool         next(OffsetSample& s);                                // Next sample in range, false when there is none
+
+    private:
+    friend class OffsetHistory;
+    Cursor(const OffsetHistory& h, int64_t from, int64_t to) : _history(h), _from(from), _to(to) {}
+    void         decode(int64_t& time, uint32_t& offset, uint32_t& delay);
+
+    const OffsetHistory&  _history;
+    int64_t      _from;
+    int64_t      _to;
+    int          _chunk    = -1;                                       // Age of the chunk being decoded, 0 oldest
+    uint16_t     _decoded  = 0;                                        // Samples decoded from it
+    uint32_t     _bit      = 0;
+    State        _state;
+  };
+
+  OffsetHistory()                                                      {reset();}
+
+  bool           append(const Instant& time, double offset, double delay);
+  bool           append(const NTPSample& s)    {return ((s.status==1)?(append(s.t4+s.offset,s.offset.sysTimed(),s.delay.sysTimed())):(false));}
+  Cursor         scan(const Instant& from, const Instant& to) const    {return Cursor(*this,toMillis(from),toMillis(to));}
+  Cursor         scan()                        const                   {return Cursor(*this,INT64_MIN,INT64_MAX);}
+  size_t         downsample(const Instant& from, const Instant& to, uint32_t seconds, OffsetSample* out, size_t max) const;
+  void           write(Print& out)             const;
+  uint32_t       size()                        const                   {return _size;}
+  uint32_t       dropped()                     const                   {return _dropped;}
+  size_t         bytes()                       const;
+  void           reset();
+
+  static int64_t toMillis(const Instant& t)                            {return t.secs()*1000 + (int64_t)(((uint64_t)t.fraction()*1000)>>32);}
+  static Instant fromMillis(int64_t ms)                                {int64_t s = ((ms<0)?(-((-ms+999)/1000)):(ms/1000));return Instant(s,(uint32_t)(((((uint64_t)(ms - s*1000))<<32) + 999)/1000));}
+
+  private:
+  int            slot(int age)                 const                   {return (_oldest + age)%OFFSET_HISTORY_CHUNKS;}
+  bool           encode(uint8_t* data, uint32_t& bit, uint32_t limit, State& st, int64_t time, uint32_t offset, uint32_t delay);
+  void           start(int64_t time, uint32_t offset, uint32_t delay);   // Begin a chunk with a full sample
+
+  uint8_t        _data[OFFSET_HISTORY_CHUNKS][OFFSET_HISTORY_CHUNK_SIZE];
+  Chunk          _chunks[OFFSET_HISTORY_CHUNKS];
+  int            _oldest;                                              // Slot of the oldest chunk
+  int            _count;                                               // Chunks in use
+  State          _state;                                               // Encoder state at the end of the newest chunk
+  uint32_t       _size;
+  uint32_t       _dropped;
+};
+
+} // End of namespace lsc
+
+#endif
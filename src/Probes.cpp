@@ -0,0 +1,39 @@
+/**
+ *
+ *  SystemClock Library
+ *  Copyright (C) 2024  Daniel L Toth
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or any
+ *  later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *  The author can be contacted at dan@leelanausoftware.com
+ *
+ */
+
+#include "Probes.h"
+
+/**
+ *   Semaphores for the probes listed in Probes.h, in the .probes section where tracers look for them. A tracer adds one
+ *   to a probe's semaphore while attached, so LSC_PROBE_ENABLED() is true only then.
+ */
+#if defined(LSC_USDT) && defined(__linux__)
+extern "C" {
+LSC_PROBE_SEMAPHORE(ntp_query_send)    = 0;
+LSC_PROBE_SEMAPHORE(ntp_reply_receive) = 0;
+LSC_PROBE_SEMAPHORE(ntp_query_timeout) = 0;
+LSC_PROBE_SEMAPHORE(ntp_offset)        = 0;
+LSC_PROBE_SEMAPHORE(clock_step)        = 0;
+LSC_PROBE_SEMAPHORE(timer_fire)        = 0;
+LSC_PROBE_SEMAPHORE(timer_return)      = 0;
+}
+#endif
@@ -0,0 +1,77 @@
+
+/**
+ *
+ *  SystemClock Library
+ *  Copyright (C) 2024  Daniel L Toth
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or any
+ *  later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *  The author can be contacted at dan@leelanausoftware.com
+ *
+ */
+
+#ifndef PROBES_H
+#define PROBES_H
+
+/**
+ *   USDT (user statically defined tracing) probes for bpftrace, perf and SystemTap on Linux. Build with LSC_USDT defined
+ *   and sys/sdt.h (systemtap-sdt-dev) installed, and each LSC_PROBE(name,args...) site becomes a single nop instruction
+ *   plus an ELF note naming the probe lsc:name and where to find its arguments; an attached probe traps only while a
+ *   tracer is listening. Without LSC_USDT, or on other platforms, a probe compiles to nothing and its arguments are not
+ *   evaluated. Arguments must be integers or pointers, at most 12 of them.
+ *
+ *   In a LSC_USDT build the arguments are computed at every pass, attached or not, since the note points at where they
+ *   are held. A probe whose arguments cost more than a few loads, such as Instant arithmetic or a conversion from
+ *   double, is wrapped in LSC_PROBE_ENABLED(name): each probe has a semaphore, lsc_name_semaphore, that tracers
+ *   increment while attached, so the test is one load and the arguments are computed only for a listener. Without
+ *   LSC_USDT the test is constant false. A new probe must add its semaphore to the list below and to Probes.cpp.
+ *
+ *   Probes defined by the library, with their arguments:
+ *      lsc:ntp_query_send         (uint32_t server, int port)                      // NTP request written to the channel
+ *      lsc:ntp_reply_receive      (uint32_t server, int stratum, unsigned long ms) // NTP response read, ms after sending
+ *      lsc:ntp_query_timeout      (uint32_t server, unsigned long ms)              // No response within the timeout
+ *      lsc:ntp_offset             (int status, int64_t offsetNs, int64_t delayNs)  // Clock offset computed from T1..T4
+ *      lsc:clock_step             (int64_t offsetNs, unsigned int syncCount)       // SystemClock set by NTP
+ *      lsc:timer_fire             (void* timer, unsigned long lateMs)              // Timer or TimerService handler about to run
+ *      lsc:timer_return           (void* timer)                                    // Handler returned
+ *
+ *   Example:
+ *      if( LSC_PROBE_ENABLED(ntp_offset) ) LSC_PROBE(ntp_offset,status,(int64_t)(offset.sysTimed()*1e9),delayNs);
+ *
+ *      $ bpftrace -e 'usdt:./app:lsc:timer_fire { @start[tid] = nsecs; }
+ *                     usdt:./app:lsc:timer_return /@start[tid]/ { @runtime = hist(nsecs - @start[tid]); delete(@start[tid]); }'
+ *      $ perf probe -x ./app sdt_lsc:ntp_offset && perf record -e sdt_lsc:ntp_offset -a
+ */
+#if defined(LSC_USDT) && defined(__linux__)
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+#define LSC_PROBE(name,...)      STAP_PROBEV(lsc,name,##__VA_ARGS__)
+#define LSC_PROBE_ENABLED(name)  (__builtin_expect(lsc_##name##_semaphore != 0,0))
+#define LSC_PROBE_SEMAPHORE(name) volatile unsigned short lsc_##name##_semaphore __attribute__((unused)) __attribute__((section(".probes")))
+
+extern "C" {
+extern LSC_PROBE_SEMAPHORE(ntp_query_send);
+extern LSC_PROBE_SEMAPHORE(ntp_reply_receive);
+extern LSC_PROBE_SEMAPHORE(ntp_query_timeout);
+extern LSC_PROBE_SEMAPHORE(ntp_offset);
+extern LSC_PROBE_SEMAPHORE(clock_step);
+extern LSC_PROBE_SEMAPHORE(timer_fire);
+extern LSC_PROBE_SEMAPHORE(timer_return);
+}
+#else
+#define LSC_PROBE(name,...)      do {} while(0)
+#define LSC_PROBE_ENABLED(name)  (false)
+#endif
+
+#endif
@@ -0,0 +1,172 @@
+/**
+ *
+ *  SystemClock Library
+ *  Copyright (C) 2024  Daniel L Toth
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or any
+ *  later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *  The author can be contacted at dan@leelanausoftware.com
+ *
+ */
+
+#include <new>
+#include <string.h>
+#include "Profiler.h"
+
+/** Leelanau Software Company namespace
+*
+*/
+namespace lsc {
+
+std::atomic<const char*>  Profiler::_names[PROFILER_POINTS] = {};
+std::atomic<Profiler::Block*> Profiler::_blocks{NULL};
+TickAnchor                Profiler::_anchor;
+
+/**
+ *   Holds this thread's Block and gives it up when the thread exits.
+ */
+class ProfileOwner {
+  public:
+  ~ProfileOwner()                                              {if( block != NULL ) block->owned.store(false,std::memory_order_release);}
+  Profiler::Block* block = NULL;
+};
+
+static thread_local ProfileOwner profileOwner;
+
+/**
+ *   Names are compared by content, so the same name used at several sites shares a point. Two threads registering a new
+ *   name at once may each take a slot; lookups then find the first.
+ */
+int Profiler::point(const char* name) {
+  for( int i=0; i<PROFILER_POINTS; i++ ) {
+    const char* n = _names[i].load(std::memory_order_acquire);
+    if( n == NULL ) {
+      if( _names[i].compare_exchange_strong(n,name,std::memory_order_acq_rel) ) return i;
+    }
+    if( strcmp(n,name) == 0 ) return i;
+  }
+  return -1;
+}
+
+Profiler::Block* Profiler::block() {
+  if( profileOwner.block == NULL ) profileOwner.block = claim();
+  return profileOwner.block;
+}
+
+Profiler::Block* Profiler::claim() {
+  for( Block* b = _blocks.load(std::memory_order_acquire); b != NULL; b = b->next ) {
+    bool owned = false;
+    if( !b->owned.load(std::memory_order_relaxed) && b->owned.compare_exchange_strong(owned,true,std::memory_order_acquire) ) return b;
+  }
+  Block* b = new (std::nothrow) Block;
+  if( b == NULL ) return NULL;
+  for( int i=0; i<PROFILER_POINTS; i++ ) {
+    b->histograms[i].store(NULL,std::memory_order_relaxed);
+    b->counters[i].store(0,std::memory_order_relaxed);
+    b->worst[i].store(0,std::memory_order_relaxed);
+    b->worstTick[i].store(0,std::memory_order_relaxed);
+  }
+  b->owned.store(true,std::memory_order_relaxed);
+  b->next = _blocks.load(std::memory_order_relaxed);
+  while( !_blocks.compare_exchange_weak(b->next,b,std::memory_order_release,std::memory_order_relaxed) ) {}
+  return b;
+}
+
+void Profiler::record(int id, uint32_t us, uint64_t tick) {
+  if( (id < 0) || (id >= PROFILER_POINTS) ) return;
+  Block* b = block();
+  if( b == NULL ) return;
+  Histogram* h = b->histograms[id].load(std::memory_order_relaxed);
+  if( h == NULL ) {
+    h = new (std::nothrow) Histogram;
+    if( h == NULL ) return;
+    b->histograms[id].store(h,std::memory_order_release);
+  }
+  h->record(us);
+  if( us > b->worst[id].load(std::memory_order_relaxed) ) {
+    b->worstTick[id].store(tick,std::memory_order_relaxed);
+    b->worst[id].store(us,std::memory_order_relaxed);
+  }
+}
+
+void Profiler::count(int id, uint32_t n) {
+  if( (id < 0) || (id >= PROFILER_POINTS) ) return;
+  Block* b = block();
+  if( b == NULL ) return;
+  b->counters[id].store(b->counters[id].load(std::memory_order_relaxed) + n,std::memory_order_relaxed);
+}
+
+uint64_t Profiler::counter(int id) {
+  uint64_t result = 0;
+  if( (id < 0) || (id >= PROFILER_POINTS) ) return result;
+  for( Block* b = _blocks.load(std::memory_order_acquire); b != NULL; b = b->next ) result += b->counters[id].load(std::memory_order_relaxed);
+  return result;
+}
+
+void Profiler::merge(int id, Histogram& h) {
+  if( (id < 0) || (id >= PROFILER_POINTS) ) return;
+  for( Block* b = _blocks.load(std::memory_order_acquire); b != NULL; b = b->next ) {
+    Histogram* p = b->histograms[id].load(std::memory_order_acquire);
+    if( p != NULL ) h.merge(*p);
+  }
+}
+
+uint32_t Profiler::worst(int id, uint64_t& tick) {
+  uint32_t result = 0;
+  if( (id < 0) || (id >= PROFILER_POINTS) ) return result;
+  for( Block* b = _blocks.load(std::memory_order_acquire); b != NULL; b = b->next ) {
+    uint32_t w = b->worst[id].load(std::memory_order_relaxed);
+    if( w > result ) {result = w;tick = b->worstTick[id].load(std::memory_order_relaxed);}
+  }
+  return result;
+}
+
+/**
+ *   One line per point: scopes show count and microsecond statistics, with the UTC start of the worst case once an
+ *   anchor is set, and counters show their total.
+ */
+void Profiler::dump(Print& out) {
+  Histogram* h = new (std::nothrow) Histogram;
+  if( h == NULL ) return;
+  out.printf("%-*s %10s %10s %10s %10s %10s %10s  %s\n",PROFILER_NAME_WIDTH,"point","count","mean","p50","p90","p99","max","worst at (UTC)");
+  for( int i=0; i<PROFILER_POINTS; i++ ) {
+    const char* n = name(i);
+    if( n == NULL ) break;
+    h->reset();
+    merge(i,*h);
+    uint64_t total = counter(i);
+    if( h->count() > 0 ) {
+      char     when[40] = "-";
+      uint64_t tick     = 0;
+      worst(i,tick);
+      if( _anchor.valid() ) _anchor.toInstant(tick).printISO(when,sizeof(when),6);
+      out.printf("%-*s %10u %10.1f %10u %10u %10u %10u  %s\n",PROFILER_NAME_WIDTH,n,h->count(),h->mean(),h->percentile(50),h->percentile(90),h->percentile(99),h->max(),when);
+    }
+    if( total > 0 ) out.printf("%-*s %10llu\n",PROFILER_NAME_WIDTH,n,(unsigned long long)total);
+  }
+  delete h;
+}
+
+void Profiler::reset() {
+  for( Block* b = _blocks.load(std::memory_order_acquire); b != NULL; b = b->next ) {
+    for( int i=0; i<PROFILER_POINTS; i++ ) {
+      Histogram* p = b->histograms[i].load(std::memory_order_acquire);
+      if( p != NULL ) p->reset();
+      b->counters[i].store(0,std::memory_order_relaxed);
+      b->worst[i].store(0,std::memory_order_relaxed);
+    }
+  }
+}
+
+} // End of namespace lsc
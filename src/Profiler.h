@@ -0,0 +1,138 @@
+
+/**
+ *
+ *  SystemClock Library
+ *  Copyright (C) 2024  Daniel L Toth
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or any
+ *  later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *  The author can be contacted at dan@leelanausoftware.com
+ *
+ */
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "Histogram.h"
+#include "Ticks.h"
+
+#define PROFILER_POINTS      32                                         // Named scopes and counters a Profiler can hold
+#define PROFILER_NAME_WIDTH  24                                         // Columns given to names by dump()
+
+#define LSC_PROFILE_JOIN2(a,b)   a##b
+#define LSC_PROFILE_JOIN(a,b)    LSC_PROFILE_JOIN2(a,b)
+
+/**
+ *   Time the rest of the enclosing block as the named scope, or add n to the named counter. The name is registered once,
+ *   on first use at each site.
+ */
+#define LSC_PROFILE_SCOPE(name)                                                                          \
+  static const int LSC_PROFILE_JOIN(_lscPoint,__LINE__) = lsc::Profiler::point(name);                    \
+  lsc::ProfileScope LSC_PROFILE_JOIN(_lscScope,__LINE__)(LSC_PROFILE_JOIN(_lscPoint,__LINE__))
+#define LSC_PROFILE_COUNT(name,n)                                                                        \
+  do {static const int _lscPoint = lsc::Profiler::point(name);lsc::Profiler::count(_lscPoint,(n));} while(0)
+
+/** Leelanau Software Company namespace
+*
+*/
+namespace lsc {
+
+/**
+ *   Profiler aggregates timed scopes and counters by name. Each point is registered once and then identified by a small
+ *   integer. Durations are measured in microseconds on monotonicMicros() and kept in a Histogram per point per thread,
+ *   so recording never takes a lock or contends with another thread; each thread's storage is allocated on its first
+ *   record and kept, for reuse by a later thread, when it exits. Readers merge across threads on demand.
+ *   The following methods are supported:
+ *      static int          point(const char* name)          // Register name (or find it), returning its id, -1 if PROFILER_POINTS are in use
+ *      static const char*  name(int id)                     // Name of point id
+ *      static void         record(int id, uint32_t us, uint64_t tick)   // Add a duration of us microseconds that started at tick
+ *      static void         count(int id, uint32_t n)        // Add n to counter id
+ *      static uint64_t     counter(int id)                  // Counter id summed across threads
+ *      static void         merge(int id, Histogram& h)      // Add durations of id from all threads to h
+ *      static uint32_t     worst(int id, uint64_t& tick)    // Longest duration of id and the tick it started at
+ *      static void         anchor(const TickAnchor& a)      // Set the anchor dump() uses to give worst durations a UTC time
+ *      static void         dump(Print& out)                 // Print every point's count, mean, percentiles, and worst case
+ *      static void         reset()                          // Zero all points
+ *
+ *   Ticks are converted to UTC only when read, through a TickAnchor taken from a SystemClock, so a slow scope seen in
+ *   dump() can be matched against logs and NTP synchronizations. Counters and the worst case are written only by their
+ *   own thread and read with relaxed atomics. reset() while other threads record may lose their records in flight.
+ *
+ *   Example:
+ *   void handleRequest() {
+ *     LSC_PROFILE_SCOPE("http.request");
+ *     ...
+ *     LSC_PROFILE_COUNT("http.bytes",len);
+ *   }
+ *   ...
+ *   Profiler::anchor(TickAnchor(sysClock.peekTime()));
+ *   Profiler::dump(Serial);
+ */
+class Profiler {
+  public:
+  static int          point(const char* name);
+  static const char*  name(int id)                             {return (((id<0)||(id>=PROFILER_POINTS))?(NULL):(_names[id].load(std::memory_order_acquire)));}
+  static void         record(int id, uint32_t us, uint64_t tick);
+  static void         count(int id, uint32_t n = 1);
+  static uint64_t     counter(int id);
+  static void         merge(int id, Histogram& h);
+  static uint32_t     worst(int id, uint64_t& tick);
+  static void         anchor(const TickAnchor& a)              {_anchor = a;}
+  static void         dump(Print& out);
+  static void         reset();
+
+  private:
+
+/**
+ *   Storage for one thread, linked on a list that only grows. The owning thread is the only writer.
+ */
+  typedef struct Block {
+    std::atomic<Histogram*>  histograms[PROFILER_POINTS];               // Allocated on a point's first record
+    std::atomic<uint64_t>    counters[PROFILER_POINTS];
+    std::atomic<uint32_t>    worst[PROFILER_POINTS];                    // Longest duration recorded
+    std::atomic<uint64_t>    worstTick[PROFILER_POINTS];                // Tick the longest duration started
+    std::atomic<bool>        owned;                                     // Held by a running thread
+    Block*                   next;
+  } Block;
+
+  friend class ProfileOwner;
+  static Block*       block();                                          // This thread's Block
+  static Block*       claim();                                          // Reuse an unowned Block or link a new one
+
+  static std::atomic<const char*>  _names[PROFILER_POINTS];
+  static std::atomic<Block*>       _blocks;
+  static TickAnchor                _anchor;
+};
+
+/**
+ *   ProfileScope records the time from its construction to its destruction under point id; an id of -1 records nothing.
+ */
+class ProfileScope {
+  public:
+  ProfileScope(int id) : _id(id), _start(monotonicMicros())   {}
+  ~ProfileScope()                                              {if( _id >= 0 ) Profiler::record(_id,(uint32_t)(monotonicMicros() - _start),_start);}
+
+  private:
+  ProfileScope(const ProfileScope&)            = delete;
+  ProfileScope& operator=(const ProfileScope&) = delete;
+
+  int            _id;
+  uint64_t       _start;
+};
+
+} // End of namespace lsc
+
+#endif
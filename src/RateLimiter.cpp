@@ -0,0 +1,87 @@
+/**
+ *
+ *  SystemClock Library
+ *  Copyright (C) 2024  Daniel L Toth
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or any
+ *  later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *  The author can be contacted at dan@leelanausoftware.com
+ *
+ */
+
+#include "RateLimiter.h"
+
+/** Leelanau Software Company namespace
+*
+*/
+namespace lsc {
+
+/**
+ *   n units conform if the TAT after taking them is no more than tolerance + interval ahead of now, i.e. the TAT before
+ *   the first of them is within tolerance.
+ */
+bool GCRA::tryAcquire(uint32_t n, uint64_t now) {
+  uint64_t current = _tat.load(std::memory_order_relaxed);
+  for( ;; ) {
+    uint64_t next = ((current>now)?(current):(now)) + (uint64_t)n*_interval;
+    if( next - now > _tolerance + _interval ) return false;
+    if( _tat.compare_exchange_weak(current,next,std::memory_order_relaxed,std::memory_order_relaxed) ) return true;
+  }
+}
+
+uint64_t GCRA::retryAfter(uint32_t n, uint64_t now) const {
+  uint64_t next  = tat(now) + (uint64_t)n*_interval;
+  uint64_t limit = _tolerance + _interval;
+  return ((next - now > limit)?(next - now - limit):(0));
+}
+
+uint32_t TokenBucket::available(uint64_t now) const {
+  uint64_t used = (tat(now) - now + _interval - 1)/_interval;       // Tokens not yet refilled, rounded up
+  return ((used >= _capacity)?(0):(_capacity - (uint32_t)used));
+}
+
+/**
+ *   When now is one window past the state, the current count becomes the previous; further past, both are zero.
+ */
+uint64_t SlidingWindow::roll(uint64_t state, uint64_t now) const {
+  uint32_t window  = (uint32_t)(now/_window);
+  uint32_t last    = (uint32_t)(state>>32);
+  uint32_t current = (uint32_t)(state&0xFFFF);
+  if( window == last ) return state;
+  if( window == last+1 ) return ((uint64_t)window<<32) | ((uint64_t)current<<16);
+  return (uint64_t)window<<32;
+}
+
+uint32_t SlidingWindow::estimate(uint64_t state, uint64_t now) const {
+  uint64_t previous = (state>>16)&0xFFFF;
+  uint64_t current  = state&0xFFFF;
+  uint64_t overlap  = _window - (now%_window);                       // Part of the previous window still in the sliding window
+  return (uint32_t)(current + (previous*overlap + _window - 1)/_window);
+}
+
+bool SlidingWindow::tryAcquire(uint64_t now) {
+  uint64_t state = _state.load(std::memory_order_relaxed);
+  for( ;; ) {
+    uint64_t rolled = roll(state,now);
+    if( estimate(rolled,now) >= _limit ) return false;
+    if( _state.compare_exchange_weak(state,rolled+1,std::memory_order_relaxed,std::memory_order_relaxed) ) return true;
+  }
+}
+
+uint32_t SlidingWindow::count(uint64_t now) const {
+  uint64_t state = roll(_state.load(std::memory_order_relaxed),now);
+  return estimate(state,now);
+}
+
+} // End of namespace lsc
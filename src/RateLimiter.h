@@ -0,0 +1,127 @@
+
+/**
+ *
+ *  SystemClock Library
+ *  Copyright (C) 2024  Daniel L Toth
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or any
+ *  later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *  The author can be contacted at dan@leelanausoftware.com
+ *
+ */
+
+#ifndef RATE_LIMITER_H
+#define RATE_LIMITER_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "Ticks.h"
+
+/** Leelanau Software Company namespace
+*
+*/
+namespace lsc {
+
+/**
+ *   GCRA is the Generic Cell Rate Algorithm: requests conform to a rate of one per interval microseconds, with bursts of up
+ *   to tolerance/interval + 1 back to back. Its whole state is the theoretical arrival time (TAT) of the next request on the
+ *   monotonic clock, so there is no timer per limiter, a check is O(1), and state is refilled lazily by the passage of time.
+ *   The following methods are supported:
+ *      bool      tryAcquire(uint32_t n)        // Take n units if they conform, returning false (and taking none) otherwise
+ *      uint64_t  retryAfter(uint32_t n)        // Microseconds until n units would conform, 0 if they conform now
+ *      void      reset()                       // Forget past requests, allowing a full burst
+ *   Each method also takes an optional now, in monotonicMicros(), so callers may share a single reading of the clock.
+ *
+ *   tryAcquire() is a compare and swap loop on the TAT, so a limiter may be shared by any number of threads without a lock.
+ *   As in HLC, 64-bit atomics are lock-free on 64-bit hosts and may use a short critical section on 32-bit ESP cores.
+ *
+ *   Example:
+ *      GCRA ntpLimit(GCRA::interval(4.0),GCRA::interval(4.0)*2);    // 4 queries per second, bursts of 3
+ *      if( ntpLimit.tryAcquire() ) sendQuery();
+ */
+class GCRA {
+  public:
+  GCRA(uint64_t interval, uint64_t tolerance) : _interval((interval<1)?(1):(interval)), _tolerance(tolerance) {}
+
+  bool           tryAcquire(uint32_t n = 1, uint64_t now = monotonicMicros());
+  uint64_t       retryAfter(uint32_t n = 1, uint64_t now = monotonicMicros()) const;
+  void           reset()                                       {_tat.store(0,std::memory_order_relaxed);}
+  uint64_t       interval()                    const           {return _interval;}
+  uint64_t       tolerance()                   const           {return _tolerance;}
+
+  static uint64_t interval(double perSecond)                   {return (uint64_t)(1000000.0/((perSecond>0)?(perSecond):(1e-6)));}
+
+  protected:
+  uint64_t       tat(uint64_t now)             const           {uint64_t t = _tat.load(std::memory_order_relaxed);return ((t>now)?(t):(now));}
+
+  uint64_t                _interval;                           // Microseconds per unit
+  uint64_t                _tolerance;                          // Microseconds the TAT may run ahead of now
+  std::atomic<uint64_t>   _tat{0};                             // Theoretical arrival time of the next unit
+};
+
+/**
+ *   TokenBucket is a bucket of capacity tokens refilled at rate tokens per second, expressed as a GCRA: a bucket holding k
+ *   tokens is a TAT (capacity-k) intervals ahead of now. It adds only a token count view of the same state.
+ *   The following methods are supported:
+ *      bool      tryAcquire(uint32_t n)        // Take n tokens if available, returning false (and taking none) otherwise
+ *      uint64_t  retryAfter(uint32_t n)        // Microseconds until n tokens are available
+ *      uint32_t  available()                   // Whole tokens in the bucket
+ *      uint32_t  capacity()                    // Bucket size
+ *
+ *   Example:
+ *      TokenBucket telemetry(10.0,20);            // 10 messages per second on average, bursts of up to 20
+ *      if( telemetry.tryAcquire() ) publish(sample);
+ */
+class TokenBucket : public GCRA {
+  public:
+  TokenBucket(double rate, uint32_t capacity) : GCRA(GCRA::interval(rate),GCRA::interval(rate)*((capacity<1)?(0):(capacity-1))), _capacity((capacity<1)?(1):(capacity)) {}
+
+  uint32_t       available(uint64_t now = monotonicMicros()) const;
+  uint32_t       capacity()                    const           {return _capacity;}
+
+  private:
+  uint32_t       _capacity;
+};
+
+/**
+ *   SlidingWindow allows at most limit requests in any window of window microseconds, estimated in the usual way from the
+ *   counts of the current and previous fixed windows, with the previous count weighted by how much of it still overlaps
+ *   the sliding window. The window number and both counts are packed in one 64-bit atomic, so tryAcquire() is a lock-free
+ *   compare and swap loop, and limit may be at most 65535.
+ *   The following methods are supported:
+ *      bool      tryAcquire()                  // Count a request if under limit, returning false otherwise
+ *      uint32_t  count()                       // Estimated requests in the sliding window ending now
+ *
+ *   Example:
+ *      SlidingWindow logins(5,60000000ULL);        // At most 5 attempts in any minute
+ */
+class SlidingWindow {
+  public:
+  SlidingWindow(uint32_t limit, uint64_t window) : _limit((limit>0xFFFF)?(0xFFFF):(limit)), _window((window<1)?(1):(window)) {}
+
+  bool           tryAcquire(uint64_t now = monotonicMicros());
+  uint32_t       count(uint64_t now = monotonicMicros())       const;
+
+  private:
+  uint64_t       roll(uint64_t state, uint64_t now)            const;   // State advanced to the window holding now
+  uint32_t       estimate(uint64_t state, uint64_t now)        const;
+
+  uint32_t                _limit;
+  uint64_t                _window;                             // Microseconds per window
+  std::atomic<uint64_t>   _state{0};                           // [32 bit window number][16 bit previous count][16 bit current count]
+};
+
+} // End of namespace lsc
+
+#endif
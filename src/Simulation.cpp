@@ -0,0 +1,182 @@
+/**
+ *
+ *  SystemClock Library
+ *  Copyright (C) 2024  Daniel L Toth
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or any
+ *  later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *  The author can be contacted at dan@leelanausoftware.com
+ *
+ */
+
+#include "Simulation.h"
+#include "SystemClock.h"
+
+#ifdef LSC_SIMULATION
+
+/** Leelanau Software Company namespace
+*
+*/
+namespace lsc {
+
+thread_local SimulatedDevice* SimulatedDevice::_current = NULL;
+
+unsigned long simulatedMillis() {
+  SimulatedDevice* d = SimulatedDevice::current();
+  return ((d==NULL)?(::millis()):(d->millis()));
+}
+
+bool simulatedMicros(uint64_t& us) {
+  SimulatedDevice* d = SimulatedDevice::current();
+  if( d == NULL ) return false;
+  us = d->micros();
+  return true;
+}
+
+/**
+ *   Box-Muller, using one of the pair.
+ */
+double SimRandom::gaussian() {
+  double u = 1.0 - uniform();
+  double v = uniform();
+  return sqrt(-2.0*log(u))*cos(2.0*M_PI*v);
+}
+
+/**
+ *   Frequency is integrated by the trapezoid rule over each segment, segments ending at temperature steps.
+ */
+void Oscillator::advance(double dt) {
+  while( dt > 0 ) {
+    double seg = dt;
+    bool   step = false;
+    if( (_model.tempInterval > 0) && (_elapsed + seg >= _nextStep) ) {seg = _nextStep - _elapsed;step = true;}
+    double next = _frequency + ((_model.randomWalk>0)?(_model.randomWalk*sqrt(seg)*_random.gaussian()):(0.0));
+    _error     += (_frequency + next)*0.5e-6*seg;
+    _frequency  = next;
+    _elapsed   += seg;
+    dt         -= seg;
+    if( step ) {
+      _frequency += _model.tempStep*_random.gaussian();
+      _nextStep  += _model.tempInterval;
+    }
+  }
+}
+
+bool SimulatedServer::respond(double sent, SimRandom& random, double& t2, double& t3, double& arrival) {
+  _queries.fetch_add(1,std::memory_order_relaxed);
+  if( random.uniform() < _model.loss ) return false;
+  double out  = _model.delay + _model.asymmetry/2 + random.exponential(_model.jitter);
+  double back = _model.delay - _model.asymmetry/2 + random.exponential(_model.jitter);
+  if( random.uniform() < _model.outliers ) back += _model.outlierDelay;
+  t2      = sent + out + _model.error;
+  t3      = t2 + _model.processing;
+  arrival = sent + out + _model.processing + back;
+  return true;
+}
+
+double SimulatedDevice::error(const SystemClock& c) const {
+  return (c.peekTime() - utc()).sysTimed();
+}
+
+void SimulatedDevice::send() {
+  _queries++;
+  _pending = _server.respond(_now,_random,_t2,_t3,_arrival);
+}
+
+/**
+ *   Write an NTP timestamp (era offset and fraction) for true time t, big endian, at packet[at].
+ */
+static void putTimestamp(uint8_t* packet, int at, double t) {
+  Instant  ts  = Instant((int64_t)SIMULATION_EPOCH) + Instant(t);
+  uint32_t s   = ts.eraOffset();
+  uint32_t f   = ts.fraction();
+  for( int i=0; i<4; i++ ) packet[at+i]   = (uint8_t)(s>>(24-8*i));
+  for( int i=0; i<4; i++ ) packet[at+4+i] = (uint8_t)(f>>(24-8*i));
+}
+
+/**
+ *   Each poll lets SIMULATION_POLL seconds pass, or less if the reply arrives sooner, so NTPTime's timeout is measured
+ *   in virtual time on the device's own ticks.
+ */
+bool SimulatedDevice::receive(uint8_t* packet) {
+  double wait = ((_pending)?(_arrival - _now):(SIMULATION_POLL));
+  advance(((wait<SIMULATION_POLL)?(((wait>0)?(wait):(0.0))):(SIMULATION_POLL)));
+  if( !_pending || (_now < _arrival) ) return false;
+  _pending = false;
+  memset(packet,0,NTP_PACKET_SIZE);
+  packet[0]  = 0b00100100;                                            // LI 0, Version 4, Mode 4 (server)
+  packet[1]  = (uint8_t)_server.model().stratum;
+  packet[2]  = 6;
+  packet[3]  = 0xEC;
+  packet[12] = 'S';
+  packet[13] = 'I';
+  packet[14] = 'M';
+  putTimestamp(packet,32,_t2);
+  putTimestamp(packet,40,_t3);
+  return true;
+}
+
+void SimulationReport::sample(double error) {
+  double magnitude = fabs(error);
+  double micros    = magnitude*1e6;
+  this->error.record((uint32_t)((micros>4294967295.0)?(4294967295.0):(micros)));
+  squares += error*error;
+  if( magnitude > worst ) worst = magnitude;
+  samples++;
+}
+
+void SimulationReport::print(Print& out) const {
+  out.printf("Simulated %.2f days in %.3f s (%.0f days per second)\n",seconds/86400.0,wall,((wall>0)?(seconds/86400.0/wall):(0.0)));
+  out.printf("NTP queries %u, timeouts %u, first sync after %.3f s\n",queries,timeouts,firstSync);
+  out.printf("Clock error rms %.6f s, max %.6f s, p50 %.6f s, p99 %.6f s over %u samples\n",rms(),worst,error.percentile(50)*1e-6,error.percentile(99)*1e-6,samples);
+}
+
+/**
+ *   Each sync is seen as a change of syncCount(), and its NTPSample tells whether the query was answered.
+ */
+static bool synced(const SystemClock& clock, const SimulatedDevice& device, double begin, SimulationReport& report) {
+  int status = clock.lastSample().status;
+  if( status == -3 ) report.timeouts++;
+  if( (status == 1) && (report.firstSync < 0) ) report.firstSync = device.now() - begin;
+  return status == 1;
+}
+
+void Simulation::run(SystemClock& clock, SimulatedDevice& device, double seconds, double step, SimulationReport& report) {
+  SimulatedDevice::uninstall();                                        // Wall time is read from the platform clock
+  uint64_t start   = monotonicMicros();
+  device.install();
+  double   begin   = device.now();
+  uint32_t queries = device.queries();
+  clock.updateSysTime();
+  unsigned int syncs    = clock.syncCount();
+  bool         answered = synced(clock,device,begin,report);
+  double       end      = begin + seconds;
+  while( device.now() < end ) {
+    device.advance(step);
+    clock.doDevice();
+    if( clock.syncCount() != syncs ) {
+      syncs     = clock.syncCount();
+      answered |= synced(clock,device,begin,report);
+    }
+    if( answered ) report.sample(device.error(clock));
+  }
+  report.queries += device.queries() - queries;
+  report.seconds += seconds;
+  SimulatedDevice::uninstall();
+  report.wall    += (monotonicMicros() - start)*1e-6;
+}
+
+} // End of namespace lsc
+
+#endif
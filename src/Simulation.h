@@ -0,0 +1,255 @@
+
+/**
+ *
+ *  SystemClock Library
+ *  Copyright (C) 2024  Daniel L Toth
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or any
+ *  later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *  The author can be contacted at dan@leelanausoftware.com
+ *
+ */
+
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#ifdef LSC_SIMULATION
+
+#include <Arduino.h>
+#include <atomic>
+#include "Instant.h"
+#include "Histogram.h"
+#include "NTPTime.h"
+
+#define SIMULATION_EPOCH       3944678400LL                            // True time 0 of a simulation, Jan 1, 2025 00:00:00 UTC
+#define SIMULATION_TICK_BASE   86400.0                                 // Local seconds on a device's tick counter at true time 0
+#define SIMULATION_POLL        0.010                                   // Seconds of virtual time per poll for an NTP reply
+#define SIMULATION_WRAP        4294967.296                             // Seconds of ticks per 32-bit millis() rollover (about 49.7 days)
+
+/** Leelanau Software Company namespace
+*
+*/
+namespace lsc {
+
+class SystemClock;                                                     // SystemClock.h is not included, NTPTime.cpp includes this
+
+/**
+ *   SimRandom is a small deterministic generator (splitmix64), so a simulation with the same seeds replays exactly.
+ */
+class SimRandom {
+  public:
+  SimRandom(uint64_t seed = 1) : _state(seed)                          {}
+
+  uint64_t       next()                                                {uint64_t z = (_state += 0x9E3779B97F4A7C15ULL);z = (z^(z>>30))*0xBF58476D1CE4E5B9ULL;z = (z^(z>>27))*0x94D049BB133111EBULL;return z^(z>>31);}
+  double         uniform()                                             {return (next()>>11)*(1.0/9007199254740992.0);}
+  double         gaussian();                                           // Standard normal
+  double         exponential(double mean)                              {return -mean*log(1.0 - uniform());}
+
+  private:
+  uint64_t       _state;
+};
+
+/**
+ *   OscillatorModel describes a device's millis() oscillator. Frequency errors are in parts per million, positive when the
+ *   oscillator runs fast. randomWalk is the standard deviation of frequency change over one second, growing with the square
+ *   root of time; every tempInterval seconds a temperature change steps the frequency by a normal variate of tempStep ppm.
+ *   ticks is where the tick counter starts: 0 for a device just powered on, or just short of SIMULATION_WRAP to see the
+ *   32-bit millis() rollover soon after the start.
+ */
+typedef struct OscillatorModel {
+  double         ticks        = SIMULATION_TICK_BASE;                  // Local seconds on the tick counter at true time 0
+  double         offset       = 0.0;                                   // Initial time error of the tick counter, seconds
+  double         frequency    = 0.0;                                   // Initial frequency error, ppm
+  double         randomWalk   = 0.0;                                   // Frequency random walk, ppm per root second
+  double         tempInterval = 0.0;                                   // Seconds between temperature steps, 0 for none
+  double         tempStep     = 0.0;                                   // Standard deviation of each step, ppm
+} OscillatorModel;
+
+/**
+ *   ServerModel describes a simulated NTP server and the network to it. Each direction takes delay seconds, plus an
+ *   exponential variate of mean jitter, plus (outbound) or minus (return) half of asymmetry. A query is lost with
+ *   probability loss, and a reply is an outlier, delayed a further outlierDelay seconds, with probability outliers.
+ */
+typedef struct ServerModel {
+  double         delay        = 0.020;
+  double         jitter       = 0.002;
+  double         asymmetry    = 0.0;
+  double         loss         = 0.0;
+  double         outliers     = 0.0;
+  double         outlierDelay = 0.250;
+  double         processing   = 0.0001;                                // Seconds from T2 to T3
+  double         error        = 0.0;                                   // Server clock minus true time, seconds
+  int            stratum      = 1;
+} ServerModel;
+
+/**
+ *   Oscillator integrates an OscillatorModel over true time: error() is the local minus true time accumulated so far.
+ */
+class Oscillator {
+  public:
+  Oscillator(const OscillatorModel& m, uint64_t seed) : _model(m), _random(seed), _error(m.offset), _frequency(m.frequency), _nextStep(m.tempInterval) {}
+
+  void           advance(double dt);                                   // Let dt seconds of true time pass
+  double         error()                       const                   {return _error;}
+  double         frequency()                   const                   {return _frequency;}
+
+  private:
+  OscillatorModel  _model;
+  SimRandom        _random;
+  double           _error;
+  double           _frequency;
+  double           _elapsed  = 0.0;
+  double           _nextStep;                                          // Elapsed time of the next temperature step
+};
+
+/**
+ *   SimulatedServer answers queries sent at true time sent, returning false if the query or reply is lost, otherwise the
+ *   server timestamps t2 and t3 (true seconds, plus the server's error) and the true time the reply arrives. Randomness
+ *   comes from the querying device, so a server may be shared by devices on many threads and stay deterministic per device.
+ */
+class SimulatedServer {
+  public:
+  SimulatedServer(const ServerModel& m) : _model(m)                    {}
+  virtual ~SimulatedServer()                                           {}
+
+  virtual bool   respond(double sent, SimRandom& random, double& t2, double& t3, double& arrival);
+  const ServerModel& model()                   const                   {return _model;}
+  uint64_t       queries()                     const                   {return _queries.load(std::memory_order_relaxed);}
+
+  protected:
+  ServerModel              _model;
+  std::atomic<uint64_t>    _queries{0};
+};
+
+/**
+ *   SimulatedDevice is one device in virtual time: an Oscillator for its tick counter and a route to a SimulatedServer.
+ *   While installed on a thread, LSC_MILLIS() and monotonicMicros() on that thread read its ticks, and NTPTime's queries
+ *   go to its server through SimulatedUDP, with virtual time passing for the round trip.
+ *   The following methods are supported:
+ *      void      install()                     // Make this the device of the calling thread
+ *      void      uninstall()                   // Remove the calling thread's device
+ *      void      advance(double dt)            // Let dt seconds of true time pass
+ *      double    now()                         // True seconds since SIMULATION_EPOCH
+ *      Instant   utc()                         // True UTC
+ *      double    error(const SystemClock& c)   // c.peekTime() minus true UTC, seconds
+ *      unsigned long millis()                  // Device tick counter in milliseconds, 32 bits wide as on the device
+ *      uint64_t  micros()                      // Device tick counter in microseconds, 64 bits wide as monotonicMicros()
+ *      uint32_t  queries()                     // NTP queries sent
+ *      static SimulatedDevice* current()       // Device installed on the calling thread, NULL if none
+ */
+class SimulatedDevice {
+  public:
+  SimulatedDevice(SimulatedServer& server, const OscillatorModel& m, uint64_t seed) : _server(server), _oscillator(m,seed), _random(seed^0x5EED5EED5EED5EEDULL), _ticks(m.ticks) {}
+
+  void           install()                                             {_current = this;}
+  static void    uninstall()                                           {_current = NULL;}
+  void           advance(double dt)                                    {_now += dt;_oscillator.advance(dt);}
+  double         now()                         const                   {return _now;}
+  Instant        utc()                         const                   {return Instant((int64_t)SIMULATION_EPOCH) + Instant(_now);}
+  double         error(const SystemClock& c)   const;
+  unsigned long  millis()                      const                   {return (unsigned long)(uint32_t)(int64_t)floor(local()*1000.0);}
+  uint64_t       micros()                      const                   {return (uint64_t)(int64_t)floor(local()*1000000.0);}
+  uint32_t       queries()                     const                   {return _queries;}
+  Oscillator&    oscillator()                                          {return _oscillator;}
+  SimulatedServer& server()                                            {return _server;}
+
+  static SimulatedDevice* current()                                    {return _current;}
+
+  private:
+  friend class SimulatedUDP;
+  double         local()                       const                   {return _ticks + _now + _oscillator.error();}
+  void           send();                                               // Hand the pending request to the server
+  bool           receive(uint8_t* packet);                             // Poll for the reply, letting virtual time pass
+
+  SimulatedServer&   _server;
+  Oscillator         _oscillator;
+  SimRandom          _random;
+  double             _ticks;                                           // Local seconds at true time 0
+  double             _now      = 0.0;
+  uint32_t           _queries  = 0;
+  bool               _pending  = false;                                // A reply is on its way
+  double             _arrival  = 0.0;
+  double             _t2       = 0.0;
+  double             _t3       = 0.0;
+
+  static thread_local SimulatedDevice*  _current;
+};
+
+/**
+ *   SimulatedUDP stands in for WiFiUDP in NTPTime in a LSC_SIMULATION build, carrying the request to the calling thread's
+ *   SimulatedDevice and polling its reply, so NTPTime's packet formatting, parsing and timeout run unchanged.
+ */
+class SimulatedUDP {
+  public:
+  uint8_t        begin(uint16_t)                                       {_device = SimulatedDevice::current();return ((_device==NULL)?(0):(1));}
+  void           stop()                                                {_device = NULL;}
+  int            beginPacket(IPAddress, uint16_t)                      {return 1;}
+  size_t         write(const uint8_t*, size_t n)                       {return n;}
+  int            endPacket()                                           {_device->send();return 1;}
+  int            parsePacket()                                         {return ((_device->receive(_packet))?(NTP_PACKET_SIZE):(0));}
+  int            read(uint8_t* buf, size_t n)                          {n = ((n<NTP_PACKET_SIZE)?(n):(NTP_PACKET_SIZE));memcpy(buf,_packet,n);return n;}
+
+  private:
+  SimulatedDevice*   _device = NULL;
+  uint8_t            _packet[NTP_PACKET_SIZE];
+};
+
+/**
+ *   SimulationReport accumulates the accuracy of a clock sampled after every step of a simulation, from its first answered
+ *   sync on (before it, the clock still holds its initialization date), and its NTP traffic.
+ */
+class SimulationReport {
+  public:
+  void           sample(double error);                                 // Record one clock error in seconds
+  void           print(Print& out)             const;
+  double         rms()                         const                   {return ((samples==0)?(0.0):(sqrt(squares/samples)));}
+
+  Histogram      error;                                                // Absolute clock error, microseconds
+  double         squares   = 0.0;
+  double         worst     = 0.0;                                      // Largest absolute error, seconds
+  uint32_t       samples   = 0;
+  uint32_t       queries   = 0;
+  uint32_t       timeouts  = 0;
+  double         seconds   = 0.0;                                      // Virtual time simulated
+  double         firstSync = -1.0;                                     // Virtual seconds to the first answered sync, -1 if none
+  double         wall      = 0.0;                                      // Real time taken
+};
+
+/**
+ *   Simulation runs a SystemClock on a SimulatedDevice: it installs the device, synchronizes the clock, then for the given
+ *   virtual seconds advances true time by step, calls the clock's doDevice() (so its syncTimer queries on schedule) and
+ *   samples its error against true UTC once a query has been answered. Every query and reply goes through NTPTime as on
+ *   a device. Build the library with LSC_SIMULATION defined (e.g. -DLSC_SIMULATION in build_flags) on a host Arduino core
+ *   or an ESP32; a day at 1 second steps takes tens of milliseconds.
+ *
+ *   Example:
+ *      ServerModel     net;          net.loss = 0.01;  net.asymmetry = 0.004;
+ *      OscillatorModel xtal;         xtal.frequency = 35.0;  xtal.randomWalk = 0.001;  xtal.tempInterval = 3600;  xtal.tempStep = 0.5;
+ *      SimulatedServer server(net);
+ *      SimulatedDevice device(server,xtal,42);
+ *      SystemClock     clock;
+ *      SimulationReport report;
+ *      clock.ntpSync(15);
+ *      Simulation::run(clock,device,7*86400.0,1.0,report);
+ *      report.print(Serial);
+ */
+class Simulation {
+  public:
+  static void    run(SystemClock& clock, SimulatedDevice& device, double seconds, double step, SimulationReport& report);
+};
+
+} // End of namespace lsc
+
+#endif
+#endif
@@ -0,0 +1,100 @@
+/**
+ *
+ *  SystemClock Library
+ *  Copyright (C) 2024  Daniel L Toth
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or any
+ *  later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *  The author can be contacted at dan@leelanausoftware.com
+ *
+ */
+
+#include "Sleep.h"
+
+#if defined(__cpp_impl_coroutine)
+
+/** Leelanau Software Company namespace
+*
+*/
+namespace lsc {
+
+bool SleepService::InstantAwaiter::await_suspend(std::coroutine_handle<> h) {
+  _handle = h;
+  if( !_service.arm(this) ) return false;
+  _service.link(this);
+  return true;
+}
+
+/**
+ *   Rounded up, so a coroutine never resumes before the clock reaches its target.
+ */
+unsigned long SleepService::untilMillis(const Instant& utc) const {
+  Instant diff = utc - _clock.peekTime();
+  if( diff.secs() < 0 ) return 0;
+  uint64_t ms = (uint64_t)diff.secs()*1000 + ((((uint64_t)diff.fraction()*1000) + 0xFFFFFFFFULL)>>32);
+  return ((ms > TIMER_MAX_DELAY)?(TIMER_MAX_DELAY):((unsigned long)ms));
+}
+
+bool SleepService::arm(InstantAwaiter* w) {
+  unsigned long ms = untilMillis(w->_target);
+  if( ms == 0 ) return false;
+  w->_timer = _timers.schedule(ms,[this,w]{expire(w);});
+  return w->_timer != INVALID_TIMER;
+}
+
+/**
+ *   The delay was computed from the clock at the time it was armed; if the clock has not yet reached the target (it was
+ *   stepped back, or the delay was clamped to TIMER_MAX_DELAY) the wait is armed again.
+ */
+void SleepService::expire(InstantAwaiter* w) {
+  if( arm(w) ) return;
+  unlink(w);
+  w->_handle.resume();
+}
+
+/**
+ *   When the SystemClock has synchronized, every wall-clock wait is converted to a delay again. The next wait is taken
+ *   before resuming, since a resumed coroutine may link a new wait or finish and free its frame.
+ */
+void SleepService::doDevice() {
+  unsigned int syncs = _clock.syncCount();
+  if( syncs == _syncs ) return;
+  _syncs = syncs;
+  InstantAwaiter* w = _waits;
+  while( w != NULL ) {
+    InstantAwaiter* next = w->_next;
+    _timers.cancel(w->_timer);
+    if( !arm(w) ) {unlink(w);w->_handle.resume();}
+    w = next;
+  }
+}
+
+void SleepService::link(InstantAwaiter* w) {
+  w->_prev = NULL;
+  w->_next = _waits;
+  if( _waits != NULL ) _waits->_prev = w;
+  _waits   = w;
+}
+
+void SleepService::unlink(InstantAwaiter* w) {
+  if( w->_prev != NULL ) w->_prev->_next = w->_next;
+  else _waits = w->_next;
+  if( w->_next != NULL ) w->_next->_prev = w->_prev;
+  w->_next = NULL;
+  w->_prev = NULL;
+}
+
+} // End of namespace lsc
+
+#endif
@@ -0,0 +1,154 @@
+
+/**
+ *
+ *  SystemClock Library
+ *  Copyright (C) 2024  Daniel L Toth
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or any
+ *  later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *  The author can be contacted at dan@leelanausoftware.com
+ *
+ */
+
+#ifndef SLEEP_H
+#define SLEEP_H
+
+#if defined(__cpp_impl_coroutine)
+
+#include <Arduino.h>
+#include <chrono>
+#include <coroutine>
+#include <exception>
+#include "Instant.h"
+#include "SystemClock.h"
+#include "TimerService.h"
+
+/** Leelanau Software Company namespace
+*
+*/
+namespace lsc {
+
+/**
+ *   SleepService provides C++20 coroutine awaitables that suspend a coroutine until a delay has passed or until a UTC
+ *   Instant on a SystemClock, sharing one TimerService as the deadline queue rather than dedicating a Timer per wait.
+ *   The following methods are supported:
+ *      auto  sleep_for(unsigned long ms)              // co_await to resume ms milliseconds from now
+ *      auto  sleep_for(std::chrono::duration d)       // co_await to resume after d, rounded up to milliseconds
+ *      auto  sleep_until(const Instant& utc)          // co_await to resume once the SystemClock reaches utc
+ *      void  doDevice()                               // Called in Arduino loop() function, after the TimerService's doDevice()
+ *
+ *   Coroutines are resumed from TimerService::doDevice() on the loop's thread. A wall-clock wait is converted to a delay
+ *   using the SystemClock's current time, and is re-converted whenever the SystemClock synchronizes (see syncCount()), so
+ *   a step forward past the target resumes the coroutine on the next doDevice() and a step backward extends the wait. A
+ *   wait whose TimerService is full resumes at once, as does a wait for a time already passed.
+ *
+ *   Example:
+ *   SystemClock  sysClock;
+ *   TimerService timers;
+ *   SleepService sleeper(timers,sysClock);
+ *
+ *   SleepTask blink() {
+ *     for(;;) {
+ *       digitalWrite(LED,!digitalRead(LED));
+ *       co_await sleeper.sleep_for(500);
+ *     }
+ *   }
+ *
+ *   void loop() {
+ *     sysClock.doDevice();
+ *     timers.doDevice();
+ *     sleeper.doDevice();
+ *   }
+ */
+class SleepService {
+  public:
+
+/**
+ *   Awaitable for a relative delay. The TimerService handler captures only the coroutine handle.
+ */
+  class DelayAwaiter {
+    public:
+    DelayAwaiter(TimerService& t, unsigned long ms) : _timers(t), _ms(ms) {}
+    bool  await_ready()                        const           {return _ms == 0;}
+    bool  await_suspend(std::coroutine_handle<> h)             {return _timers.schedule(_ms,[h]{h.resume();}) != INVALID_TIMER;}
+    void  await_resume()                       const           {}
+
+    private:
+    TimerService&  _timers;
+    unsigned long  _ms;
+  };
+
+/**
+ *   Awaitable for a UTC Instant. While suspended it is linked on its SleepService's list of wall-clock waits, which lives
+ *   in the coroutine frame, so waiting never allocates.
+ */
+  class InstantAwaiter {
+    public:
+    InstantAwaiter(SleepService& s, const Instant& utc) : _service(s), _target(utc) {}
+    bool  await_ready()                        const           {return _service.untilMillis(_target) == 0;}
+    bool  await_suspend(std::coroutine_handle<> h);
+    void  await_resume()                       const           {}
+
+    private:
+    friend class SleepService;
+    SleepService&            _service;
+    Instant                  _target;
+    std::coroutine_handle<>  _handle;
+    TimerId                  _timer = INVALID_TIMER;
+    InstantAwaiter*          _next  = NULL;
+    InstantAwaiter*          _prev  = NULL;
+  };
+
+  SleepService(TimerService& t, SystemClock& c) : _timers(t), _clock(c), _syncs(c.syncCount()) {}
+
+  DelayAwaiter   sleep_for(unsigned long ms)                   {return DelayAwaiter(_timers,ms);}
+  template<typename Rep, typename Period>
+  DelayAwaiter   sleep_for(std::chrono::duration<Rep,Period> d){return DelayAwaiter(_timers,(unsigned long)std::chrono::ceil<std::chrono::milliseconds>(d).count());}
+  InstantAwaiter sleep_until(const Instant& utc)               {return InstantAwaiter(*this,utc);}
+  void           doDevice();
+
+  private:
+  SleepService(const SleepService&)            = delete;
+  SleepService& operator=(const SleepService&) = delete;
+
+  unsigned long  untilMillis(const Instant& utc)  const;       // Milliseconds from now to utc, 0 if passed
+  bool           arm(InstantAwaiter* w);                       // Schedule w for its target, false if it is due now
+  void           expire(InstantAwaiter* w);                    // TimerService handler for w
+  void           link(InstantAwaiter* w);
+  void           unlink(InstantAwaiter* w);
+
+  TimerService&    _timers;
+  SystemClock&     _clock;
+  unsigned int     _syncs;                                     // SystemClock syncCount() when waits were last converted
+  InstantAwaiter*  _waits = NULL;                              // Suspended wall-clock waits
+};
+
+/**
+ *   SleepTask is a minimal fire-and-forget coroutine type for sketches with no task library of their own. It starts
+ *   running when called and its frame is destroyed when the coroutine returns.
+ */
+struct SleepTask {
+  struct promise_type {
+    SleepTask           get_return_object()                    {return SleepTask();}
+    std::suspend_never  initial_suspend()                      {return {};}
+    std::suspend_never  final_suspend()        noexcept        {return {};}
+    void                return_void()                          {}
+    void                unhandled_exception()                  {std::terminate();}
+  };
+};
+
+} // End of namespace lsc
+
+#endif
+#endif
@@ -22,6 +22,7 @@
  */
 
 #include "SystemClock.h"
+#include "Probes.h"
 
 /** Leelanau Software Company namespace 
 *  
@@ -32,6 +33,7 @@ SystemClock::SystemClock()  {
   _timeServer = NTPTime::getTimeServerAddress();
   _initDate.initialize(0,JAN1_2024,0);
   _sysTime.initialize(Instant(0,JAN1_2024,0));
+  publish();
   _syncTimer.set(0,_ntpSync,0);  
   _syncTimer.setHandler([this]{ 
                 updateSysTime(); 
@@ -83,15 +85,60 @@ void SystemClock::ntpSync(unsigned int min) {
 
 Instant SystemClock::sysTime() {
   if( (_lastSync == 0) || (_sysTime.ntpTime().secs() > _nextSync)  )  return updateSysTime();
-  else return _sysTime.update().ntpTime();
+  _sysTime.update();
+  publish();
+  return _sysTime.ntpTime();
+}
+
+/**
+ *   Called only from the loop thread. Slot fields are relaxed atomics so a reader overlapping a publish reads stale or
+ *   mixed values, never torn ones, and discards them when it sees the slot sequence has moved.
+ */
+void SystemClock::publish() {
+  uint32_t   n    = _current.load(std::memory_order_relaxed) + 1;
+  Published& slot = _published[n&1];
+  uint32_t   seq  = slot.seq.load(std::memory_order_relaxed);
+  slot.seq.store(seq+1,std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot.secs.store(_sysTime.ntpTime().secs(),std::memory_order_relaxed);
+  slot.fraction.store(_sysTime.ntpTime().fraction(),std::memory_order_relaxed);
+  slot.millis.store(_sysTime.getMillis(),std::memory_order_relaxed);
+  slot.seq.store(seq+2,std::memory_order_release);
+  _current.store(n,std::memory_order_release);
+}
+
+/**
+ *   The current slot is next written two publishes later, so a retry means the loop published in full meanwhile and the
+ *   retry finds a newer complete slot.
+ */
+Instant SystemClock::peekTime() const {
+  int64_t       secs;
+  uint32_t      fraction;
+  unsigned long stamp;
+  for( ;; ) {
+    const Published& slot = _published[_current.load(std::memory_order_acquire)&1];
+    uint32_t         seq  = slot.seq.load(std::memory_order_acquire);
+    if( seq & 1 ) continue;
+    secs     = slot.secs.load(std::memory_order_relaxed);
+    fraction = slot.fraction.load(std::memory_order_relaxed);
+    stamp    = slot.millis.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if( slot.seq.load(std::memory_order_relaxed) == seq ) break;
+  }
+  Instant result(secs,fraction);
+  result.addMillis((uint32_t)(LSC_MILLIS() - stamp));
+  return result;
 }
 
 Instant SystemClock::updateSysTime() {
-  Instant ofst;
-  _sysTime           = NTPTime::updateSysTime(ofst,_sysTime);
+  _sysTime           = NTPTime::updateSysTime(_lastSample,_sysTime);
+  publish();
   if( _lastSync == 0 ) _start = _sysTime;
   _lastSync          = _sysTime.ntpTime().secs();
   _nextSync          = _lastSync + ntpSync()*60;
+  _syncCount++;
+  if( LSC_PROBE_ENABLED(clock_step) ) LSC_PROBE(clock_step,(int64_t)(_lastSample.offset.sysTimed()*1e9),_syncCount);
+  if( _metrics != NULL ) _metrics->record(_lastSample,_syncCount);
   resetSyncTimer();
   return _sysTime.ntpTime();
 }
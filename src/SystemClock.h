@@ -24,10 +24,12 @@
 #define SYSTEM_CLOCK_H
 
 #include <Arduino.h>
+#include <atomic>
 #include "Instant.h"
 #include "Timestamp.h"
 #include "NTPTime.h"
 #include "Timer.h"
+#include "Metrics.h"
 
 #define GMT              0.0              // Timezone offset for GMT
 #define DEFAULT_SYNC     60               // NTP Synchronization interval in minutes
@@ -48,8 +50,15 @@ namespace lsc {
  *      sysTime()            - Current system time UTC, updating with NTP as necessary
  *      updateSysTime()      - Force NTP update and return current system time UTC
  *      startTime()          - The actual UTC start time of SystemClock
+ *      peekTime()           - Current system time UTC, never synchronizing with NTP
  *      initializationDate() - Initialization date/time in UTC
  *
+ *   SystemClock is driven from one thread, the application loop, which alone calls sysTime(), updateSysTime(), doDevice()
+ *   and the other methods that set the clock. peekTime() may be called from any thread: each time system time is set, the
+ *   loop publishes an (NTP time, millis()) pair into the older of two slots, each under its own sequence lock, and then
+ *   marks it current. peekTime() reads the current slot and retries only if a whole newer publish completed meanwhile, so
+ *   a reader never waits on a publish in progress, even one preempted on the same core.
+ *
  *   Additionaly, for convenience SystemClock has a timezone offset so some methods can provide system time as 
  *   Instant in local time:
  *      now()                - System time in local time
@@ -66,6 +75,7 @@ class SystemClock {
     virtual Instant   now()                                      {return utcToLocal(sysTime());}   // Return system time in local time zone, synchronizing with NTP as necessary.
     virtual Instant   sysTime();                                                                   // Return system time in UTC, synchronizing with NTP as necessary.
     virtual Instant   updateSysTime();                                                             // Force NTP update to system time and return sysTime in UTC
+    Instant           peekTime()                     const;                                        // Return system time in UTC without synchronizing with NTP, from any thread
     Instant           utcToLocal(const Instant& utc) const       {return utc + _tzOffset;}         // Convert utc Instant to local time from timezone offset
     const Timestamp&  startTime()                    const       {return _start;}                  // UTC Timestamp of clock start 
 
@@ -73,9 +83,9 @@ class SystemClock {
  *    Initialize System Time for first update. As noted above, system time should be initialized to within 68 years
  *    of actual UTC. Default initialization is Jan 1, 2024 00:00:00
  */
-    void             initialize(const Instant& ref)               {_sysTime.initialize(ref);_initDate = ref;}  // Initialize SystemClock time UTC
+    void             initialize(const Instant& ref)               {_sysTime.initialize(ref);publish();_initDate = ref;_syncCount++;}  // Initialize SystemClock time UTC
     const Instant&   initializationDate()                         {return _initDate;}                          // Get initialization date/time as Instant UTC
-    void             reset()                                      {_lastSync=0;_sysTime=initializationDate();} // Reset SystemClock to its initialization date
+    void             reset()                                      {_lastSync=0;_sysTime=initializationDate();publish();_syncCount++;} // Reset SystemClock to its initialization date
 
 /**
  *    Methods for timezone offset and NTP server address/port
@@ -97,16 +107,27 @@ class SystemClock {
     void             setTimerON()                                 {timerOFF(false);}                           // Turn syncTimer ON
     boolean          timerOFF()       const                       {return _timerOFF;}                          // True of syncTimer is OFF
     boolean          timerON()        const                       {return !timerOFF();}                        // True if syncTImer is ON
+    unsigned int     syncCount()      const                       {return _syncCount;}                         // Number of times system time has been set, so clients can detect steps
+    const NTPSample& lastSample()     const                       {return _lastSample;}                        // Timestamps, offset and delay of the last NTP query
+
+/**
+ *   Record the NTPSample of each sync in NTPMetrics, NULL to stop recording
+ */
+    void             setMetrics(NTPMetrics* m)                    {_metrics = m;}
+    NTPMetrics*      metrics()                                    {return _metrics;}
 
 /**
- *   Do a unit of work, in this case update the syncTimer
+ *   Do a unit of work, in this case update the syncTimer. remaining() is the number of milliseconds until doDevice() has work
+ *   to do, or TIMER_NO_DEADLINE if the syncTimer is OFF, so a loop may sleep until then.
  */
     void             doDevice()                                   {_syncTimer.doDevice();}
+    unsigned long    remaining()                                  {return ((timerON())?(_syncTimer.remaining()):(TIMER_NO_DEADLINE));}
 
 
   protected:
     void             timerOFF(boolean flg);
     void             resetSyncTimer();
+    void             publish();                                  // Publish _sysTime for peekTime()
 
     Instant         _initDate;                           // Clock initialization date, defaults to Jan 1, 2024
     Timestamp       _start;                              // Start time is first call sysTime()
@@ -119,6 +140,18 @@ class SystemClock {
     unsigned int    _ntpSync      = DEFAULT_SYNC;        // NTP synchronization interval in minutes
     boolean         _timerOFF     = false;               // Turn syncTimer ON/OFF
     Timer           _syncTimer;                          // Timer to sync with NTP on the ntpSync interval
+    unsigned int    _syncCount    = 0;                   // Incremented each time system time is set
+    NTPSample       _lastSample;                         // Last NTP query
+    NTPMetrics*     _metrics      = NULL;                // Sync health, none recorded if NULL
+
+    typedef struct Published {
+      std::atomic<uint32_t>       seq{0};                // Sequence lock on the slot, odd while publishing
+      std::atomic<int64_t>        secs{0};               // _sysTime seconds
+      std::atomic<uint32_t>       fraction{0};           // _sysTime fraction
+      std::atomic<unsigned long>  millis{0};             // _sysTime millis()
+    } Published;
+    Published                   _published[2];           // System time for peekTime(), slot _current&1 is current
+    std::atomic<uint32_t>       _current{0};             // Publishes so far
 
 };
 
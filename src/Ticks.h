@@ -0,0 +1,123 @@
+
+/**
+ *
+ *  SystemClock Library
+ *  Copyright (C) 2024  Daniel L Toth
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or any
+ *  later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *  The author can be contacted at dan@leelanausoftware.com
+ *
+ */
+
+#ifndef TICKS_H
+#define TICKS_H
+
+#include <Arduino.h>
+#include "Instant.h"
+#ifdef ESP32
+#include <esp_timer.h>
+#elif !defined(ESP8266) && (defined(__linux__) || defined(__APPLE__))
+#include <time.h>
+#endif
+
+/** Leelanau Software Company namespace
+*
+*/
+namespace lsc {
+
+/**
+ *   LSC_MILLIS() is the millisecond tick read by Timestamp, Deadline, Timer, TimerService, TimerExecutor, CronScheduler,
+ *   IDClock and NTPTime. It is millis(), except in a LSC_SIMULATION build, where it and monotonicMicros() read the virtual
+ *   oscillator of the SimulatedDevice installed on the calling thread (see Simulation.h), falling back to the platform
+ *   clocks on threads without one.
+ */
+#ifdef LSC_SIMULATION
+unsigned long    simulatedMillis();
+bool             simulatedMicros(uint64_t& us);                        // False if the thread has no SimulatedDevice
+#define LSC_MILLIS()   lsc::simulatedMillis()
+#else
+#define LSC_MILLIS()   millis()
+#endif
+
+/**
+ *   Microseconds on a 64-bit monotonic clock that never wraps in practice and is unaffected by NTP steps of SystemClock.
+ *   The source is esp_timer_get_time() on ESP32, micros64() on ESP8266, and CLOCK_MONOTONIC on Linux and macOS.
+ *   Elsewhere micros() is extended to 64 bits in software, which requires a call at least once per 71 minutes and is
+ *   not safe for concurrent callers.
+ */
+inline uint64_t monotonicMicros() {
+#ifdef LSC_SIMULATION
+  uint64_t us;
+  if( simulatedMicros(us) ) return us;
+#endif
+#ifdef ESP32
+  return (uint64_t)esp_timer_get_time();
+#elif defined(ESP8266)
+  return micros64();
+#elif defined(__linux__) || defined(__APPLE__)
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  return (uint64_t)ts.tv_sec*1000000ULL + (uint64_t)ts.tv_nsec/1000;
+#else
+  static uint32_t high = 0;
+  static uint32_t last = 0;
+  uint32_t        now  = (uint32_t)micros();
+  if( now < last ) high++;
+  last = now;
+  return ((uint64_t)high<<32) | now;
+#endif
+}
+
+/**
+ *   TickAnchor pairs a monotonicMicros() tick with the UTC Instant it was read at, so ticks recorded on a hot path can be
+ *   converted to UTC later, away from it. Conversion is linear from the anchor and so drifts with the oscillator; anchor
+ *   again after each SystemClock synchronization (see syncCount()) to keep the error within the clock's own. The UTC
+ *   reading is taken from SystemClock::peekTime(), which has millisecond resolution.
+ *   The following methods are supported:
+ *      bool      valid()                       // True once the anchor has been set
+ *      uint64_t  tick()                        // monotonicMicros() at the anchor
+ *      Instant   utc()                         // UTC at the anchor
+ *      Instant   toInstant(uint64_t tick)      // UTC Instant at tick
+ *      uint64_t  toTick(const Instant& utc)    // Tick at utc
+ *      static Instant fromMicros(int64_t us)   // Duration of us microseconds as an Instant, fraction rounded up so it prints back as us
+ *
+ *   Example:
+ *      TickAnchor anchor(sysClock.peekTime());
+ *      uint64_t   start = monotonicMicros();
+ *      ...
+ *      anchor.toInstant(start).printDateTime(buffer,64);
+ */
+class TickAnchor {
+  public:
+  TickAnchor()                                                 {}
+  TickAnchor(const Instant& utc, uint64_t tick = monotonicMicros()) : _utc(utc), _tick(tick), _valid(true) {}
+
+  bool           valid()                       const           {return _valid;}
+  uint64_t       tick()                        const           {return _tick;}
+  Instant        utc()                         const           {return _utc;}
+  Instant        toInstant(uint64_t tick)      const           {return _utc + fromMicros((int64_t)(tick - _tick));}
+  uint64_t       toTick(const Instant& utc)    const           {Instant d = utc - _utc;return _tick + (uint64_t)(d.secs()*1000000 + (((uint64_t)d.fraction()*1000000 + 0x80000000ULL)>>32));}
+
+  static Instant fromMicros(int64_t us)                        {int64_t s = ((us<0)?(-((-us+999999)/1000000)):(us/1000000));return Instant(s,(uint32_t)(((((uint64_t)(us - s*1000000))<<32) + 999999)/1000000));}
+
+  private:
+  Instant        _utc;
+  uint64_t       _tick  = 0;
+  bool           _valid = false;
+};
+
+} // End of namespace lsc
+
+#endif
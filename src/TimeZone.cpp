@@ -0,0 +1,157 @@
+/**
+ *
+ *  SystemClock Library
+ *  Copyright (C) 2024  Daniel L Toth
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or any
+ *  later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *  The author can be contacted at dan@leelanausoftware.com
+ *
+ */
+
+#include "TimeZone.h"
+
+/** Leelanau Software Company namespace
+*
+*/
+namespace lsc {
+
+#define DAYS_1900_TO_1970    25567                // Days from Jan 1, 1900 to Jan 1, 1970
+
+/**
+ *   Day number conversions from the proleptic Gregorian calendar, computed in 400 year eras so the cost does not depend
+ *   on the distance from 1900. Months are 1 based.
+ */
+int64_t TimeZone::daysFromCivil(int y, int m, int d) {
+  y -= ((m <= 2)?(1):(0));
+  int64_t  era = ((y >= 0)?(y):(y-399))/400;
+  uint32_t yoe = (uint32_t)(y - era*400);
+  uint32_t doy = (153*(m + ((m > 2)?(-3):(9))) + 2)/5 + d - 1;
+  uint32_t doe = yoe*365 + yoe/4 - yoe/100 + doy;
+  return era*146097 + (int64_t)doe - 719468 + DAYS_1900_TO_1970;
+}
+
+void TimeZone::civilFromDays(int64_t days, int& y, int& m, int& d) {
+  days += 719468 - DAYS_1900_TO_1970;
+  int64_t  era = ((days >= 0)?(days):(days-146096))/146097;
+  uint32_t doe = (uint32_t)(days - era*146097);
+  uint32_t yoe = (doe - doe/1460 + doe/36524 - doe/146096)/365;
+  uint32_t doy = doe - (365*yoe + yoe/4 - yoe/100);
+  uint32_t mp  = (5*doy + 2)/153;
+  d = (int)(doy - (153*mp + 2)/5 + 1);
+  m = (int)((mp < 10)?(mp+3):(mp-9));
+  y = (int)(yoe + era*400) + ((m <= 2)?(1):(0));
+}
+
+/**
+ *   Parse helpers. Names are alphabetic or quoted as <...>; times are [+-]hh[:mm[:ss]].
+ */
+static bool parseName(const char*& s) {
+  const char* start = s;
+  if( *s == '<' ) {
+    while( *s && *s != '>' ) s++;
+    if( *s != '>' ) return false;
+    s++;
+    return (s - start) > 2;
+  }
+  while( (*s >= 'A' && *s <= 'Z') || (*s >= 'a' && *s <= 'z') ) s++;
+  return (s - start) >= 3;
+}
+
+static bool parseNumber(const char*& s, int& result) {
+  if( *s < '0' || *s > '9' ) return false;
+  result = 0;
+  while( *s >= '0' && *s <= '9' ) result = result*10 + (*s++ - '0');
+  return true;
+}
+
+static bool parseTime(const char*& s, int32_t& result) {
+  int sign = 1;
+  if( *s == '+' || *s == '-' ) sign = ((*s++ == '-')?(-1):(1));
+  int h = 0, m = 0, sec = 0;
+  if( !parseNumber(s,h) ) return false;
+  if( *s == ':' ) {s++;if( !parseNumber(s,m) ) return false;}
+  if( *s == ':' ) {s++;if( !parseNumber(s,sec) ) return false;}
+  if( h > 167 || m > 59 || sec > 59 ) return false;
+  result = sign*(h*3600 + m*60 + sec);
+  return true;
+}
+
+bool TimeZone::parse(const char* s) {
+  if( s == NULL || !parseName(s) ) return false;
+  int32_t west = 0;
+  if( !parseTime(s,west) ) return false;
+  _std       = -west;
+  _dstOffset = _std;
+  if( *s == '\0' ) return true;
+
+  if( !parseName(s) ) return false;
+  _hasDST    = true;
+  _dstOffset = _std + 3600;
+  if( *s != ',' && *s != '\0' ) {
+    if( !parseTime(s,west) ) return false;
+    _dstOffset = -west;
+  }
+  if( *s == '\0' ) {                                     // No rules, use US rules
+    _start = Rule{3,2,0,7200};
+    _end   = Rule{11,1,0,7200};
+    return true;
+  }
+
+  Rule* rules[] = {&_start,&_end};
+  for( Rule* r : rules ) {
+    if( *s++ != ',' || *s++ != 'M' ) return false;      // Only Mm.w.d rules are supported
+    if( !parseNumber(s,r->month) || *s++ != '.' || !parseNumber(s,r->week) || *s++ != '.' || !parseNumber(s,r->day) ) return false;
+    if( r->month < 1 || r->month > 12 || r->week < 1 || r->week > 5 || r->day > 6 ) return false;
+    r->time = 7200;
+    if( *s == '/' ) {s++;if( !parseTime(s,r->time) ) return false;}
+  }
+  return *s == '\0';
+}
+
+/**
+ *   UTC seconds of a rule transition in year, where offset is the UTC offset in effect just before the transition.
+ */
+int64_t TimeZone::transition(int year, const Rule& r, int32_t offset) const {
+  int64_t first = daysFromCivil(year,r.month,1);
+  int64_t next  = ((r.month == 12)?(daysFromCivil(year+1,1,1)):(daysFromCivil(year,r.month+1,1)));
+  int64_t day   = first + (r.day - weekday(first) + 7)%7 + (r.week-1)*7;
+  while( day >= next ) day -= 7;                         // Week 5 is the last such weekday of the month
+  return day*SECS_IN_DAY + r.time - offset;
+}
+
+bool TimeZone::isDST(const Instant& utc) const {
+  if( !_hasDST ) return false;
+  int64_t t     = utc.secs();
+  int     year  = yearOf(t + _std);
+  int64_t start = dstStart(year);
+  int64_t end   = dstEnd(year);
+  if( start < end ) return (t >= start) && (t < end);
+  return (t < end) || (t >= start);                      // Southern hemisphere, DST spans the new year
+}
+
+/**
+ *   Try the daylight reading of local first, so a repeated local time resolves to its first occurrence. If neither
+ *   reading is consistent local is in the spring forward gap, and the transition instant is returned.
+ */
+Instant TimeZone::toUTC(const Instant& local) const {
+  if( !_hasDST ) return local - (int)_std;
+  Instant daylight = local - (int)_dstOffset;
+  if( isDST(daylight) ) return daylight;
+  Instant standard = local - (int)_std;
+  if( !isDST(standard) ) return standard;
+  return Instant(dstStart(yearOf(standard.secs() + _std)),local.fraction());
+}
+
+} // End of namespace lsc
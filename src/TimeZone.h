@@ -0,0 +1,105 @@
+
+/**
+ *
+ *  SystemClock Library
+ *  Copyright (C) 2024  Daniel L Toth
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or any
+ *  later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *  The author can be contacted at dan@leelanausoftware.com
+ *
+ */
+
+#ifndef TIME_ZONE_H
+#define TIME_ZONE_H
+
+#include <Arduino.h>
+#include "Instant.h"
+
+/** Leelanau Software Company namespace
+*
+*/
+namespace lsc {
+
+/**
+ *   TimeZone converts between UTC and local time for a standard offset with an optional daylight saving rule, given as
+ *   a POSIX TZ string:
+ *      std offset [dst [offset] [,start[/time],end[/time]]]
+ *   where offsets are hours west of UTC as [+-]hh[:mm[:ss]], and start and end are Mm.w.d (month m, week w of 1 to 5
+ *   where 5 is the last, weekday d with 0 for Sunday), with a local transition time defaulting to 02:00:00. If a DST name
+ *   is given without rules, US rules (M3.2.0,M11.1.0) are used. For example:
+ *      "UTC0"                              // UTC
+ *      "EST5EDT,M3.2.0,M11.1.0"            // US Eastern
+ *      "CET-1CEST,M3.5.0,M10.5.0/3"        // Central European
+ *      "AEST-10AEDT,M10.1.0,M4.1.0/3"      // Australian Eastern (DST spans the new year)
+ *   The following methods are supported:
+ *      bool     valid()                        // True if the TZ string parsed
+ *      int32_t  offset(const Instant& utc)     // Seconds east of UTC in effect at utc
+ *      bool     isDST(const Instant& utc)      // True if daylight saving is in effect at utc
+ *      Instant  toLocal(const Instant& utc)    // Local time at utc
+ *      Instant  toUTC(const Instant& local)    // UTC of a local time, see below
+ *      int64_t  dstStart(int year)             // UTC seconds (NTP scale) daylight saving starts in year
+ *      int64_t  dstEnd(int year)               // UTC seconds (NTP scale) daylight saving ends in year
+ *
+ *   A local time inside the spring forward gap does not exist; toUTC() returns the instant daylight saving starts. A local
+ *   time inside the fall back overlap occurs twice; toUTC() returns the first (daylight) occurrence.
+ *
+ *   Instant::toDate() and toInstant() count years from 1900, so TimeZone carries its own constant time day number
+ *   conversions, daysFromCivil() and civilFromDays(), for use in tight loops such as cron evaluation.
+ */
+class TimeZone {
+  public:
+  TimeZone()                                                   {}
+  TimeZone(const char* posix)                                  {_valid = parse(posix);}
+  TimeZone(double hours)                                       {_std = Instant::tzOffset(hours);_dstOffset = _std;}
+
+  bool           valid()                       const           {return _valid;}
+  bool           hasDST()                      const           {return _hasDST;}
+  int32_t        standardOffset()              const           {return _std;}
+  int32_t        daylightOffset()              const           {return _dstOffset;}
+  int32_t        offset(const Instant& utc)    const           {return ((isDST(utc))?(_dstOffset):(_std));}
+  bool           isDST(const Instant& utc)     const;
+  Instant        toLocal(const Instant& utc)   const           {return utc + offset(utc);}
+  Instant        toUTC(const Instant& local)   const;
+  int64_t        dstStart(int year)            const           {return transition(year,_start,_std);}
+  int64_t        dstEnd(int year)              const           {return transition(year,_end,_dstOffset);}
+
+  static int64_t daysFromCivil(int y, int m, int d);                         // Days from Jan 1, 1900 to m/d/y
+  static void    civilFromDays(int64_t days, int& y, int& m, int& d);       // m/d/y of days from Jan 1, 1900
+  static int     weekday(int64_t days)                         {int w = (int)((days+1)%7);return ((w<0)?(w+7):(w));}  // 0 is Sunday
+  static int     yearOf(int64_t secs)                          {int y,m,d;civilFromDays(floorDiv(secs,SECS_IN_DAY),y,m,d);return y;}
+  static int64_t floorDiv(int64_t a, int64_t b)                {return ((a<0)?(-((-a+b-1)/b)):(a/b));}
+
+  private:
+  typedef struct Rule {
+    int          month = 3;
+    int          week  = 2;
+    int          day   = 0;
+    int32_t      time  = 7200;                                 // Local seconds after midnight
+  } Rule;
+
+  bool           parse(const char* s);
+  int64_t        transition(int year, const Rule& r, int32_t offset) const;
+
+  bool           _valid     = true;
+  bool           _hasDST    = false;
+  int32_t        _std       = 0;                               // Standard offset, seconds east of UTC
+  int32_t        _dstOffset = 0;                               // Daylight offset, seconds east of UTC
+  Rule           _start;
+  Rule           _end;
+};
+
+} // End of namespace lsc
+
+#endif
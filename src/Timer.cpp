@@ -22,16 +22,28 @@
  */
 
 #include "Timer.h"
+#include "Probes.h"
 
 /** Leelanau Software Company namespace 
 *  
 */
 namespace lsc {
 
-Timer::Timer( const Timer& t ) {
-  _millis   = t._millis;
-  _setPoint = t._setPoint;
-  _handler  = t._handler;
+Timer::Timer( Timer&& t ) {
+  *this = std::move(t);
+}
+
+Timer& Timer::operator=( Timer&& t ) {
+  _run         = t._run;
+  _pause       = t._pause;
+  _setPoint    = t._setPoint;
+  _stoppage    = t._stoppage;
+  _handler     = std::move(t._handler);
+  _periodic    = t._periodic;
+  _policy      = t._policy;
+  _missed      = t._missed;
+  _stats       = t._stats;
+  return *this;
 }
 
 /**
@@ -44,17 +56,61 @@ void Timer::setPoint(int& h, int& m, int& s) {
 }
 **/
 
+/**
+ *   doDevice() acts once millis() passes limit() (or pauseLimit()), so the next deadline is one millisecond past the limit.
+ */
+unsigned long Timer::remaining() {
+  if( started() ) return _run.remaining(LSC_MILLIS());
+  else if( paused() ) return _pause.remaining(LSC_MILLIS());
+  return TIMER_NO_DEADLINE;
+}
+
+/**
+ *   A Timer expires once millis() passes limit(). For a periodic Timer, deadlines fall at limit() + n*setPoint, so
+ *   the number of further deadlines already passed is (late-1)/setPoint. The next run starts one period before its
+ *   deadline, so elapsedTimeMillis() measures from the previous deadline.
+ */
 void Timer::doDevice() {
   if(started()) {
-    if((millis() > limit()) && (_handler!=NULL)) {
-      reset();
-      run();
+    unsigned long current = LSC_MILLIS();
+    if(_run.expired(current)) {
+      if(periodic()) {
+        unsigned long period = ((_setPoint>0)?(_setPoint):(1));
+        unsigned long late   = _run.overrun(current);
+        unsigned long steps  = 1;
+        _missed = (late-1)/period;
+        bool due = true;
+        if(_policy != MISSED_CATCH_UP) {
+          steps = _missed+1;
+          due   = ((_policy == MISSED_COALESCE) || (_missed == 0));
+        }
+        _run.startAt(_run.limit() + period*(steps-1),period);
+        if(due) dispatch(late);
+      }
+      else {
+        unsigned long late = _run.overrun(current);
+        reset();
+        dispatch(late);
+      }
     }
   }
   else if(paused()) {
-    if(millis() > pauseLimit()) cancelPause();
+    if(_pause.expired(LSC_MILLIS())) cancelPause();
   }
 }
 
+/**
+ *   The handler may restart, move, or clear this Timer, so the TimerStats are fetched before it runs.
+ */
+void Timer::dispatch(unsigned long late) {
+  TimerStats* stats = _stats;
+  LSC_PROBE(timer_fire,(void*)this,late);
+  if( stats == NULL ) {run();LSC_PROBE(timer_return,(void*)this);return;}
+  uint32_t start = (uint32_t)micros();
+  run();
+  LSC_PROBE(timer_return,(void*)this);
+  stats->record((uint32_t)late,(uint32_t)micros() - start);
+}
+
 } // End of namespace lsc
 
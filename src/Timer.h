@@ -26,19 +26,76 @@
 #include <Arduino.h>
 #include <ctype.h>
 #include <functional>
+#include "InplaceFunction.h"
+#include "Deadline.h"
+#include "Histogram.h"
+
+#ifndef TIMER_HANDLER_SIZE
+#define TIMER_HANDLER_SIZE INPLACE_FUNCTION_SIZE    // Bytes of capture a Timer handler may hold, define before including to change
+#endif
 
 typedef std::function<void(void)> TimerCallback;
 
+#define TIMER_NO_DEADLINE  (~0UL)           // Returned by remaining() when nothing is scheduled
+
 
 /** Leelanau Software Company namespace 
 *  
 */
 namespace lsc {
 
+/**
+ *   Timer handlers are stored inplace with no heap allocation. Any lambda or functor whose captures fit in TIMER_HANDLER_SIZE
+ *   bytes may be used directly, and a TimerCallback (std::function) still fits for compatibility. As before, NULL or an empty
+ *   TimerCallback sets a handler that does nothing.
+ */
+typedef InplaceFunction<void(void),TIMER_HANDLER_SIZE> TimerHandler;
+
+/**
+ *   Policy for a periodic timer when doDevice() is late by one or more whole periods:
+ *      MISSED_CATCH_UP  - Run the handler once for every missed period, on successive calls to doDevice()
+ *      MISSED_COALESCE  - Run the handler once for all missed periods
+ *      MISSED_SKIP      - Do not run the handler for a late expiry, wait for the next period
+ *   In every case the next deadline stays on the original schedule, start + n*period.
+ */
+enum MissedPolicy {MISSED_CATCH_UP, MISSED_COALESCE, MISSED_SKIP};
+
+/**
+ *   TimerStats records, for each handler run, its lateness (milliseconds from deadline to dispatch) and its runtime
+ *   (microseconds) in Histograms. Give each Timer its own TimerStats for per-timer figures, share one among several Timers
+ *   to aggregate them, or give per-timer TimerStats a parent to have both: every record is also made in the parent.
+ *   The following methods are supported:
+ *      Histogram&   lateness()                 // Milliseconds handlers ran past their deadline
+ *      Histogram&   runtime()                  // Microseconds handlers ran
+ *      void         record(uint32_t late, uint32_t micros)   // Record one run here and in the parent
+ *      void         reset()                    // Forget all runs recorded here
+ *
+ *   Example:
+ *      TimerStats all;
+ *      TimerStats reportStats(&all);
+ *      report.setStats(&reportStats);
+ *      Serial.printf("report p99 lateness %u ms, p99 runtime %u us\n",reportStats.lateness().percentile(99),reportStats.runtime().percentile(99));
+ */
+class TimerStats {
+  public:
+  TimerStats(TimerStats* parent = NULL) : _parent(parent) {}
+
+  Histogram&     lateness()                                    {return _lateness;}
+  Histogram&     runtime()                                     {return _runtime;}
+  void           record(uint32_t late, uint32_t micros)        {_lateness.record(late);_runtime.record(micros);if(_parent!=NULL) _parent->record(late,micros);}
+  void           reset()                                       {_lateness.reset();_runtime.reset();}
+
+  private:
+  Histogram      _lateness;
+  Histogram      _runtime;
+  TimerStats*    _parent;
+};
+
 /** Timer class
  *  Measure elapsed time or trigger a unit of work after some interval. The unit of work is performed by a handler function (TimerCallback)
  *  that executes once when the Timer's setPoint has expired. The unit of work can be made perpetual by calling Timer.start() from within
- *  the handler.
+ *  the handler, or by making the Timer periodic with setPeriodic(). A periodic Timer computes each deadline as the previous deadline plus
+ *  setPoint, so lateness in calling doDevice() does not accumulate as it does when start() is called from the handler.
  *  Once Timer is started it can be stopped and started again, or paused for a duration.
  *  The following methods are supported:
  *     void          start()                        // Start the Timer; if Timer is paused, pause is cancelled
@@ -51,14 +108,21 @@ namespace lsc {
  *     void          set(unsigned long millis)      // Set duration in milliseconds
  *     unsigned long elapsedTimeMillis()            // Elapsed time in milliseconds since last Timer start()
  *     unsigned long elapsedTimeSeconds()           // Elapsed time in seconds since last Timer start()
- *     void          setHandler(TimerCallback h)    // Set Timer callback handler
+ *     void          setHandler(TimerHandler h)     // Set Timer callback handler, NULL or an empty TimerCallback sets a handler that does nothing
  *     unsigned long setPointMillis()               // Return Timer duration in milliseconds
  *     unsigned long limit()                        // If Timer is started, returns point at which Timer expires in milliseconds, otherwise returns 0
  *     void          pause(unsigned long duration)  // Pause Timer for duration milliseconds; stops Timer until duration expires or start() is called
  *     void          cancelPause()                  // Cancel an active pause and start Timer
  *     bool          paused()                       // Return true if Timer is paused
  *     bool          pauseLimit()                   // If Timer is paused, returns point at which pause expires in milliseconds
+ *     unsigned long remaining()                    // Milliseconds until doDevice() has work to do, TIMER_NO_DEADLINE if stopped and not paused
+ *     void          setPeriodic(MissedPolicy p)    // Repeat every setPoint milliseconds without drift, handling missed periods by policy p
+ *     void          setOneShot()                   // Run the handler once per start() (default)
+ *     bool          periodic()                     // Returns true if Timer is periodic
+ *     unsigned long missed()                       // Whole periods missed at the most recent periodic expiry
  *     void          run()                          // Execute callback handler
+ *     void          setStats(TimerStats* s)        // Record lateness and runtime of each expiry in s, NULL to stop recording
+ *     TimerStats*   stats()                        // TimerStats set, NULL if none
  *     void          doDevice()                     // Called in Arduino loop() function to update internal counters, potentially calling callback
  *
  *  Example:
@@ -75,31 +139,42 @@ namespace lsc {
  *      1. Timer.doDevice() must be called from within the application loop.
  *      2. Timer.reset() is called prior to handler invocation so the handler will not be called
  *         again unless Timer.start() is called within the handler.
+ *      3. Timer handlers are move-only, so Timer can be moved but not copied.
+ *      4. Deadlines are tested on elapsed time (see Deadline), so Timers are unaffected by the 49.7 day millis() rollover
+ *         provided doDevice() or remaining() is called at least once per rollover.
  *
  */
 class Timer {
   public:
   Timer() {}
-  Timer( const Timer& t );
+  Timer( Timer&& t );
+  Timer& operator=( Timer&& t );
 
-  void          start()                        {if(stopped()) {_millis = millis();_pauseMillis=0;_pauseLimit=0;_limit=_millis+_stoppage;}} 
-  bool          started()                      {return _millis != 0;}
+  void          start()                        {if(stopped()) {_run.start(_stoppage);_pause.clear();}}
+  bool          started()                      {return _run.armed();}
   bool          stopped()                      {return !started();}
-  void          stop()                         {if(started()) {_millis=0;unsigned long current = millis();_stoppage=((current<_limit)?(_limit-current):(0));_limit=0;}}
-  void          reset()                        {_millis=0;_stoppage=_setPoint;_limit=0;_pauseLimit=0;_pauseMillis=0;}
+  void          stop()                         {if(started()) {unsigned long e = _run.elapsed(LSC_MILLIS());_stoppage=((e<_run.duration())?(_run.duration()-e):(0));_run.clear();}}
+  void          reset()                        {_run.clear();_stoppage=_setPoint;_pause.clear();}
   void          clear()                        {reset();_setPoint=0;_stoppage=0;}
   void          set(int h, int m, int s)       {h=((h<0)?(0):(h));m=((m<0)?(0):(m));s=((s<0)?(0):(s));_setPoint = 1000*s + 60000*m + 3600000*h;_stoppage=_setPoint;}
   void          set(unsigned long millis)      {_setPoint = millis;_stoppage = _setPoint;}
-  unsigned long elapsedTimeMillis()            {return((_millis>0)?(millis() - _millis):(0));}     // once timer starts, _millis > 0 and _millis < millis()
+  unsigned long elapsedTimeMillis()            {return((started())?(_run.elapsed(LSC_MILLIS())):(0));}
   unsigned long elapsedTimeSeconds()           {return elapsedTimeMillis()/1000;}
-  void          setHandler(TimerCallback h)    {if(h != NULL) _handler=h;else _handler=([]{});}
+  void          setHandler(TimerHandler h)     {_handler=std::move(h);}
   unsigned long setPointMillis()               {return _setPoint;}
-  unsigned long limit()                        {return _limit;}                                    // limit is 0 if not started
-  void          pause(unsigned long duration)  {if(!paused()) {stop();_pauseMillis=millis();_pauseLimit=_pauseMillis+duration;}}
+  unsigned long limit()                        {return((started())?(_run.limit()):(0));}           // limit is 0 if not started
+  void          pause(unsigned long duration)  {if(!paused()) {stop();_pause.start(duration);}}
   void          cancelPause()                  {if(paused()) start();}
-  bool          paused()                       {return _pauseMillis != 0;}
-  unsigned long pauseLimit()                   {return _pauseLimit;}
+  bool          paused()                       {return _pause.armed();}
+  unsigned long pauseLimit()                   {return((paused())?(_pause.limit()):(0));}
+  unsigned long remaining();
+  void          setPeriodic(MissedPolicy p = MISSED_COALESCE) {_periodic=true;_policy=p;}
+  void          setOneShot()                   {_periodic=false;}
+  bool          periodic()                     {return _periodic;}
+  unsigned long missed()                       {return _missed;}
   void          run()                          {_handler();}
+  void          setStats(TimerStats* s)        {_stats=s;}
+  TimerStats*   stats()                        {return _stats;}
   void          doDevice();
 
 /**
@@ -107,13 +182,17 @@ class Timer {
 **/
   
   private:
-  unsigned long      _millis      = 0;           // Millisecond timestamp of the Timer start
+  Deadline           _run;                       // Current run, from start (or previous periodic deadline) to limit
+  Deadline           _pause;                     // Current pause
   unsigned long      _setPoint    = 0;           // Millisecond duration set
-  unsigned long      _limit       = 0;           // Millisecond endpoint of Timer run
   unsigned long      _stoppage    = 0;           // Remaining milliseconds prior to start(), set at last stop()
-  unsigned long      _pauseMillis = 0;           // Millisecond timestamp at pause
-  unsigned long      _pauseLimit  = 0;           // Millisecond endpoint of pause
-  TimerCallback      _handler     = ([]{});      // Unit of work to be done when Timer expires
+  TimerHandler       _handler;                   // Unit of work to be done when Timer expires, empty does nothing
+  bool               _periodic    = false;       // Re-arm from the previous deadline on expiry
+  MissedPolicy       _policy      = MISSED_COALESCE;
+  unsigned long      _missed      = 0;           // Whole periods missed at last periodic expiry
+  TimerStats*        _stats       = NULL;        // Lateness and runtime of expiries, none recorded if NULL
+
+  void               dispatch(unsigned long late);               // run(), recording into _stats
 };
 
 
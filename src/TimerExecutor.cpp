@@ -0,0 +1,365 @@
+/**
+ *
+ *  SystemClock Library
+ *  Copyright (C) 2024  Daniel L Toth
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or any
+ *  later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *  The author can be contacted at dan@leelanausoftware.com
+ *
+ */
+
+#include "TimerExecutor.h"
+
+#if defined(__linux__) || defined(ESP32)
+
+#include <chrono>
+
+/** Leelanau Software Company namespace
+*
+*/
+namespace lsc {
+
+#define FREE_INDEX(h)   ((uint32_t)(h))
+#define FREE_TAG(h)     ((h)>>32)
+
+bool TimerExecutor::Deque::push(uint32_t job) {
+  int64_t b = _bottom.load(std::memory_order_relaxed);
+  int64_t t = _top.load(std::memory_order_acquire);
+  if( b - t >= EXECUTOR_QUEUE_SIZE ) return false;
+  _buffer[b&(EXECUTOR_QUEUE_SIZE-1)].store(job,std::memory_order_relaxed);
+  _bottom.store(b+1,std::memory_order_release);
+  return true;
+}
+
+bool TimerExecutor::Deque::pop(uint32_t& job) {
+  int64_t b = _bottom.load(std::memory_order_relaxed) - 1;
+  _bottom.store(b,std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  int64_t t = _top.load(std::memory_order_relaxed);
+  if( t > b ) {_bottom.store(b+1,std::memory_order_relaxed);return false;}
+  job = _buffer[b&(EXECUTOR_QUEUE_SIZE-1)].load(std::memory_order_relaxed);
+  if( t == b ) {                                                     // Last job, race thieves for it
+    bool won = _top.compare_exchange_strong(t,t+1,std::memory_order_seq_cst,std::memory_order_relaxed);
+    _bottom.store(b+1,std::memory_order_relaxed);
+    return won;
+  }
+  return true;
+}
+
+bool TimerExecutor::Deque::steal(uint32_t& job) {
+  int64_t t = _top.load(std::memory_order_acquire);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  int64_t b = _bottom.load(std::memory_order_acquire);
+  if( t >= b ) return false;
+  job = _buffer[t&(EXECUTOR_QUEUE_SIZE-1)].load(std::memory_order_relaxed);
+  return _top.compare_exchange_strong(t,t+1,std::memory_order_seq_cst,std::memory_order_relaxed);
+}
+
+TimerExecutor::TimerExecutor(unsigned workers, uint32_t capacity) : _service(capacity) {
+  _capacity    = ((capacity<1)?(1):(capacity));
+  _workerCount = ((workers<1)?(1):((workers>EXECUTOR_MAX_WORKERS)?(EXECUTOR_MAX_WORKERS):(workers)));
+  _service.reserve(_capacity);
+  _jobs        = new Job[_capacity];
+  for( uint32_t i=0; i<_capacity; i++ ) {
+    _jobs[i].refs.store(0);
+    _jobs[i].busy.store(false);
+    _jobs[i].generation.store(0);
+    _jobs[i].nextFree.store(((i+1<_capacity)?(i+1):(NIL)));
+  }
+  _free.store(0);
+  _workers     = new Worker[_workerCount];
+  for( unsigned i=0; i<_workerCount; i++ ) _workers[i].thread = std::thread(&TimerExecutor::workerLoop,this,i);
+  _timerThread = std::thread(&TimerExecutor::timerLoop,this);
+}
+
+/**
+ *   Jobs still queued when the executor is destroyed are not run.
+ */
+TimerExecutor::~TimerExecutor() {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stop.store(true);
+  }
+  _wake.notify_one();
+  {
+    std::lock_guard<std::mutex> lock(_roomMutex);
+    _room.notify_one();
+  }
+  _timerThread.join();
+  for( unsigned i=0; i<_workerCount; i++ ) {notify(_workers[i]);_workers[i].thread.join();}
+  delete[] _workers;
+  delete[] _jobs;
+}
+
+uint64_t TimerExecutor::executed() const {
+  uint64_t result = 0;
+  for( unsigned i=0; i<_workerCount; i++ ) result += _workers[i].executed.load(std::memory_order_relaxed);
+  return result;
+}
+
+/**
+ *   The wheel handler only captures the job index, so it fits in TimerHandler and dispatch never allocates. The timer
+ *   thread is woken only if the new deadline precedes the one it is sleeping until.
+ */
+TimerId TimerExecutor::add(unsigned long delay, unsigned long period, MissedPolicy p, unsigned long slack, TimerHandler& h) {
+  uint32_t job = allocate();
+  if( job == NIL ) return INVALID_TIMER;
+  Job& j     = _jobs[job];
+  j.handler  = std::move(h);
+  j.periodic = (period != 0);
+  j.busy.store(false,std::memory_order_relaxed);
+  j.refs.store(1,std::memory_order_release);
+  uint16_t generation = j.generation.load(std::memory_order_relaxed);
+
+  bool wake = false;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto thunk = [this,job]{dispatch(job);};
+    j.timer    = ((period==0)?(_service.schedule(delay,thunk,slack)):(_service.schedulePeriodic(period,thunk,p,slack)));
+    if( j.timer == INVALID_TIMER ) {release(job);return INVALID_TIMER;}
+    wake = _sleeping && (_forever || ((int32_t)(uint32_t)(_sleepUntil - (LSC_MILLIS()+delay)) > 0));
+  }
+  if( wake ) _wake.notify_one();
+  return ((TimerId)generation<<32) | job;
+}
+
+bool TimerExecutor::cancel(TimerId id) {
+  uint32_t job = (uint32_t)id;
+  if( job >= _capacity ) return false;
+  Job& j = _jobs[job];
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if( j.generation.load(std::memory_order_acquire) != (uint16_t)(id>>32) ) return false;
+    if( !_service.cancel(j.timer) ) return false;
+  }
+  release(job);
+  return true;
+}
+
+uint32_t TimerExecutor::allocate() {
+  uint64_t head = _free.load(std::memory_order_acquire);
+  while( FREE_INDEX(head) != NIL ) {
+    uint32_t job  = FREE_INDEX(head);
+    uint64_t next = ((FREE_TAG(head)+1)<<32) | _jobs[job].nextFree.load(std::memory_order_relaxed);
+    if( _free.compare_exchange_weak(head,next,std::memory_order_acquire,std::memory_order_acquire) ) return job;
+  }
+  return NIL;
+}
+
+void TimerExecutor::release(uint32_t job) {
+  Job& j = _jobs[job];
+  if( j.refs.fetch_sub(1,std::memory_order_acq_rel) != 1 ) return;
+  j.handler = nullptr;
+  j.generation.fetch_add(1,std::memory_order_release);
+  uint64_t head = _free.load(std::memory_order_relaxed);
+  do {j.nextFree.store(FREE_INDEX(head),std::memory_order_relaxed);}
+  while( !_free.compare_exchange_weak(head,((FREE_TAG(head)+1)<<32)|job,std::memory_order_release,std::memory_order_relaxed) );
+}
+
+/**
+ *   A one-shot job's wheel reference passes to the worker; a periodic job takes another reference, unless its previous
+ *   run is still in flight. Called from the wheel with _mutex held; if every inbox is full, _mutex is released while the
+ *   timer thread waits for room, just as a TimerService handler may itself schedule or cancel, so other threads are not
+ *   held up. Jobs that cannot be handed over because the executor is stopping are dropped.
+ *
+ *   A job handed to a worker that is running a handler wakes a sleeping peer to steal it. The seq_cst store of inTail and
+ *   load of running pair with the worker's store of running and load of inTail before it runs a handler, so either this
+ *   sees the worker running or the worker sees the job, and one of them wakes a peer.
+ */
+void TimerExecutor::dispatch(uint32_t job) {
+  Job& j = _jobs[job];
+  if( j.busy.exchange(true,std::memory_order_acq_rel) ) return;
+  if( j.periodic ) j.refs.fetch_add(1,std::memory_order_relaxed);
+  for( ;; ) {
+    unsigned target = choose();
+    if( target < _workerCount ) {
+      Worker&  w    = _workers[target];
+      uint32_t tail = w.inTail.load(std::memory_order_relaxed);
+      w.inbox[tail&(EXECUTOR_QUEUE_SIZE-1)].store(job,std::memory_order_relaxed);
+      w.inTail.store(tail+1,std::memory_order_seq_cst);
+      if( w.sleeping.load(std::memory_order_seq_cst) ) notify(w);
+      else if( w.running.load(std::memory_order_seq_cst) ) wakePeer(target);
+      return;
+    }
+    if( _stop.load() ) {j.busy.store(false,std::memory_order_release);release(job);return;}
+    _mutex.unlock();
+    {
+      std::unique_lock<std::mutex> lock(_roomMutex);
+      _blocked.store(true,std::memory_order_seq_cst);
+      _room.wait(lock,[this]{
+        if( _stop.load() ) return true;
+        for( unsigned i=0; i<_workerCount; i++ ) {
+          Worker& w = _workers[i];
+          if( w.inTail.load(std::memory_order_relaxed) - w.inHead.load(std::memory_order_seq_cst) < EXECUTOR_QUEUE_SIZE ) return true;
+        }
+        return false;
+      });
+      _blocked.store(false,std::memory_order_relaxed);
+    }
+    _mutex.lock();
+  }
+}
+
+/**
+ *   The first worker from _next that has nothing queued and is not running a handler, otherwise the one with the fewest
+ *   jobs queued or running. Only the timer thread writes an inbox, so a worker with room still has room when it is used.
+ */
+unsigned TimerExecutor::choose() {
+  unsigned best = _workerCount;
+  int64_t  load = INT64_MAX;
+  for( unsigned n=0; n<_workerCount; n++ ) {
+    unsigned i      = ((_next+n < _workerCount)?(_next+n):(_next+n-_workerCount));
+    Worker&  w      = _workers[i];
+    uint32_t queued = w.inTail.load(std::memory_order_relaxed) - w.inHead.load(std::memory_order_seq_cst);
+    if( queued >= EXECUTOR_QUEUE_SIZE ) continue;
+    int64_t  jobs   = queued + w.deque.size() + ((w.running.load(std::memory_order_relaxed))?(1):(0));
+    if( jobs < load ) {best = i;load = jobs;}
+    if( jobs <= 0 ) break;
+  }
+  if( best < _workerCount ) _next = ((best+1 < _workerCount)?(best+1):(0));
+  return best;
+}
+
+void TimerExecutor::run(uint32_t job) {
+  Job& j = _jobs[job];
+  j.handler();
+  j.busy.store(false,std::memory_order_release);
+  release(job);
+}
+
+void TimerExecutor::notify(Worker& w) {
+  std::lock_guard<std::mutex> lock(w.mutex);
+  w.wake.notify_one();
+}
+
+void TimerExecutor::timerLoop() {
+  std::unique_lock<std::mutex> lock(_mutex);
+  while( !_stop.load() ) {
+    _service.doDevice();
+    unsigned long wait = _service.remaining();
+    if( wait == 0 ) continue;
+    _sleeping   = true;
+    _forever    = (wait == TIMER_NO_DEADLINE);
+    if( _forever ) _wake.wait(lock);
+    else {
+      _sleepUntil = LSC_MILLIS() + wait;
+      _wake.wait_for(lock,std::chrono::milliseconds(wait));
+    }
+    _sleeping   = false;
+  }
+}
+
+/**
+ *   Move the inbox into the deque, then pop locally, steal from a peer's deque, or take from a peer's inbox. A worker
+ *   leaving jobs in its deque, or a thief leaving jobs in its victim's deque or inbox, wakes one sleeping peer to take
+ *   them, and each peer woken does the same, so sleepers are woken in a chain as far as there is work. Taking jobs from
+ *   an inbox wakes the timer thread if it is waiting for room.
+ */
+bool TimerExecutor::findWork(unsigned self, uint32_t& job) {
+  Worker& w    = _workers[self];
+  bool    took = false;
+  while( (w.deque.size() < EXECUTOR_QUEUE_SIZE) && claim(w,job) ) {w.deque.push(job);took = true;}
+  if( took ) drained();
+  if( w.deque.pop(job) ) {
+    if( w.deque.size() > 0 ) wakePeer(self);
+    return true;
+  }
+  for( unsigned i=1; i<_workerCount; i++ ) {
+    Worker& victim = _workers[(self+i)%_workerCount];
+    if( victim.deque.steal(job) ) {
+      if( victim.deque.size() > 0 ) wakePeer(self);
+      return true;
+    }
+  }
+  for( unsigned i=1; i<_workerCount; i++ ) {
+    Worker& victim = _workers[(self+i)%_workerCount];
+    if( claim(victim,job) ) {
+      drained();
+      if( victim.inHead.load(std::memory_order_relaxed) != victim.inTail.load(std::memory_order_acquire) ) wakePeer(self);
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ *   An inbox has one producer, the timer thread, and any number of consumers: its owner and thieves. The job is read
+ *   before the compare and exchange claims it, and the timer thread reuses the slot only after inHead has moved past it.
+ */
+bool TimerExecutor::claim(Worker& w, uint32_t& job) {
+  uint32_t head = w.inHead.load(std::memory_order_acquire);
+  while( head != w.inTail.load(std::memory_order_acquire) ) {
+    job = w.inbox[head&(EXECUTOR_QUEUE_SIZE-1)].load(std::memory_order_relaxed);
+    if( w.inHead.compare_exchange_weak(head,head+1,std::memory_order_seq_cst,std::memory_order_acquire) ) return true;
+  }
+  return false;
+}
+
+void TimerExecutor::drained() {
+  if( !_blocked.load(std::memory_order_seq_cst) ) return;
+  std::lock_guard<std::mutex> lock(_roomMutex);
+  _room.notify_one();
+}
+
+bool TimerExecutor::stealable(unsigned self) const {
+  for( unsigned i=1; i<_workerCount; i++ ) {
+    const Worker& peer = _workers[(self+i)%_workerCount];
+    if( (peer.deque.size() > 0) || (peer.inHead.load(std::memory_order_relaxed) != peer.inTail.load(std::memory_order_seq_cst)) ) return true;
+  }
+  return false;
+}
+
+/**
+ *   The seq_cst fence pairs with the one a worker makes between announcing it is sleeping and testing for work, so either
+ *   the sleeper sees the jobs left in the deque or this sees it sleeping.
+ */
+void TimerExecutor::wakePeer(unsigned self) {
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  for( unsigned i=1; i<_workerCount; i++ ) {
+    Worker& peer = _workers[(self+i)%_workerCount];
+    if( peer.sleeping.load(std::memory_order_seq_cst) ) {notify(peer);return;}
+  }
+}
+
+/**
+ *   A worker sleeps without a timeout until its inbox fills, a peer has a job to steal, or the executor stops. Jobs left
+ *   in its own inbox as it starts a handler are handed to a sleeping peer, which takes them from the inbox.
+ *   The test is made under the worker's mutex, which notify() takes, so a wake cannot fall between test and wait.
+ */
+void TimerExecutor::workerLoop(unsigned self) {
+  Worker& w = _workers[self];
+  uint32_t job;
+  while( !_stop.load(std::memory_order_relaxed) ) {
+    if( findWork(self,job) ) {
+      w.running.store(true,std::memory_order_seq_cst);
+      if( w.inHead.load(std::memory_order_relaxed) != w.inTail.load(std::memory_order_seq_cst) ) wakePeer(self);
+      run(job);
+      w.running.store(false,std::memory_order_release);
+      w.executed.fetch_add(1,std::memory_order_relaxed);
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(w.mutex);
+    w.sleeping.store(true,std::memory_order_seq_cst);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    w.wake.wait(lock,[&]{
+      return _stop.load() || (w.inHead.load(std::memory_order_relaxed) != w.inTail.load(std::memory_order_seq_cst)) || stealable(self);
+    });
+    w.sleeping.store(false,std::memory_order_relaxed);
+  }
+}
+
+} // End of namespace lsc
+
+#endif
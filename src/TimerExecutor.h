@@ -0,0 +1,173 @@
+
+/**
+ *
+ *  SystemClock Library
+ *  Copyright (C) 2024  Daniel L Toth
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or any
+ *  later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *  The author can be contacted at dan@leelanausoftware.com
+ *
+ */
+
+#ifndef TIMER_EXECUTOR_H
+#define TIMER_EXECUTOR_H
+
+#if defined(__linux__) || defined(ESP32)
+
+#include <Arduino.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include "TimerService.h"
+
+#define EXECUTOR_SIZE         1024                 // Default number of timers a TimerExecutor can hold
+#define EXECUTOR_MAX_WORKERS  16                   // Most worker threads a TimerExecutor runs
+#define EXECUTOR_QUEUE_BITS   10                   // log2 of the per-worker inbox and deque capacity
+#define EXECUTOR_QUEUE_SIZE   (1<<EXECUTOR_QUEUE_BITS)
+
+/** Leelanau Software Company namespace
+*
+*/
+namespace lsc {
+
+/**
+ *   TimerExecutor runs timer handlers on a pool of worker threads rather than inline in the thread calling doDevice(), so
+ *   a slow handler delays neither the wheel nor other handlers. Available where std::thread is (Linux and ESP32).
+ *   The following methods are supported:
+ *      TimerId   schedule(unsigned long delay, TimerHandler h, unsigned long slack)       // Run h once on a worker after delay
+ *      TimerId   schedulePeriodic(unsigned long period, TimerHandler h, MissedPolicy p, unsigned long slack)
+ *                                                                                     // Run h on a worker every period
+ *      bool      cancel(TimerId id)                                                   // Cancel a timer that has not been handed to a worker
+ *      unsigned  workers()                                                            // Number of worker threads
+ *      uint64_t  executed()                                                           // Handlers run by all workers
+ *
+ *   A timer thread owns a TimerService and sleeps on a condition variable for the wheel's remaining(), indefinitely when
+ *   no timer is scheduled. Schedule and cancel take the TimerService lock, which the timer thread holds only while
+ *   dispatching; a dispatch does no more than hand a job index to a worker. Each worker has a single producer inbox written
+ *   by the timer thread, which the worker moves into its own Chase-Lev work-stealing deque; other workers steal from the
+ *   top of that deque. A dispatch goes to a worker that is not running a handler if there is one, and to the least loaded
+ *   worker otherwise; the inbox of a worker running a handler may be emptied by its peers as well, so jobs are never left
+ *   queued behind a slow handler while another worker is free. Jobs live in a fixed pool with a tagged lock-free free
+ *   list, so neither dispatch nor completion allocates.
+ *
+ *   Nothing polls. An idle worker sleeps until its inbox fills or another worker leaves jobs in its deque or inbox to be
+ *   stolen, and is woken by that worker or the timer thread, so an executor with no timers due uses no CPU. If every inbox is full
+ *   the timer thread releases the TimerService lock and sleeps until a worker drains its inbox, so schedule() and cancel()
+ *   are not blocked behind a backlog.
+ *
+ *   A periodic handler never runs on two workers at once: a period that expires while the previous run is still queued or
+ *   running is skipped. The TimerId returned is the executor's own handle and is not valid with a TimerService.
+ *
+ *   Example:
+ *   TimerExecutor executor(4);
+ *   executor.schedulePeriodic(10,[]{pollSensors();});
+ *   executor.schedule(5000,[]{flushLog();});
+ */
+class TimerExecutor {
+  public:
+  TimerExecutor(unsigned workers = std::thread::hardware_concurrency(), uint32_t capacity = EXECUTOR_SIZE);
+  ~TimerExecutor();
+
+  TimerId        schedule(unsigned long delay, TimerHandler h, unsigned long slack = 0)  {return add(delay,0,MISSED_SKIP,slack,h);}
+  TimerId        schedulePeriodic(unsigned long period, TimerHandler h, MissedPolicy p = MISSED_SKIP, unsigned long slack = 0)
+                                                                                       {return add(period,((period<1)?(1):(period)),p,slack,h);}
+  bool           cancel(TimerId id);
+  unsigned       workers()                     const           {return _workerCount;}
+  uint64_t       executed()                    const;
+
+  private:
+  TimerExecutor(const TimerExecutor&)            = delete;
+  TimerExecutor& operator=(const TimerExecutor&) = delete;
+
+  static const uint32_t NIL = 0xFFFFFFFF;
+
+  typedef struct Job {
+    TimerHandler             handler;
+    TimerId                  timer;                            // TimerService handle, guarded by _mutex
+    bool                     periodic;
+    std::atomic<uint32_t>    refs;                             // One for the wheel, one per dispatch in flight
+    std::atomic<bool>        busy;                             // A dispatch is queued or running
+    std::atomic<uint16_t>    generation;                       // Advanced each time the job is released
+    std::atomic<uint32_t>    nextFree;                         // Next job on the free list
+  } Job;
+
+  /**
+   *   Chase-Lev deque over a fixed ring. The owning worker pushes and pops at the bottom, other workers steal from the top.
+   */
+  class Deque {
+    public:
+    bool          push(uint32_t job);
+    bool          pop(uint32_t& job);
+    bool          steal(uint32_t& job);
+    int64_t       size()                       const           {return _bottom.load(std::memory_order_relaxed)-_top.load(std::memory_order_relaxed);}
+
+    private:
+    alignas(64) std::atomic<int64_t>   _top{0};
+    alignas(64) std::atomic<int64_t>   _bottom{0};
+    std::atomic<uint32_t>              _buffer[EXECUTOR_QUEUE_SIZE];
+  };
+
+  typedef struct alignas(64) Worker {
+    alignas(64) std::atomic<uint32_t>  inHead{0};              // Next inbox slot the worker reads
+    alignas(64) std::atomic<uint32_t>  inTail{0};              // Next inbox slot the timer thread writes
+    std::atomic<uint32_t>              inbox[EXECUTOR_QUEUE_SIZE];
+    Deque                              deque;
+    std::atomic<bool>                  sleeping{false};
+    std::atomic<bool>                  running{false};         // A handler is running, so its inbox may be stolen
+    std::atomic<uint64_t>              executed{0};
+    std::mutex                         mutex;
+    std::condition_variable            wake;
+    std::thread                        thread;
+  } Worker;
+
+  TimerId        add(unsigned long delay, unsigned long period, MissedPolicy p, unsigned long slack, TimerHandler& h);
+  uint32_t       allocate();
+  void           release(uint32_t job);                        // Drop a reference, freeing the job on the last
+  void           dispatch(uint32_t job);                       // Hand a job to a worker, called on the timer thread
+  void           run(uint32_t job);
+  void           timerLoop();
+  void           workerLoop(unsigned self);
+  unsigned       choose();                                     // Worker for the next dispatch, or _workerCount if none has room
+  bool           findWork(unsigned self, uint32_t& job);
+  bool           claim(Worker& w, uint32_t& job);              // Take the oldest job in w's inbox
+  void           drained();                                    // Wake the timer thread if it is waiting for inbox room
+  bool           stealable(unsigned self)      const;          // True if a peer's deque or inbox holds a job
+  void           wakePeer(unsigned self);                      // Wake one sleeping worker other than self
+  void           notify(Worker& w);
+
+  TimerService             _service;
+  std::mutex               _mutex;                             // Guards _service
+  std::condition_variable  _wake;                              // Wakes the timer thread for an earlier deadline
+  unsigned long            _sleepUntil = 0;                    // millis() the timer thread is sleeping until
+  bool                     _sleeping   = false;
+  bool                     _forever    = false;                // The timer thread is sleeping with no deadline
+  std::mutex               _roomMutex;
+  std::condition_variable  _room;                              // Wakes the timer thread when an inbox has room
+  std::atomic<bool>        _blocked{false};                    // The timer thread is waiting for inbox room
+  std::atomic<bool>        _stop{false};
+  Job*                     _jobs;
+  uint32_t                 _capacity;
+  std::atomic<uint64_t>    _free{0};                           // Free list head index (low 32 bits) and ABA tag
+  Worker*                  _workers;
+  unsigned                 _workerCount;
+  unsigned                 _next       = 0;                    // Worker the next dispatch starts looking from
+  std::thread              _timerThread;
+};
+
+} // End of namespace lsc
+
+#endif
+#endif
@@ -0,0 +1,76 @@
+/**
+ *
+ *  SystemClock Library
+ *  Copyright (C) 2024  Daniel L Toth
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or any
+ *  later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *  The author can be contacted at dan@leelanausoftware.com
+ *
+ */
+
+#include "TimerFd.h"
+
+#ifdef __linux__
+
+#include <sys/timerfd.h>
+#include <poll.h>
+#include <unistd.h>
+
+/** Leelanau Software Company namespace
+*
+*/
+namespace lsc {
+
+TimerFd::TimerFd(TimerService& s) : _service(s) {
+  _fd = timerfd_create(CLOCK_MONOTONIC,TFD_NONBLOCK|TFD_CLOEXEC);
+}
+
+TimerFd::~TimerFd() {
+  if( _fd >= 0 ) close(_fd);
+}
+
+/**
+ *   A deadline already due is armed at 1 ns, since a zero it_value disarms the timerfd.
+ */
+void TimerFd::arm() {
+  if( _fd < 0 ) return;
+  unsigned long wait = _service.remaining();
+  struct itimerspec spec = {};
+  if( wait == 0 ) spec.it_value.tv_nsec = 1;
+  else if( wait != TIMER_NO_DEADLINE ) {
+    spec.it_value.tv_sec  = wait/1000;
+    spec.it_value.tv_nsec = (long)(wait%1000)*1000000L;
+  }
+  timerfd_settime(_fd,0,&spec,NULL);
+}
+
+void TimerFd::handleEvent() {
+  uint64_t expirations;
+  if( _fd >= 0 ) while( read(_fd,&expirations,sizeof(expirations)) > 0 ) {}
+  _service.doDevice();
+  arm();
+}
+
+bool TimerFd::wait(int timeout) {
+  if( _fd < 0 ) return false;
+  struct pollfd p = {_fd,POLLIN,0};
+  if( poll(&p,1,timeout) <= 0 ) return false;
+  handleEvent();
+  return true;
+}
+
+} // End of namespace lsc
+
+#endif
@@ -0,0 +1,94 @@
+
+/**
+ *
+ *  SystemClock Library
+ *  Copyright (C) 2024  Daniel L Toth
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or any
+ *  later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *  The author can be contacted at dan@leelanausoftware.com
+ *
+ */
+
+#ifndef TIMER_FD_H
+#define TIMER_FD_H
+
+#ifdef __linux__
+
+#include <Arduino.h>
+#include "TimerService.h"
+
+/** Leelanau Software Company namespace
+*
+*/
+namespace lsc {
+
+/**
+ *   TimerFd dispatches a TimerService, with the Timers and SystemClocks attached to it, from a single Linux timerfd armed
+ *   to the service's remaining(), so an application's epoll loop can wait on timers alongside sockets and use no CPU while
+ *   idle. Timers are dispatched by attaching them to the service (TimerService::attach()), which already polls them and
+ *   includes them in remaining(). A service holds at most TIMER_SERVICE_DEVICES (16) attached Timers, and as many
+ *   SystemClocks; attach() returns false beyond that. Build with -DTIMER_SERVICE_DEVICES=n to raise the limit, or
+ *   schedule the work on the service itself, which holds as many timers as its capacity.
+ *   The following methods are supported:
+ *      bool  valid()                      // True if the timerfd was created
+ *      int   fd()                         // File descriptor to register for EPOLLIN with epoll_ctl(), -1 if not valid
+ *      TimerService& service()            // The TimerService dispatched
+ *      void  arm()                        // Arm the timerfd to the service's remaining(), or disarm if there is no deadline
+ *      void  handleEvent()                // Call when fd() is readable: run the service's doDevice() and re-arm
+ *      bool  wait(int timeout)            // Without an epoll loop, wait up to timeout milliseconds (-1 forever) and handle the event
+ *
+ *   Deadlines are taken from remaining(), so the timerfd is armed relative to now on CLOCK_MONOTONIC, which neither NTP
+ *   steps of SystemClock nor changes to the system wall clock disturb. Timers scheduled, started, stopped, or set outside
+ *   of a handler do not notify TimerFd, so call arm() after changing them; handleEvent() re-arms after every dispatch.
+ *
+ *   Example:
+ *   TimerService service;
+ *   TimerFd      timers(service);
+ *   if( !service.attach(sampleTimer) ) Serial.printf("Too many Timers attached\n");
+ *   timers.arm();
+ *   epoll_event ev = {EPOLLIN,{.fd = timers.fd()}};
+ *   epoll_ctl(epfd,EPOLL_CTL_ADD,timers.fd(),&ev);
+ *   for(;;) {
+ *     int n = epoll_wait(epfd,events,MAX_EVENTS,-1);
+ *     for( int i=0; i<n; i++ ) {
+ *       if( events[i].data.fd == timers.fd() ) timers.handleEvent();
+ *       else ...
+ *     }
+ *   }
+ */
+class TimerFd {
+  public:
+  TimerFd(TimerService& s);
+  ~TimerFd();
+
+  bool          valid()                        const           {return _fd >= 0;}
+  int           fd()                           const           {return _fd;}
+  TimerService& service()                                      {return _service;}
+  void          arm();
+  void          handleEvent();
+  bool          wait(int timeout);
+
+  private:
+  TimerFd(const TimerFd&)            = delete;
+  TimerFd& operator=(const TimerFd&) = delete;
+
+  int           _fd;
+  TimerService& _service;
+};
+
+} // End of namespace lsc
+
+#endif
+#endif
@@ -0,0 +1,386 @@
+/**
+ *
+ *  SystemClock Library
+ *  Copyright (C) 2024  Daniel L Toth
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or any
+ *  later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *  The author can be contacted at dan@leelanausoftware.com
+ *
+ */
+
+#include <new>
+#include "TimerService.h"
+#include "Probes.h"
+
+/** Leelanau Software Company namespace
+*
+*/
+namespace lsc {
+
+#define SLOT_MASK             (TIMER_WHEEL_SLOTS-1)
+#define SLOT_LIST(l,s)        ((uint16_t)((l)*TIMER_WHEEL_SLOTS+(s)))
+
+TimerService::TimerService(uint32_t capacity) {
+  _capacity = ((capacity<NIL)?(capacity):(NIL-1));
+  _slabs    = new Slab*[(_capacity+TIMER_SLAB_SIZE-1)/TIMER_SLAB_SIZE];
+  _now      = (uint32_t)LSC_MILLIS();
+  for( int i=0; i<TIMER_WHEEL_LEVELS; i++ ) _occupied[i] = 0;
+  for( int i=0; i<LIST_COUNT; i++ ) _heads[i] = NIL;
+  for( int i=0; i<TIMER_PRIORITIES; i++ ) _tails[i] = NIL;
+  for( int i=0; i<TIMER_SERVICE_DEVICES; i++ ) {_timers[i] = NULL;_clocks[i] = NULL;}
+}
+
+TimerService::~TimerService() {
+  for( uint32_t i=0; i<_slabCount; i++ ) delete _slabs[i];
+  delete[] _slabs;
+}
+
+bool TimerService::reserve(uint32_t n) {
+  while( (_slabCount*TIMER_SLAB_SIZE < n) && (_slabCount*TIMER_SLAB_SIZE < _capacity) ) {
+    if( !grow() ) return false;
+  }
+  return true;
+}
+
+/**
+ *   A slab is linked onto the free list in reverse so entries are handed out in index order. Entries past capacity in the
+ *   last slab are never linked.
+ */
+bool TimerService::grow() {
+  if( _slabCount*TIMER_SLAB_SIZE >= _capacity ) return false;
+  Slab* slab = new (std::nothrow) Slab;
+  if( slab == NULL ) return false;
+  uint32_t first = _slabCount*TIMER_SLAB_SIZE;
+  uint32_t last  = first + TIMER_SLAB_SIZE;
+  if( last > _capacity ) last = _capacity;
+  _slabs[_slabCount++] = slab;
+  for( uint32_t i=last; i>first; i-- ) {
+    entry(i-1).generation = 0;
+    link(i-1,LIST_FREE);
+  }
+  return true;
+}
+
+TimerId TimerService::schedule(unsigned long delay, TimerHandler h, unsigned long slack, TimerPriority pri, TimerStats* s) {
+  return add(((delay<TIMER_MAX_DELAY)?(delay):(TIMER_MAX_DELAY)),0,MISSED_COALESCE,slack,pri,h,s);
+}
+
+TimerId TimerService::schedulePeriodic(unsigned long period, TimerHandler h, MissedPolicy p, unsigned long slack, TimerPriority pri, TimerStats* s) {
+  period = ((period<1)?(1):((period<TIMER_MAX_DELAY)?(period):(TIMER_MAX_DELAY)));
+  if( slack >= period ) slack = period-1;                                  // Slack of a period or more would read as missed periods
+  return add(period,period,p,slack,pri,h,s);
+}
+
+/**
+ *   Slack is kept as the power of two the deadline is rounded to, and delay is shortened if needed so the rounded
+ *   deadline stays within TIMER_MAX_DELAY.
+ */
+TimerId TimerService::add(uint32_t delay, uint32_t period, MissedPolicy p, unsigned long slack, TimerPriority pri, TimerHandler& h, TimerStats* s) {
+  if( (_heads[LIST_FREE] == NIL) && !grow() ) return INVALID_TIMER;
+  uint32_t idx  = _heads[LIST_FREE];
+  int      bits = ((slack>=(1UL<<TIMER_SLACK_BITS))?(TIMER_SLACK_BITS):(31 - __builtin_clz((uint32_t)slack+1)));
+  uint32_t mask = (1UL<<bits)-1;
+  unlink(idx);
+  Entry& e     = entry(idx);
+  e.deadline   = (uint32_t)LSC_MILLIS() + ((delay<TIMER_MAX_DELAY-mask)?(delay):(TIMER_MAX_DELAY-mask));
+  e.period     = period;
+  e.policy     = p;
+  e.slack      = bits;
+  handler(idx)  = std::move(h);
+  priority(idx) = ((pri<TIMER_PRIORITIES)?(pri):(TIMER_PRIORITY_LOW));
+  entryStats(idx) = s;
+  file(idx);
+  _size++;
+  return ((TimerId)e.generation<<32) | idx;
+}
+
+bool TimerService::cancel(TimerId id) {
+  if( !pending(id) ) return false;
+  uint32_t idx = (uint32_t)id;
+  unlink(idx);
+  handler(idx) = nullptr;
+  release(idx);
+  return true;
+}
+
+bool TimerService::pending(TimerId id) const {
+  uint32_t idx = (uint32_t)id;
+  if( idx >= _slabCount*TIMER_SLAB_SIZE ) return false;
+  const Entry& e = entry(idx);
+  return (e.generation == (uint16_t)(id>>32)) && (e.list < LIST_FREE);
+}
+
+void TimerService::release(uint32_t idx) {
+  entry(idx).generation++;
+  link(idx,LIST_FREE);
+  _size--;
+}
+
+/**
+ *   The wheel is brought up to date first, moving everything expired onto the ready lists, so the budget is spent on the
+ *   highest priority work whichever slot it expired in.
+ */
+void TimerService::doDevice() {
+  uint32_t target = (uint32_t)LSC_MILLIS();
+  _dispatch       = target;
+  expire(LIST_DUE);
+  uint32_t delta;
+  while( nextEvent(delta) && (delta <= target - _now) ) {
+    _now += delta;
+    cascade();
+    expire(SLOT_LIST(0,_now&SLOT_MASK));
+    expire(LIST_DUE);
+  }
+  _now = target;
+  fire();
+  for( int i=0; i<TIMER_SERVICE_DEVICES; i++ ) {
+    if( _timers[i] != NULL ) _timers[i]->doDevice();
+    if( _clocks[i] != NULL ) _clocks[i]->doDevice();
+  }
+}
+
+bool TimerService::attach(Timer& t) {
+  for( int i=0; i<TIMER_SERVICE_DEVICES; i++ ) if( _timers[i] == &t ) return true;
+  for( int i=0; i<TIMER_SERVICE_DEVICES; i++ ) if( _timers[i] == NULL ) {_timers[i] = &t;return true;}
+  return false;
+}
+
+bool TimerService::attach(SystemClock& c) {
+  for( int i=0; i<TIMER_SERVICE_DEVICES; i++ ) if( _clocks[i] == &c ) return true;
+  for( int i=0; i<TIMER_SERVICE_DEVICES; i++ ) if( _clocks[i] == NULL ) {_clocks[i] = &c;return true;}
+  return false;
+}
+
+void TimerService::detach(Timer& t) {
+  for( int i=0; i<TIMER_SERVICE_DEVICES; i++ ) if( _timers[i] == &t ) _timers[i] = NULL;
+}
+
+void TimerService::detach(SystemClock& c) {
+  for( int i=0; i<TIMER_SERVICE_DEVICES; i++ ) if( _clocks[i] == &c ) _clocks[i] = NULL;
+}
+
+/**
+ *   Earliest of the next occupied wheel slot and the deadlines of attached Timers and SystemClocks. Timers on LIST_DUE
+ *   or deferred on a ready list are dispatched on the next doDevice(), so remaining() is 0 while any are waiting.
+ */
+unsigned long TimerService::remaining() {
+  unsigned long result = TIMER_NO_DEADLINE;
+  uint32_t      delta;
+  if( (_heads[LIST_DUE] != NIL) || (ready() != NIL) ) return 0;
+  if( nextEvent(delta) ) {
+    uint32_t behind = (uint32_t)LSC_MILLIS() - _now;
+    result = ((delta>behind)?(delta-behind):(0));
+  }
+  for( int i=0; i<TIMER_SERVICE_DEVICES; i++ ) {
+    if( _timers[i] != NULL ) {unsigned long r = _timers[i]->remaining();if( r < result ) result = r;}
+    if( _clocks[i] != NULL ) {unsigned long r = _clocks[i]->remaining();if( r < result ) result = r;}
+  }
+  return result;
+}
+
+unsigned long TimerService::idle(unsigned long maxWait) {
+  unsigned long wait = remaining();
+  if( maxWait > TIMER_IDLE_MILLIS ) maxWait = TIMER_IDLE_MILLIS;
+  if( wait > maxWait ) wait = maxWait;
+  if( wait > 0 ) delay(wait);
+  return wait;
+}
+
+void TimerService::link(uint32_t idx, uint16_t list) {
+  Entry& e = entry(idx);
+  e.list   = list;
+  e.prev   = NIL;
+  e.next   = _heads[list];
+  if( e.next != NIL ) entry(e.next).prev = idx;
+  _heads[list] = idx;
+  if( list < LIST_DUE ) _occupied[list/TIMER_WHEEL_SLOTS] |= (1ULL << (list%TIMER_WHEEL_SLOTS));
+}
+
+void TimerService::append(uint32_t idx, uint16_t list) {
+  Entry&    e    = entry(idx);
+  uint32_t& tail = _tails[list-LIST_READY];
+  e.list = list;
+  e.next = NIL;
+  e.prev = tail;
+  if( tail != NIL ) entry(tail).next = idx;
+  else _heads[list] = idx;
+  tail   = idx;
+}
+
+void TimerService::unlink(uint32_t idx) {
+  Entry& e = entry(idx);
+  if( e.prev != NIL ) entry(e.prev).next = e.next;
+  else _heads[e.list] = e.next;
+  if( e.next != NIL ) entry(e.next).prev = e.prev;
+  else if( (e.list >= LIST_READY) && (e.list < LIST_FREE) ) _tails[e.list-LIST_READY] = e.prev;
+  if( (e.list < LIST_DUE) && (_heads[e.list] == NIL) ) _occupied[e.list/TIMER_WHEEL_SLOTS] &= ~(1ULL << (e.list%TIMER_WHEEL_SLOTS));
+  e.next = NIL;
+  e.prev = NIL;
+}
+
+/**
+ *   Level is the highest TIMER_WHEEL_BITS digit in which the rounded deadline and wheel time differ, and slot is the
+ *   deadline's digit at that level. Deadlines at or before wheel time go to LIST_DUE.
+ */
+void TimerService::file(uint32_t idx) {
+  Entry&   e     = entry(idx);
+  uint32_t when  = due(e);
+  uint32_t delta = when - _now;
+  if( (delta == 0) || (delta > TIMER_MAX_DELAY) ) {link(idx,LIST_DUE);return;}
+  uint32_t diff  = when ^ _now;
+  int      level = (31 - __builtin_clz(diff))/TIMER_WHEEL_BITS;
+  int      slot  = (when >> (level*TIMER_WHEEL_BITS)) & SLOT_MASK;
+  link(idx,SLOT_LIST(level,slot));
+}
+
+/**
+ *   When wheel time reaches the start of a slot at level L (all lower digits 0), entries in that slot are refiled against
+ *   the new wheel time, landing at a lower level or on LIST_DUE. Levels are processed top down so entries cascade through
+ *   several levels in one pass.
+ */
+void TimerService::cascade() {
+  for( int level=TIMER_WHEEL_LEVELS-1; level>0; level-- ) {
+    int shift = level*TIMER_WHEEL_BITS;
+    if( (_now & ((1UL<<shift)-1)) != 0 ) continue;
+    uint16_t list = SLOT_LIST(level,(_now>>shift)&SLOT_MASK);
+    uint32_t idx  = _heads[list];
+    while( idx != NIL ) {
+      uint32_t next = entry(idx).next;
+      unlink(idx);
+      file(idx);
+      idx = next;
+    }
+  }
+}
+
+void TimerService::expire(uint16_t list) {
+  uint32_t idx = _heads[list];
+  while( idx != NIL ) {
+    uint32_t next = entry(idx).next;
+    unlink(idx);
+    append(idx,LIST_READY+priority(idx));
+    idx = next;
+  }
+}
+
+uint32_t TimerService::ready() const {
+  for( int i=0; i<TIMER_PRIORITIES; i++ ) if( _heads[LIST_READY+i] != NIL ) return _heads[LIST_READY+i];
+  return NIL;
+}
+
+bool TimerService::spent(uint32_t fired, uint32_t start) const {
+  if( (_maxHandlers != 0) && (fired >= _maxHandlers) ) return true;
+  return (_maxMicros != 0) && ((uint32_t)micros() - start >= _maxMicros);
+}
+
+/**
+ *   One-shot entries are returned to the free list before their handler runs, so a handler may schedule new timers
+ *   (including itself) and may cancel timers that are still waiting on a ready list. Periodic entries are refiled at their
+ *   next deadline before their handler runs, and the handler is moved out for the call so it may cancel its own timer;
+ *   it is moved back only if the timer is still the same generation afterward. A periodic entry deferred by the budget
+ *   is rearmed against the doDevice() that finally runs it, so its missed periods are counted from then.
+ */
+void TimerService::fire() {
+  uint32_t idx;
+  uint32_t fired   = 0;
+  uint32_t rounded = 0;                                                 // Timers held past their deadline by slack
+  uint32_t start   = ((_maxMicros!=0)?((uint32_t)micros()):(0));
+  while( (idx = ready()) != NIL ) {
+    if( (fired > 0) && spent(fired,start) ) {_deferrals++;break;}
+    unlink(idx);
+    if( due(entry(idx)) != entry(idx).deadline ) rounded++;
+    uint32_t deadline = entry(idx).deadline;
+    if( entry(idx).period == 0 ) {
+      TimerHandler h = std::move(handler(idx));
+      TimerStats*  s = entryStats(idx);
+      release(idx);
+      fired++;
+      run(h,deadline,s);
+    }
+    else if( rearm(idx) ) {
+      uint16_t     generation = entry(idx).generation;
+      TimerHandler h          = std::move(handler(idx));
+      fired++;
+      run(h,deadline,entryStats(idx));
+      if( entry(idx).generation == generation ) handler(idx) = std::move(h);
+    }
+  }
+  if( fired == 0 ) return;
+  _expirations += fired;
+  _wakeups++;
+  _saved       += ((rounded<fired)?(rounded):(fired-1));
+}
+
+/**
+ *   Lateness is measured from the unrounded deadline, so it includes time held by slack and by the budget. Both TimerStats
+ *   are fetched before the handler runs, since it may call setStats() or cancel its own timer.
+ */
+void TimerService::run(TimerHandler& h, uint32_t deadline, TimerStats* s) {
+  TimerStats* stats = _stats;
+  LSC_PROBE(timer_fire,(void*)&h,(unsigned long)((uint32_t)LSC_MILLIS() - deadline));
+  if( (stats == NULL) && (s == NULL) ) {h();LSC_PROBE(timer_return,(void*)&h);return;}
+  uint32_t start = (uint32_t)micros();
+  uint32_t late  = (uint32_t)LSC_MILLIS() - deadline;
+  h();
+  LSC_PROBE(timer_return,(void*)&h);
+  uint32_t runtime = (uint32_t)micros() - start;
+  if( stats != NULL ) stats->record(late,runtime);
+  if( s != NULL ) s->record(late,runtime);
+}
+
+/**
+ *   Deadlines of a periodic timer fall at deadline + n*period. Periods whose deadline had also passed by the time of
+ *   dispatch are missed, and are either run one at a time (the next deadline is already due and goes to LIST_DUE), or
+ *   coalesced into this run, or skipped.
+ */
+bool TimerService::rearm(uint32_t idx) {
+  Entry&   e      = entry(idx);
+  uint32_t late   = _dispatch - e.deadline;
+  uint32_t missed = ((late<=TIMER_MAX_DELAY)?(late/e.period):(0));
+  bool     result = true;
+  if( e.policy == MISSED_CATCH_UP ) e.deadline += e.period;
+  else {
+    e.deadline += e.period*(missed+1);
+    result = ((e.policy == MISSED_COALESCE) || (missed == 0));
+  }
+  file(idx);
+  return result;
+}
+
+/**
+ *   For each level, the next occupied slot after wheel time's digit at that level gives a lower bound on the next
+ *   deadline filed there; at level 0 the bound is exact. An occupied slot behind wheel time's digit can only occur at
+ *   the top level, when a deadline lies across the 32-bit rollover, and belongs to the next rotation. LIST_DUE is not
+ *   considered, so a handler that reschedules itself with no delay runs at most once per doDevice().
+ */
+bool TimerService::nextEvent(uint32_t& delta) const {
+  bool found = false;
+  for( int level=0; level<TIMER_WHEEL_LEVELS; level++ ) {
+    uint64_t bits = _occupied[level];
+    if( bits == 0 ) continue;
+    int      shift    = level*TIMER_WHEEL_BITS;
+    int      digit    = (_now >> shift) & SLOT_MASK;
+    uint64_t ahead    = bits & ~((2ULL << digit) - 1);
+    uint64_t rotation = ((uint64_t)_now >> (shift+TIMER_WHEEL_BITS)) << (shift+TIMER_WHEEL_BITS);
+    uint64_t start;
+    if( ahead != 0 ) start = rotation + ((uint64_t)__builtin_ctzll(ahead) << shift);
+    else start = rotation + (1ULL << (shift+TIMER_WHEEL_BITS)) + ((uint64_t)__builtin_ctzll(bits) << shift);
+    uint32_t d = (uint32_t)(start - _now);
+    if( !found || (d < delta) ) {delta = d;found = true;}
+  }
+  return found;
+}
+
+} // End of namespace lsc
@@ -0,0 +1,258 @@
+
+/**
+ *
+ *  SystemClock Library
+ *  Copyright (C) 2024  Daniel L Toth
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or any
+ *  later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *  The author can be contacted at dan@leelanausoftware.com
+ *
+ */
+
+#ifndef TIMER_SERVICE_H
+#define TIMER_SERVICE_H
+
+#include <Arduino.h>
+#include "Timer.h"
+#include "SystemClock.h"
+
+#define TIMER_WHEEL_BITS     6                                          // log2 of slots per wheel level
+#define TIMER_WHEEL_SLOTS    (1<<TIMER_WHEEL_BITS)                      // Slots per wheel level
+#define TIMER_WHEEL_LEVELS   6                                          // Levels needed to cover 32-bit millisecond deadlines
+#define TIMER_SERVICE_SIZE   32                                         // Default number of timers a TimerService can hold
+#define TIMER_SLAB_BITS      8                                          // log2 of timers per slab
+#define TIMER_SLAB_SIZE      (1<<TIMER_SLAB_BITS)                       // Timers allocated at a time as the pool grows
+#define TIMER_MAX_DELAY      0x7FFFFFFFUL                               // Longest delay in milliseconds (about 24.8 days)
+#define INVALID_TIMER        0xFFFFFFFFFFFFFFFFULL                      // TimerId returned when a timer cannot be scheduled
+#ifndef TIMER_SERVICE_DEVICES
+#define TIMER_SERVICE_DEVICES 16                                        // Timers, and separately SystemClocks, that may be attached
+#endif
+#define TIMER_SLACK_BITS     15                                         // log2 of the coarsest slack rounding, about 33 seconds
+#define TIMER_PRIORITIES     4                                          // Number of TimerPriority levels
+#ifndef TIMER_IDLE_MILLIS
+#define TIMER_IDLE_MILLIS    1000                                       // Longest idle() sleep, may be set with a build flag
+#endif
+
+/** Leelanau Software Company namespace
+*
+*/
+namespace lsc {
+
+/**
+ *   TimerId is a handle to a timer in a TimerService, combining the timer's pool index (low 32 bits) with the 16-bit
+ *   generation of that pool entry (bits 32 to 47; the top 16 bits are zero). The generation advances each time the entry
+ *   is released, so a handle to a timer that has fired or been cancelled does not refer to a later timer occupying the
+ *   same entry until the generation wraps, after 65536 reuses.
+ */
+typedef uint64_t TimerId;
+
+/**
+ *   Order in which expired timers are dispatched by a TimerService. When a dispatch budget stops doDevice() early, timers
+ *   of lower priority are the ones deferred to the next call:
+ *      TIMER_PRIORITY_CRITICAL  - Run before any other expired timer
+ *      TIMER_PRIORITY_HIGH      - Run before normal work
+ *      TIMER_PRIORITY_NORMAL    - Default
+ *      TIMER_PRIORITY_LOW       - Housekeeping that may wait for a quiet iteration
+ *   Within a priority, timers run in order of expiry.
+ */
+enum TimerPriority {TIMER_PRIORITY_CRITICAL, TIMER_PRIORITY_HIGH, TIMER_PRIORITY_NORMAL, TIMER_PRIORITY_LOW};
+
+/** TimerService class
+ *  Owns a pool of one-shot and periodic timers and dispatches them from a hierarchical timing wheel, so scheduling, cancellation,
+ *  and expiry cost O(1) regardless of the number of timers pending. Compare to Timer, where every Timer must be polled
+ *  from loop() on every iteration.
+ *  The following methods are supported:
+ *     TimerId       schedule(unsigned long delay, TimerHandler h, unsigned long slack, TimerPriority pri, TimerStats* s)
+ *                                                                   // Run h once, delay to delay+slack milliseconds from now; INVALID_TIMER if full
+ *     TimerId       schedulePeriodic(unsigned long period, TimerHandler h, MissedPolicy p, unsigned long slack, TimerPriority pri, TimerStats* s)
+ *                                                                   // Run h every period milliseconds until cancelled, handling missed periods by p
+ *     bool          cancel(TimerId id)                              // Cancel a pending timer; returns false if it already fired
+ *     bool          pending(TimerId id)                             // True if the timer has not yet fired or been cancelled
+ *     uint32_t      size()                                          // Number of timers pending
+ *     uint32_t      capacity()                                      // Maximum number of timers pending
+ *     bool          reserve(uint32_t n)                             // Allocate pool storage for n timers up front
+ *     void          doDevice()                                      // Called in Arduino loop() function to dispatch expired timers
+ *     void          budget(uint32_t handlers, unsigned long micros) // Limit each doDevice() to handlers runs or micros microseconds, 0 for no limit
+ *     bool          attach(Timer& t)                                // Poll Timer t from doDevice() and include it in remaining(); false if full
+ *     bool          attach(SystemClock& c)                          // Poll SystemClock c from doDevice() and include its NTP sync in remaining(); false if full
+ *     void          detach(Timer& t)                                // Stop polling Timer t
+ *     void          detach(SystemClock& c)                          // Stop polling SystemClock c
+ *     unsigned long remaining()                                     // Milliseconds until doDevice() has work to do, TIMER_NO_DEADLINE if none
+ *     unsigned long idle(unsigned long maxWait)                     // delay() for remaining(), at most maxWait (TIMER_IDLE_MILLIS), and return milliseconds slept
+ *     uint32_t      expirations()                                   // Handlers run since the last resetCounts()
+ *     uint32_t      wakeups()                                       // Dispatches that ran at least one handler
+ *     uint32_t      wakeupsSaved()                                  // Estimated wakeups avoided by slack
+ *     uint32_t      deferrals()                                     // Dispatches stopped by the budget with handlers still waiting
+ *     void          setStats(TimerStats* s)                         // Record lateness and runtime of every handler run in s, NULL to stop
+ *     TimerStats*   stats()                                         // TimerStats set, NULL if none
+ *     void          resetCounts()                                   // Zero the counts above
+ *
+ *  The wheel has TIMER_WHEEL_LEVELS levels of TIMER_WHEEL_SLOTS slots, each level covering TIMER_WHEEL_BITS more bits of
+ *  the 32-bit millisecond clock. A timer is filed at the level of the highest bit in which its deadline differs from the
+ *  wheel's current time, and is moved down a level (cascaded) when the wheel reaches the start of its slot. Each level
+ *  keeps a 64-bit occupancy mask, so doDevice() jumps directly to the next occupied slot rather than stepping through
+ *  empty milliseconds. All deadline arithmetic is modular, so millis() rollover is handled naturally.
+ *
+ *  A periodic timer's next deadline is its previous deadline plus period, never the time its handler ran, so periodic
+ *  work does not drift; see MissedPolicy for handling of periods missed while the loop was busy.
+ *
+ *  A timer given slack may run up to slack milliseconds late, which lets nearly equal deadlines share one wakeup: its
+ *  deadline is rounded up to a multiple of the largest power of two not exceeding slack+1 (at most 2^TIMER_SLACK_BITS),
+ *  so timers from unrelated callers whose windows overlap land on the same millisecond. A periodic timer keeps its
+ *  unrounded deadlines, so slack never accumulates as drift. wakeupsSaved() counts, for each wakeup, the rounded timers
+ *  beyond the first that ran in it; it is an estimate, since rounded timers might have coincided anyway.
+ *
+ *  By default doDevice() runs every expired handler before returning, so a burst of expiries can hold up the rest of
+ *  loop(). budget() bounds each call: expired timers wait on one ready list per TimerPriority and are run highest
+ *  priority first, and once the handler count or elapsed time reaches the budget the rest are left for the next call,
+ *  with remaining() returning 0 so the loop does not sleep while work is waiting. The budget is checked between handlers,
+ *  so one long handler may overrun it, and at least one handler runs per call so deferred work always progresses.
+ *
+ *  Timers are held in a pool of 20-byte records, allocated TIMER_SLAB_SIZE at a time as the pool grows up to capacity(),
+ *  and linked into wheel slots by 32-bit index. Handlers are kept in a separate array within each slab, so walking and
+ *  cascading wheel slots touches only the compact records. Once storage is reserved, scheduling never allocates.
+ *
+ *  Each handler run is recorded in the TimerStats given to setStats(), if any, and in the TimerStats s given when the
+ *  timer was scheduled, if any, so one timer or a group of timers sharing s may be watched apart from the rest. Give s a
+ *  parent to aggregate groups, but not the service's own TimerStats, or its runs would be recorded there twice.
+ *
+ *  Since the wheel knows its next occupied slot, remaining() lets the application loop sleep instead of spinning: delay(),
+ *  light sleep, or an epoll_wait() timeout may be taken from it. For slots above the first level remaining() is the start
+ *  of the slot rather than the exact deadline, so the loop may wake a few times early while timers cascade down. idle()
+ *  never sleeps longer than TIMER_IDLE_MILLIS, even with nothing scheduled (remaining() is then TIMER_NO_DEADLINE), since
+ *  a delay() cannot be cut short by a timer scheduled or attached while it sleeps; a longer maxWait is shortened to it.
+ *
+ *  Example:
+ *  TimerService timers(128);
+ *  TimerId      retry = timers.schedule(5000,[]{
+ *                   Serial.printf("Retry\n");
+ *               });
+ *  ...
+ *  timers.cancel(retry);                     // Response arrived, cancel the retry
+ *
+ *  void loop() {
+ *    timers.doDevice();                      // Dispatch expired timers and poll attached Timers and SystemClocks
+ *    timers.idle(100);                       // Sleep until the next deadline, waking at least every 100 ms for other work
+ *  }
+ *
+ *  Note:
+ *     1. TimerService.doDevice() must be called from within the application loop.
+ *     2. Delays are limited to TIMER_MAX_DELAY milliseconds; longer delays are clamped.
+ *     3. Pool entries are reused once a timer fires or is cancelled, but its TimerId is not; the 16-bit generation kept
+ *        in each record repeats only after 65536 reuses of the same entry.
+ *
+ */
+class TimerService {
+  public:
+  TimerService(uint32_t capacity = TIMER_SERVICE_SIZE);
+  ~TimerService();
+
+  TimerId       schedule(unsigned long delay, TimerHandler h, unsigned long slack = 0, TimerPriority pri = TIMER_PRIORITY_NORMAL,
+                         TimerStats* s = NULL);
+  TimerId       schedulePeriodic(unsigned long period, TimerHandler h, MissedPolicy p = MISSED_COALESCE, unsigned long slack = 0,
+                                 TimerPriority pri = TIMER_PRIORITY_NORMAL, TimerStats* s = NULL);
+  bool          cancel(TimerId id);
+  bool          pending(TimerId id)                            const;
+  uint32_t      size()                                         const    {return _size;}
+  uint32_t      capacity()                                     const    {return _capacity;}
+  bool          reserve(uint32_t n);
+  void          doDevice();
+  void          budget(uint32_t handlers, unsigned long micros)         {_maxHandlers = handlers;_maxMicros = micros;}
+  bool          attach(Timer& t);
+  bool          attach(SystemClock& c);
+  void          detach(Timer& t);
+  void          detach(SystemClock& c);
+  unsigned long remaining();
+  unsigned long idle(unsigned long maxWait = TIMER_IDLE_MILLIS);
+  uint32_t      expirations()                                  const    {return _expirations;}
+  uint32_t      wakeups()                                      const    {return _wakeups;}
+  uint32_t      wakeupsSaved()                                 const    {return _saved;}
+  uint32_t      deferrals()                                    const    {return _deferrals;}
+  void          resetCounts()                                           {_expirations = 0;_wakeups = 0;_saved = 0;_deferrals = 0;}
+  void          setStats(TimerStats* s)                                 {_stats = s;}
+  TimerStats*   stats()                                        const    {return _stats;}
+
+  private:
+  TimerService(const TimerService&)            = delete;
+  TimerService& operator=(const TimerService&) = delete;
+
+  static const uint32_t NIL          = 0xFFFFFFFF;
+  static const uint16_t LIST_DUE     = TIMER_WHEEL_LEVELS*TIMER_WHEEL_SLOTS;     // Timers whose deadline has passed
+  static const uint16_t LIST_READY   = LIST_DUE+1;                               // Expired timers waiting to run, one list per TimerPriority
+  static const uint16_t LIST_FREE    = LIST_READY+TIMER_PRIORITIES;              // Unused entries
+  static const uint16_t LIST_COUNT   = LIST_FREE+1;
+
+  typedef struct Entry {
+    uint32_t       deadline;                                            // Millisecond deadline, before rounding for slack
+    uint32_t       next;                                                // Next entry on list
+    uint32_t       prev;                                                // Previous entry on list
+    uint32_t       period;                                              // Period in milliseconds, 0 for one-shot
+    uint16_t       list   : 10;                                         // List (wheel slot) holding this entry
+    uint16_t       policy : 2;                                          // MissedPolicy of a periodic timer
+    uint16_t       slack  : 4;                                          // Deadline is rounded up to a multiple of 2^slack
+    uint16_t       generation;                                          // Advanced each time the entry is released
+  } Entry;
+
+  typedef struct Slab {
+    Entry          entries[TIMER_SLAB_SIZE];
+    TimerHandler   handlers[TIMER_SLAB_SIZE];                           // Unit of work to be done when the timer expires
+    uint8_t        priorities[TIMER_SLAB_SIZE];                         // TimerPriority, read only as timers expire
+    TimerStats*    stats[TIMER_SLAB_SIZE];                              // TimerStats given at schedule time, NULL if none
+  } Slab;
+
+  Entry&        entry(uint32_t idx)                            const    {return _slabs[idx>>TIMER_SLAB_BITS]->entries[idx&(TIMER_SLAB_SIZE-1)];}
+  TimerHandler& handler(uint32_t idx)                          const    {return _slabs[idx>>TIMER_SLAB_BITS]->handlers[idx&(TIMER_SLAB_SIZE-1)];}
+  uint8_t&      priority(uint32_t idx)                         const    {return _slabs[idx>>TIMER_SLAB_BITS]->priorities[idx&(TIMER_SLAB_SIZE-1)];}
+  TimerStats*&  entryStats(uint32_t idx)                       const    {return _slabs[idx>>TIMER_SLAB_BITS]->stats[idx&(TIMER_SLAB_SIZE-1)];}
+  bool          grow();                                                 // Allocate one more slab
+  TimerId       add(uint32_t delay, uint32_t period, MissedPolicy p, unsigned long slack, TimerPriority pri, TimerHandler& h, TimerStats* s);
+  static uint32_t due(const Entry& e)                                   {uint32_t m = (1UL<<e.slack)-1;return (e.deadline+m) & ~m;}
+  bool          rearm(uint32_t idx);                                    // Advance a periodic deadline, true if its handler should run
+  void          release(uint32_t idx);                                  // Return entry to LIST_FREE
+  void          link(uint32_t idx, uint16_t list);
+  void          append(uint32_t idx, uint16_t list);                    // Link entry at the tail of a ready list
+  void          unlink(uint32_t idx);
+  void          file(uint32_t idx);                                     // Link entry into the wheel slot for its deadline
+  void          cascade();                                              // Move entries down a level at slot boundaries
+  void          expire(uint16_t list);                                  // Move list to the ready lists
+  uint32_t      ready()                                        const;   // First entry of the highest priority ready list, NIL if none
+  bool          spent(uint32_t fired, uint32_t start)          const;   // True once fired handlers since micros() start exhaust the budget
+  void          fire();                                                 // Dispatch ready lists as one wakeup, within the budget
+  void          run(TimerHandler& h, uint32_t deadline, TimerStats* s); // Call h, recording into _stats and s
+  bool          nextEvent(uint32_t& delta)                     const;   // Milliseconds from _now to the next occupied slot
+
+  Slab**        _slabs;
+  uint32_t      _slabCount = 0;                                         // Slabs allocated
+  uint32_t      _capacity;
+  uint32_t      _size      = 0;
+  uint32_t      _now;                                                   // Wheel time in milliseconds
+  uint32_t      _dispatch;                                              // millis() at the current doDevice()
+  uint64_t      _occupied[TIMER_WHEEL_LEVELS];                          // Non-empty slots per level
+  uint32_t      _heads[LIST_COUNT];                                     // List heads
+  uint32_t      _tails[TIMER_PRIORITIES];                               // Ready list tails, so expiry order is kept
+  uint32_t      _maxHandlers = 0;                                       // Handlers per doDevice(), 0 for no limit
+  unsigned long _maxMicros   = 0;                                       // Microseconds per doDevice(), 0 for no limit
+  Timer*        _timers[TIMER_SERVICE_DEVICES];                         // Attached Timers
+  SystemClock*  _clocks[TIMER_SERVICE_DEVICES];                         // Attached SystemClocks
+  uint32_t      _expirations = 0;                                       // Handlers run
+  uint32_t      _wakeups     = 0;                                       // fire() calls that ran a handler
+  uint32_t      _saved       = 0;                                       // Wakeups avoided by slack
+  uint32_t      _deferrals   = 0;                                       // fire() calls stopped by the budget
+  TimerStats*   _stats       = NULL;                                    // Lateness and runtime of handlers, none recorded if NULL
+};
+
+} // End of namespace lsc
+
+#endif
@@ -29,8 +29,8 @@
 namespace lsc {
 
 Timestamp Timestamp::update() {
-  unsigned long currentMillis  = millis();
-  unsigned long elapsedMillis  = currentMillis - _millis;
+  unsigned long currentMillis  = LSC_MILLIS();
+  uint32_t      elapsedMillis  = (uint32_t)(currentMillis - _millis);
   _millis                      = currentMillis;  
   _ntpTime.addMillis(elapsedMillis);
   return *this;
@@ -25,6 +25,7 @@
 #define TIMESTAMP_H
 
 #include "Instant.h"
+#include "Ticks.h"
 
 /**
  *  Timestamp class joins a sysTime Instant with a device millisecond timestamp. Updating the Timestamp folds milliseconds into the Instant, 
@@ -46,7 +47,7 @@ class Timestamp {
   Instant           ntpTime()     const                              {return _ntpTime;}         // Return Instant that this Timestamp refers to
   unsigned long     getMillis()   const                              {return _millis;}          // Return millis since last update
   unsigned long     getStamp()    const                              {return _stamp;}           // Return millisecond timestamp of creation
-  void              initialize(const Instant& sysTime)               {_ntpTime = sysTime; _millis = millis();_stamp = _millis;}
+  void              initialize(const Instant& sysTime)               {_ntpTime = sysTime; _millis = LSC_MILLIS();_stamp = _millis;}
   Timestamp         update();                                        // Update ntpTime to current milliseconds
 
 /**
@@ -0,0 +1,246 @@
+/**
+ *
+ *  SystemClock Library
+ *  Copyright (C) 2024  Daniel L Toth
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or any
+ *  later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *  The author can be contacted at dan@leelanausoftware.com
+ *
+ */
+
+#include <new>
+#include <string.h>
+#include "TraceBuffer.h"
+
+/** Leelanau Software Company namespace
+*
+*/
+namespace lsc {
+
+#define TRACE_RING_MASK       (TRACE_RING_SIZE-1)
+
+std::atomic<const char*>  TraceBuffer::_names[TRACE_EVENTS] = {};
+std::atomic<TraceBuffer::Ring*> TraceBuffer::_rings{NULL};
+std::atomic<uint16_t>     TraceBuffer::_ringCount{0};
+std::atomic<uint64_t>     TraceBuffer::_anchorTicks[TRACE_SYNCS] = {};
+std::atomic<int64_t>      TraceBuffer::_anchorSecs[TRACE_SYNCS] = {};
+std::atomic<uint32_t>     TraceBuffer::_anchorFractions[TRACE_SYNCS] = {};
+std::atomic<uint32_t>     TraceBuffer::_anchorsClaimed{0};
+std::atomic<uint32_t>     TraceBuffer::_anchors{0};
+unsigned int              TraceBuffer::_syncs = 0;
+
+/**
+ *   Holds this thread's Ring and gives it up when the thread exits.
+ */
+class TraceOwner {
+  public:
+  ~TraceOwner()                                                {if( ring != NULL ) ring->owned.store(false,std::memory_order_release);}
+  TraceBuffer::Ring* ring = NULL;
+};
+
+static thread_local TraceOwner traceOwner;
+
+/**
+ *   Print that fills a buffer, counting the bytes that did not fit.
+ */
+class TraceBufferPrint : public Print {
+  public:
+  TraceBufferPrint(uint8_t* buf, size_t len) : _buf(buf), _len(len) {}
+  size_t         write(uint8_t c)                              {if( _pos < _len ) _buf[_pos] = c;_pos++;return 1;}
+  size_t         write(const uint8_t* b, size_t n)             {for( size_t i=0; i<n; i++ ) write(b[i]);return n;}
+  size_t         size()                        const           {return _pos;}
+
+  private:
+  uint8_t*       _buf;
+  size_t         _len;
+  size_t         _pos = 0;
+};
+
+static void put(Print& out, uint64_t v, int bytes) {
+  uint8_t b[8];
+  for( int i=0; i<bytes; i++ ) {b[i] = (uint8_t)v;v >>= 8;}
+  out.write(b,bytes);
+}
+
+int TraceBuffer::event(const char* name) {
+  for( int i=0; i<TRACE_EVENTS; i++ ) {
+    const char* n = _names[i].load(std::memory_order_acquire);
+    if( n == NULL ) {
+      if( _names[i].compare_exchange_strong(n,name,std::memory_order_acq_rel) ) return i;
+    }
+    if( strcmp(n,name) == 0 ) return i;
+  }
+  return -1;
+}
+
+TraceBuffer::Ring* TraceBuffer::ring() {
+  if( traceOwner.ring == NULL ) traceOwner.ring = claim();
+  return traceOwner.ring;
+}
+
+TraceBuffer::Ring* TraceBuffer::claim() {
+  for( Ring* r = _rings.load(std::memory_order_acquire); r != NULL; r = r->next ) {
+    bool owned = false;
+    if( !r->owned.load(std::memory_order_relaxed) && r->owned.compare_exchange_strong(owned,true,std::memory_order_acquire) ) return r;
+  }
+  Ring* r = new (std::nothrow) Ring;
+  if( r == NULL ) return NULL;
+  for( int i=0; i<TRACE_RING_SIZE; i++ ) {r->ticks[i].store(0,std::memory_order_relaxed);r->words[i].store(0,std::memory_order_relaxed);}
+  r->claimed.store(0,std::memory_order_relaxed);
+  r->committed.store(0,std::memory_order_relaxed);
+  r->owned.store(true,std::memory_order_relaxed);
+  r->thread = _ringCount.fetch_add(1,std::memory_order_relaxed);
+  r->next   = _rings.load(std::memory_order_relaxed);
+  while( !_rings.compare_exchange_weak(r->next,r,std::memory_order_release,std::memory_order_relaxed) ) {}
+  return r;
+}
+
+/**
+ *   The claim is made visible before the slot is overwritten, so a reader that sees any part of the new event also sees
+ *   the claim and drops the slot.
+ */
+void TraceBuffer::record(int id, uint32_t arg) {
+  if( (id < 0) || (id >= TRACE_EVENTS) ) return;
+  Ring* r = ring();
+  if( r == NULL ) return;
+  uint32_t i    = r->claimed.load(std::memory_order_relaxed);
+  uint32_t slot = i & TRACE_RING_MASK;
+  r->claimed.store(i+1,std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  r->ticks[slot].store(monotonicMicros(),std::memory_order_relaxed);
+  r->words[slot].store(((uint64_t)arg<<32) | (uint16_t)id,std::memory_order_relaxed);
+  r->committed.store(i+1,std::memory_order_release);
+}
+
+/**
+ *   Counters are modular, so a ring that has wrapped 2^32 events is read as holding end & TRACE_RING_MASK events until it
+ *   fills again; in practice only the oldest few events of a very busy thread are affected.
+ */
+uint32_t TraceBuffer::copy(Ring* r, TraceEvent* out, uint32_t max) {
+  uint32_t end   = r->committed.load(std::memory_order_acquire);
+  uint32_t count = ((end<TRACE_RING_SIZE)?(end):(TRACE_RING_SIZE));
+  if( count > max ) count = max;
+  for( uint32_t k=0; k<count; k++ ) {
+    uint32_t slot = (end - count + k) & TRACE_RING_MASK;
+    uint64_t word = r->words[slot].load(std::memory_order_relaxed);
+    out[k].tick   = r->ticks[slot].load(std::memory_order_relaxed);
+    out[k].event  = (uint16_t)word;
+    out[k].thread = r->thread;
+    out[k].arg    = (uint32_t)(word>>32);
+  }
+  std::atomic_thread_fence(std::memory_order_acquire);
+  uint32_t claimed = r->claimed.load(std::memory_order_relaxed);
+  uint32_t lapped  = 0;                                                 // Leading events overwritten during the copy
+  while( (lapped < count) && (claimed - (end - count + lapped) > TRACE_RING_SIZE) ) lapped++;
+  if( lapped > 0 ) memmove(out,out+lapped,(count-lapped)*sizeof(TraceEvent));
+  return count - lapped;
+}
+
+void TraceBuffer::sync(SystemClock& c) {
+  unsigned int syncs = c.syncCount();
+  if( syncs == _syncs ) return;
+  _syncs = syncs;
+  anchor(TickAnchor(c.peekTime()));
+}
+
+void TraceBuffer::anchor(const TickAnchor& a) {
+  uint32_t i    = _anchorsClaimed.load(std::memory_order_relaxed);
+  uint32_t slot = i % TRACE_SYNCS;
+  _anchorsClaimed.store(i+1,std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  _anchorTicks[slot].store(a.tick(),std::memory_order_relaxed);
+  _anchorSecs[slot].store(a.utc().secs(),std::memory_order_relaxed);
+  _anchorFractions[slot].store(a.utc().fraction(),std::memory_order_relaxed);
+  _anchors.store(i+1,std::memory_order_release);
+}
+
+size_t TraceBuffer::snapshotSize() {
+  size_t result = TRACE_HEADER_BYTES + TRACE_SYNCS*TRACE_ANCHOR_BYTES;
+  for( int i=0; i<TRACE_EVENTS; i++ ) {
+    const char* n = name(i);
+    if( n == NULL ) break;
+    size_t len = strlen(n);
+    result += 3 + ((len<255)?(len):(255));
+  }
+  for( Ring* r = _rings.load(std::memory_order_acquire); r != NULL; r = r->next ) result += 4 + TRACE_RING_SIZE*TRACE_EVENT_BYTES;
+  return result;
+}
+
+size_t TraceBuffer::snapshot(uint8_t* buf, size_t len) {
+  TraceBufferPrint out(buf,len);
+  write(out);
+  return out.size();
+}
+
+/**
+ *   Rings linked after the list head is read are left out, so the ring count in the header always matches.
+ */
+void TraceBuffer::write(Print& out) {
+  TraceEvent* events = new (std::nothrow) TraceEvent[TRACE_RING_SIZE];
+  if( events == NULL ) return;
+  Ring*    head  = _rings.load(std::memory_order_acquire);
+  uint16_t rings = 0;
+  uint16_t names = 0;
+  for( Ring* r = head; r != NULL; r = r->next ) rings++;
+  while( (names < TRACE_EVENTS) && (name(names) != NULL) ) names++;
+
+  uint64_t ticks[TRACE_SYNCS];
+  int64_t  secs[TRACE_SYNCS];
+  uint32_t fractions[TRACE_SYNCS];
+  uint32_t end     = _anchors.load(std::memory_order_acquire);
+  uint32_t anchors = ((end<TRACE_SYNCS)?(end):(TRACE_SYNCS));
+  for( uint32_t k=0; k<anchors; k++ ) {
+    uint32_t slot = (end - anchors + k) % TRACE_SYNCS;
+    ticks[k]      = _anchorTicks[slot].load(std::memory_order_relaxed);
+    secs[k]       = _anchorSecs[slot].load(std::memory_order_relaxed);
+    fractions[k]  = _anchorFractions[slot].load(std::memory_order_relaxed);
+  }
+  std::atomic_thread_fence(std::memory_order_acquire);
+  uint32_t claimed = _anchorsClaimed.load(std::memory_order_relaxed);
+  uint32_t first   = 0;
+  while( (first < anchors) && (claimed - (end - anchors + first) > TRACE_SYNCS) ) first++;
+
+  put(out,TRACE_MAGIC,4);
+  put(out,TRACE_VERSION,2);
+  put(out,names,2);
+  put(out,anchors-first,2);
+  put(out,rings,2);
+  for( uint16_t i=0; i<names; i++ ) {
+    const char* n   = name(i);
+    size_t      len = strlen(n);
+    if( len > 255 ) len = 255;
+    put(out,i,2);
+    put(out,len,1);
+    out.write((const uint8_t*)n,len);
+  }
+  for( uint32_t k=first; k<anchors; k++ ) {
+    put(out,ticks[k],8);
+    put(out,(uint64_t)secs[k],8);
+    put(out,fractions[k],4);
+  }
+  for( Ring* r = head; r != NULL; r = r->next ) {
+    uint32_t count = copy(r,events,TRACE_RING_SIZE);
+    put(out,count,4);
+    for( uint32_t k=0; k<count; k++ ) {
+      put(out,events[k].tick,8);
+      put(out,events[k].event,2);
+      put(out,events[k].thread,2);
+      put(out,events[k].arg,4);
+    }
+  }
+  delete[] events;
+}
+
+} // End of namespace lsc
@@ -0,0 +1,124 @@
+
+/**
+ *
+ *  SystemClock Library
+ *  Copyright (C) 2024  Daniel L Toth
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or any
+ *  later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *  The author can be contacted at dan@leelanausoftware.com
+ *
+ */
+
+#ifndef TRACE_BUFFER_H
+#define TRACE_BUFFER_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "Ticks.h"
+#include "SystemClock.h"
+#include "TraceFormat.h"
+
+#define TRACE_RING_BITS      8                                          // log2 of events kept per thread
+#define TRACE_RING_SIZE      (1<<TRACE_RING_BITS)
+#define TRACE_SYNCS          16                                         // Clock synchronizations kept for converting ticks to UTC
+
+/**
+ *   Record the named event with a 32-bit argument in this thread's ring. The name is registered once, on first use at each site.
+ */
+#define LSC_TRACE(name,arg)                                                                               \
+  do {static const int _lscEvent = lsc::TraceBuffer::event(name);lsc::TraceBuffer::record(_lscEvent,(uint32_t)(arg));} while(0)
+
+/** Leelanau Software Company namespace
+*
+*/
+namespace lsc {
+
+/**
+ *   TraceBuffer is a flight recorder. Each thread records into its own ring of the last TRACE_RING_SIZE events, so
+ *   recording is a few relaxed stores with no lock and no contention, and the newest events are always kept. Events carry
+ *   raw monotonic ticks and are converted to UTC only when decoded, using a history of TickAnchors taken each time the
+ *   SystemClock synchronized, so a step of the clock between two events is attributed to the right side of the step.
+ *   The following methods are supported:
+ *      static int          event(const char* name)        // Register name (or find it), returning its id, -1 if TRACE_EVENTS are in use
+ *      static const char*  name(int id)                   // Name of event id
+ *      static void         record(int id, uint32_t arg)   // Add an event to this thread's ring
+ *      static void         sync(SystemClock& c)           // Add an anchor if c has synchronized since the last call; call from loop()
+ *      static void         anchor(const TickAnchor& a)    // Add an anchor directly
+ *      static size_t       snapshotSize()                 // Upper bound on the bytes in a snapshot
+ *      static size_t       snapshot(uint8_t* buf, size_t len)   // Copy a snapshot to buf, returning its bytes, more than len if truncated
+ *      static void         write(Print& out)              // Write a snapshot to out, e.g. a File or a WiFiClient, one ring at a time
+ *
+ *   sync() and anchor() are made from one thread, normally the loop. A snapshot may be taken while other threads record. Each ring is copied between two reads of its counters, and
+ *   events that may have been overwritten during the copy are dropped, so a snapshot never holds a torn event.
+ *
+ *   The snapshot is a compact little endian binary stream, laid out in TraceFormat.h and decoded with TraceDecoder on the
+ *   device or, with extras/TraceDecoder, on a host.
+ *
+ *   Example:
+ *   LSC_TRACE("ntp.request",seq);
+ *   ...
+ *   void loop() {
+ *     sysClock.doDevice();
+ *     TraceBuffer::sync(sysClock);
+ *   }
+ *   ...
+ *   TraceBuffer::write(file);                             // On a fault, keep the last moments for post-mortem
+ */
+class TraceBuffer {
+  public:
+  static int          event(const char* name);
+  static const char*  name(int id)                             {return (((id<0)||(id>=TRACE_EVENTS))?(NULL):(_names[id].load(std::memory_order_acquire)));}
+  static void         record(int id, uint32_t arg);
+  static void         sync(SystemClock& c);
+  static void         anchor(const TickAnchor& a);
+  static size_t       snapshotSize();
+  static size_t       snapshot(uint8_t* buf, size_t len);
+  static void         write(Print& out);
+
+  private:
+
+/**
+ *   One thread's ring. The owner claims an index in _claimed, writes the slot, then publishes it in _committed; a
+ *   reader copies up to _committed and then drops slots _claimed has since lapped.
+ */
+  typedef struct Ring {
+    std::atomic<uint64_t>    ticks[TRACE_RING_SIZE];
+    std::atomic<uint64_t>    words[TRACE_RING_SIZE];                    // [arg u32][0 u16][event u16]
+    std::atomic<uint32_t>    claimed;
+    std::atomic<uint32_t>    committed;
+    std::atomic<bool>        owned;                                     // Held by a running thread
+    uint16_t                 thread;                                    // Ring number, recorded in each event
+    Ring*                    next;
+  } Ring;
+
+  friend class TraceOwner;
+  static Ring*        ring();                                           // This thread's Ring
+  static Ring*        claim();                                          // Reuse an unowned Ring or link a new one
+  static uint32_t     copy(Ring* r, TraceEvent* out, uint32_t max);     // Consistent copy of a ring's events, oldest first
+
+  static std::atomic<const char*>  _names[TRACE_EVENTS];
+  static std::atomic<Ring*>        _rings;                              // Every Ring, newest first
+  static std::atomic<uint16_t>     _ringCount;
+  static std::atomic<uint64_t>     _anchorTicks[TRACE_SYNCS];
+  static std::atomic<int64_t>      _anchorSecs[TRACE_SYNCS];
+  static std::atomic<uint32_t>     _anchorFractions[TRACE_SYNCS];
+  static std::atomic<uint32_t>     _anchorsClaimed;                     // Anchors begun, ahead of _anchors while one is written
+  static std::atomic<uint32_t>     _anchors;                            // Anchors ever added
+  static unsigned int              _syncs;                              // syncCount() at the last sync()
+};
+
+} // End of namespace lsc
+
+#endif
@@ -0,0 +1,212 @@
+/**
+ *
+ *  SystemClock Library
+ *  Copyright (C) 2024  Daniel L Toth
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or any
+ *  later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *  The author can be contacted at dan@leelanausoftware.com
+ *
+ */
+
+#include <new>
+#include <stdio.h>
+#include <string.h>
+#include "TraceFormat.h"
+
+#define TRACE_UNIX_OFFSET     2208988800LL                              // Seconds from the NTP epoch (1900) to the Unix epoch (1970)
+
+/** Leelanau Software Company namespace
+*
+*/
+namespace lsc {
+
+/**
+ *   Bounds checked little endian reader over a snapshot.
+ */
+class TraceReader {
+  public:
+  TraceReader(const uint8_t* buf, size_t len) : _buf(buf), _len(len) {}
+  bool           ok()                          const           {return _ok;}
+  size_t         position()                    const           {return _pos;}
+  void           seek(size_t pos)                              {_pos = pos;}
+  uint64_t       get(int bytes)                                {uint64_t v = 0;if( !need(bytes) ) return 0;for( int i=bytes-1; i>=0; i-- ) v = (v<<8) | _buf[_pos+i];_pos += bytes;return v;}
+  const uint8_t* bytes(size_t n)                               {if( !need(n) ) return NULL;const uint8_t* p = _buf+_pos;_pos += n;return p;}
+
+  private:
+  bool           need(size_t n)                                {if( _len - _pos < n ) _ok = false;return _ok;}
+
+  const uint8_t* _buf;
+  size_t         _len;
+  size_t         _pos = 0;
+  bool           _ok  = true;
+};
+
+void TraceDecoder::clear() {
+  delete[] _events;
+  delete[] _anchors;
+  for( int i=0; i<TRACE_EVENTS; i++ ) {delete[] _names[i];_names[i] = NULL;}
+  _events      = NULL;
+  _anchors     = NULL;
+  _count       = 0;
+  _anchorCount = 0;
+}
+
+/**
+ *   Rings are read twice: once to validate and count, then to merge. Each ring is already in tick order, so the merge
+ *   repeatedly takes the earliest head among the rings, which keeps events of one thread in the order recorded.
+ */
+bool TraceDecoder::decode(const uint8_t* buf, size_t len) {
+  clear();
+  TraceReader in(buf,len);
+  if( (in.get(4) != TRACE_MAGIC) || (in.get(2) != TRACE_VERSION) ) return false;
+  uint16_t names   = in.get(2);
+  uint16_t anchors = in.get(2);
+  uint16_t rings   = in.get(2);
+  for( uint16_t i=0; (i<names) && in.ok(); i++ ) {
+    uint16_t       id    = in.get(2);
+    uint8_t        n     = in.get(1);
+    const uint8_t* bytes = in.bytes(n);
+    if( (bytes == NULL) || (id >= TRACE_EVENTS) ) continue;
+    delete[] _names[id];
+    _names[id] = new (std::nothrow) char[n+1];
+    if( _names[id] != NULL ) {memcpy(_names[id],bytes,n);_names[id][n] = '\0';}
+  }
+  if( anchors > 0 ) {
+    _anchors = new (std::nothrow) TraceAnchor[anchors];
+    if( _anchors == NULL ) return false;
+    for( uint16_t i=0; (i<anchors) && in.ok(); i++ ) {
+      TraceAnchor& a = _anchors[_anchorCount++];
+      a.tick         = in.get(8);
+      a.secs         = (int64_t)in.get(8);
+      a.fraction     = in.get(4);
+    }
+  }
+  size_t    start  = in.position();
+  uint32_t  total  = 0;
+  for( uint16_t i=0; (i<rings) && in.ok(); i++ ) {
+    uint32_t n = in.get(4);
+    total += n;
+    in.bytes((size_t)n*TRACE_EVENT_BYTES);
+  }
+  if( !in.ok() ) {clear();return false;}
+
+  size_t*   heads = new (std::nothrow) size_t[rings+1];
+  uint32_t* left  = new (std::nothrow) uint32_t[rings+1];
+  _events         = new (std::nothrow) TraceEvent[total+1];
+  if( (heads == NULL) || (left == NULL) || (_events == NULL) ) {delete[] heads;delete[] left;clear();return false;}
+  in.seek(start);
+  for( uint16_t i=0; i<rings; i++ ) {
+    left[i]  = in.get(4);
+    heads[i] = in.position();
+    in.bytes((size_t)left[i]*TRACE_EVENT_BYTES);
+  }
+  while( _count < total ) {
+    int      best     = -1;
+    uint64_t bestTick = 0;
+    for( uint16_t i=0; i<rings; i++ ) {
+      if( left[i] == 0 ) continue;
+      in.seek(heads[i]);
+      uint64_t tick = in.get(8);
+      if( (best < 0) || (tick < bestTick) ) {best = i;bestTick = tick;}
+    }
+    in.seek(heads[best]);
+    TraceEvent& e = _events[_count++];
+    e.tick   = in.get(8);
+    e.event  = in.get(2);
+    e.thread = in.get(2);
+    e.arg    = in.get(4);
+    heads[best] = in.position();
+    left[best]--;
+  }
+  delete[] heads;
+  delete[] left;
+  return true;
+}
+
+const char* TraceDecoder::name(uint16_t id) const {
+  return (((id<TRACE_EVENTS)&&(_names[id]!=NULL))?(_names[id]):("?"));
+}
+
+/**
+ *   As TickAnchor::toInstant(), the microseconds since the anchor are converted to a fraction rounded up, so a tick
+ *   prints back as the microsecond it was recorded at.
+ */
+bool TraceDecoder::utc(uint64_t tick, int64_t& secs, uint32_t& fraction) const {
+  if( _anchorCount == 0 ) return false;
+  uint16_t i = 0;
+  while( (i+1 < _anchorCount) && (_anchors[i+1].tick <= tick) ) i++;
+  int64_t  us  = (int64_t)(tick - _anchors[i].tick);
+  int64_t  s   = ((us<0)?(-((-us+999999)/1000000)):(us/1000000));
+  uint64_t f   = (uint64_t)_anchors[i].fraction + (((((uint64_t)(us - s*1000000))<<32) + 999999)/1000000);
+  secs         = _anchors[i].secs + s + (int64_t)(f>>32);
+  fraction     = (uint32_t)f;
+  return true;
+}
+
+/**
+ *   Civil date from days since 1970 (H. Hinnant's days_from_civil inverse); the fraction is truncated to microseconds,
+ *   as Instant::printISO() does, so the printed time never runs ahead into the next second.
+ */
+bool TraceDecoder::iso(uint64_t tick, char* buf, size_t len) const {
+  int64_t  secs;
+  uint32_t fraction;
+  if( !utc(tick,secs,fraction) ) return false;
+  int64_t  since = secs - TRACE_UNIX_OFFSET;
+  int64_t  days  = ((since<0)?(-((-since+86399)/86400)):(since/86400));
+  int64_t  sod   = since - days*86400;
+  int64_t  z     = days + 719468;
+  int64_t  era   = ((z>=0)?(z):(z-146096))/146097;
+  int64_t  doe   = z - era*146097;
+  int64_t  yoe   = (doe - doe/1460 + doe/36524 - doe/146096)/365;
+  int64_t  doy   = doe - (365*yoe + yoe/4 - yoe/100);
+  int64_t  mp    = (5*doy + 2)/153;
+  int      day   = (int)(doy - (153*mp + 2)/5 + 1);
+  int      month = (int)((mp<10)?(mp+3):(mp-9));
+  int      year  = (int)(yoe + era*400 + ((month<=2)?(1):(0)));
+  unsigned long part = (unsigned long)(((uint64_t)fraction*1000000)>>32);
+  snprintf(buf,len,"%04d-%02d-%02dT%02d:%02d:%02d.%06luZ",year,month,day,(int)(sod/3600),(int)((sod/60)%60),(int)(sod%60),part);
+  return true;
+}
+
+size_t TraceDecoder::formatText(uint32_t i, char* buf, size_t len) const {
+  const TraceEvent& e = _events[i];
+  char when[40] = "-";
+  iso(e.tick,when,sizeof(when));
+  int n = snprintf(buf,len,"%-27s %14llu %4u %-24s %lu\n",when,(unsigned long long)e.tick,e.thread,name(e.event),(unsigned long)e.arg);
+  return ((n<0)?(0):((size_t)n));
+}
+
+/**
+ *   Names are escaped for the characters JSON requires; control characters are dropped.
+ */
+size_t TraceDecoder::formatJSON(uint32_t i, char* buf, size_t len) const {
+  const TraceEvent& e = _events[i];
+  char   when[40];
+  char   escaped[2*255+1];
+  size_t k = 0;
+  for( const char* c = name(e.event); (*c != '\0') && (k+2 < sizeof(escaped)); c++ ) {
+    if( (*c == '"') || (*c == '\\') ) {escaped[k++] = '\\';escaped[k++] = *c;}
+    else if( (unsigned char)*c >= 0x20 ) escaped[k++] = *c;
+  }
+  escaped[k] = '\0';
+  int n;
+  if( iso(e.tick,when,sizeof(when)) ) n = snprintf(buf,len,"%s\n{\"utc\":\"%s\",",((i==0)?(""):(",")),when);
+  else n = snprintf(buf,len,"%s\n{\"utc\":null,",((i==0)?(""):(",")));
+  if( (n < 0) || ((size_t)n >= len) ) return ((n<0)?(0):((size_t)n));
+  int m = snprintf(buf+n,len-n,"\"tick\":%llu,\"thread\":%u,\"event\":\"%s\",\"arg\":%lu}",(unsigned long long)e.tick,e.thread,escaped,(unsigned long)e.arg);
+  return ((m<0)?((size_t)n):((size_t)(n+m)));
+}
+
+} // End of namespace lsc
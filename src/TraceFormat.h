@@ -0,0 +1,127 @@
+
+/**
+ *
+ *  SystemClock Library
+ *  Copyright (C) 2024  Daniel L Toth
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or any
+ *  later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *  The author can be contacted at dan@leelanausoftware.com
+ *
+ */
+
+#ifndef TRACE_FORMAT_H
+#define TRACE_FORMAT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define TRACE_EVENTS         64                                         // Event names a TraceBuffer can hold
+#define TRACE_MAGIC          0x5443534CUL                               // "LSCT" as a little endian 32-bit word
+#define TRACE_VERSION        1
+#define TRACE_HEADER_BYTES   12
+#define TRACE_ANCHOR_BYTES   20
+#define TRACE_EVENT_BYTES    16
+#define TRACE_LINE_SIZE      640                                        // Bytes of one printed event, long enough for an escaped 255 byte name
+
+/** Leelanau Software Company namespace
+*
+*/
+namespace lsc {
+
+/**
+ *   A TraceBuffer snapshot is a compact little endian binary stream:
+ *      [magic u32][version u16][names u16][anchors u16][rings u16]
+ *      names   - [id u16][length u8][bytes] each
+ *      anchors - [tick u64][seconds i64][fraction u32] each, in order taken; seconds and fraction are NTP time (since 1900)
+ *      rings   - [events u32] then [tick u64][event u16][thread u16][arg u32] per event, oldest first
+ *   This file has no dependency on Arduino or the rest of the library, so snapshots saved from a device can be decoded
+ *   on a host; see extras/TraceDecoder.
+ */
+
+/**
+ *   TraceEvent is the 16-byte record kept in a trace ring and in a snapshot: the monotonicMicros() tick it was recorded
+ *   at, the event id, the ring (thread) that recorded it, and a 32-bit argument.
+ */
+typedef struct TraceEvent {
+  uint64_t       tick;
+  uint16_t       event;
+  uint16_t       thread;
+  uint32_t       arg;
+} TraceEvent;
+
+/**
+ *   TraceAnchor pairs a tick with the UTC it was read at, as NTP seconds and 32-bit fraction.
+ */
+typedef struct TraceAnchor {
+  uint64_t       tick;
+  int64_t        secs;
+  uint32_t       fraction;
+} TraceAnchor;
+
+/**
+ *   TraceDecoder reads a TraceBuffer snapshot and prints its events merged across threads in tick order, each stamped
+ *   with the UTC time given by the latest anchor at or before it (the first anchor for events older than all anchors).
+ *   Events are printed with their tick alone if the snapshot has no anchors. printText() and printJSON() write to any
+ *   out with print(const char*), such as Serial, a File, or a FILE* wrapper on a host.
+ *   The following methods are supported:
+ *      bool      decode(const uint8_t* buf, size_t len)   // Parse a snapshot, false if it is malformed
+ *      uint32_t  size()                                   // Events decoded
+ *      const TraceEvent& at(uint32_t i)                   // Event i in tick order
+ *      const char* name(uint16_t id)                      // Event name, "?" if not in the snapshot
+ *      bool      utc(uint64_t tick, int64_t& secs, uint32_t& fraction)   // NTP time for tick, false if the snapshot has no anchors
+ *      size_t    formatText(uint32_t i, char* buf, size_t len)           // Event i as a line: UTC, tick, thread, name, argument
+ *      size_t    formatJSON(uint32_t i, char* buf, size_t len)           // Event i as a JSON object, preceded by a comma after the first
+ *      void      printText(Out& out)                      // One line per event
+ *      void      printJSON(Out& out)                      // JSON array of event objects
+ *
+ *   Example:
+ *   TraceDecoder d;
+ *   if( d.decode(buf,len) ) d.printJSON(Serial);
+ */
+class TraceDecoder {
+  public:
+  TraceDecoder()                                               {}
+  ~TraceDecoder()                                              {clear();}
+
+  bool               decode(const uint8_t* buf, size_t len);
+  uint32_t           size()                    const           {return _count;}
+  const TraceEvent&  at(uint32_t i)            const           {return _events[i];}
+  const char*        name(uint16_t id)         const;
+  bool               utc(uint64_t tick, int64_t& secs, uint32_t& fraction) const;
+  size_t             formatText(uint32_t i, char* buf, size_t len) const;
+  size_t             formatJSON(uint32_t i, char* buf, size_t len) const;
+
+  template<class Out>
+  void               printText(Out& out)       const           {char line[TRACE_LINE_SIZE];for( uint32_t i=0; i<_count; i++ ) {formatText(i,line,sizeof(line));out.print(line);}}
+  template<class Out>
+  void               printJSON(Out& out)       const           {char line[TRACE_LINE_SIZE];out.print("[");for( uint32_t i=0; i<_count; i++ ) {formatJSON(i,line,sizeof(line));out.print(line);}out.print("\n]\n");}
+
+  private:
+  TraceDecoder(const TraceDecoder&)            = delete;
+  TraceDecoder& operator=(const TraceDecoder&) = delete;
+
+  void               clear();
+  bool               iso(uint64_t tick, char* buf, size_t len) const;   // ISO 8601 UTC for tick, false if no anchors
+
+  TraceEvent*        _events     = NULL;
+  uint32_t           _count      = 0;
+  TraceAnchor*       _anchors    = NULL;
+  uint16_t           _anchorCount = 0;
+  char*              _names[TRACE_EVENTS] = {};
+};
+
+} // End of namespace lsc
+
+#endif
@@ -0,0 +1,166 @@
+/**
+ *
+ *  SystemClock Library
+ *  Copyright (C) 2024  Daniel L Toth
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or any
+ *  later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *  The author can be contacted at dan@leelanausoftware.com
+ *
+ */
+
+#include "UniqueID.h"
+#if !defined(ESP8266) && !defined(ESP32)
+#include <random>
+#endif
+
+/** Leelanau Software Company namespace
+*
+*/
+namespace lsc {
+
+/**
+ *   32 bits from the hardware random number generator where one exists
+ */
+static uint32_t hardwareRandom() {
+#ifdef ESP32
+  return esp_random();
+#elif defined(ESP8266)
+  return RANDOM_REG32;
+#else
+  static std::random_device rd;
+  return rd();
+#endif
+}
+
+uint64_t IDClock::unixMillis() {
+  unsigned long current = LSC_MILLIS();
+  if( !_valid || (((uint32_t)(current - _baseMillis)) >= ID_RESYNC_MILLIS) ) {
+    _base       = toUnixMillis(_clock.peekTime());
+    _baseMillis = current;
+    _valid      = true;
+  }
+  uint64_t result = _base + (uint32_t)(current - _baseMillis);
+  if( result < _last ) result = _last;      // Clock stepped backward, hold until it catches up
+  _last = result;
+  return result;
+}
+
+/**
+ *   Claims the lowest free slot.
+ */
+int SnowflakeFactory::claimSlot() {
+  uint16_t used = _slots.load(std::memory_order_relaxed);
+  for( ;; ) {
+    int slot = 0;
+    while( (slot < (1<<SNOWFLAKE_THREAD_BITS)) && (used & (1U<<slot)) ) slot++;
+    if( slot == (1<<SNOWFLAKE_THREAD_BITS) ) return SNOWFLAKE_NO_SLOT;
+    if( _slots.compare_exchange_weak(used,(uint16_t)(used|(1U<<slot)),std::memory_order_acquire,std::memory_order_relaxed) ) return slot;
+  }
+}
+
+/**
+ *   The high-water mark is written before the slot bit is cleared, so the acquire in claimSlot() makes it visible to the
+ *   next generator on the slot. Only the holder of a slot writes its mark.
+ */
+void SnowflakeFactory::releaseSlot(int slot, uint64_t ms) {
+  if( (slot<0) || (slot>=(1<<SNOWFLAKE_THREAD_BITS)) ) return;
+  if( ms > _highWater[slot].load(std::memory_order_relaxed) ) _highWater[slot].store(ms,std::memory_order_relaxed);
+  _slots.fetch_and((uint16_t)~(1U<<slot),std::memory_order_release);
+}
+
+/**
+ *   A generator on a reused slot starts at the slot's high-water millisecond with its sequence exhausted, so its first ID
+ *   is in a later millisecond than any the slot has issued, and its IDClock holds at least there.
+ */
+SnowflakeGenerator::SnowflakeGenerator(SnowflakeFactory& f) : _factory(f), _time(f.clock()), _slot(f.claimSlot()) {
+  _prefix   = ((uint64_t)f.node()<<(SNOWFLAKE_THREAD_BITS+SNOWFLAKE_SEQUENCE_BITS)) | ((uint64_t)_slot<<SNOWFLAKE_SEQUENCE_BITS);
+  _millis   = f.slotMillis(_slot);
+  _sequence = (1UL<<SNOWFLAKE_SEQUENCE_BITS) - 1;
+  _time.advance(_millis);
+}
+
+uint64_t SnowflakeGenerator::next() {
+  if( !valid() ) return SNOWFLAKE_INVALID_ID;
+  uint64_t ms = _time.unixMillis();
+  if( ms > _millis ) {
+    _millis   = ms;
+    _sequence = 0;
+  }
+  else if( ++_sequence >= (1UL<<SNOWFLAKE_SEQUENCE_BITS) ) {
+    _millis++;                              // Sequence exhausted, borrow the next millisecond
+    _sequence = 0;
+    _time.advance(_millis);
+  }
+  uint64_t elapsed = ((_millis>SNOWFLAKE_EPOCH)?(_millis-SNOWFLAKE_EPOCH):(0));
+  return (elapsed<<(SNOWFLAKE_NODE_BITS+SNOWFLAKE_THREAD_BITS+SNOWFLAKE_SEQUENCE_BITS)) | _prefix | _sequence;
+}
+
+void UUID::toString(char buffer[], unsigned int buffLen) const {
+  static const char hex[] = "0123456789abcdef";
+  if( buffLen < 37 ) {if(buffLen > 0) buffer[0] = '\0';return;}
+  int j = 0;
+  for( int i=0; i<16; i++ ) {
+    if( (i==4) || (i==6) || (i==8) || (i==10) ) buffer[j++] = '-';
+    buffer[j++] = hex[bytes[i]>>4];
+    buffer[j++] = hex[bytes[i]&0x0F];
+  }
+  buffer[j] = '\0';
+}
+
+UUIDv7Generator::UUIDv7Generator(SystemClock& c) : _time(c) {
+  _state[0] = ((uint64_t)hardwareRandom()<<32) | hardwareRandom();
+  _state[1] = ((uint64_t)hardwareRandom()<<32) | hardwareRandom();
+  if( (_state[0]|_state[1]) == 0 ) _state[1] = 1;
+}
+
+uint64_t UUIDv7Generator::random64() {
+  uint64_t s1 = _state[0];
+  const uint64_t s0 = _state[1];
+  _state[0] = s0;
+  s1 ^= s1 << 23;
+  _state[1] = s1 ^ s0 ^ (s1 >> 17) ^ (s0 >> 26);
+  return _state[1] + s0;
+}
+
+UUID UUIDv7Generator::next() {
+  uint64_t ms  = _time.unixMillis();
+  uint64_t rnd = random64();
+  if( ms > _millis ) {
+    _millis  = ms;
+    _counter = (uint16_t)(rnd>>52) & 0x07FF;      // Random seed with the top counter bit clear
+  }
+  else if( ++_counter > 0x0FFF ) {
+    _millis++;                                    // Counter exhausted, borrow the next millisecond
+    _counter = 0;
+    _time.advance(_millis);
+  }
+
+  UUID result;
+  for( int i=0; i<6; i++ ) result.bytes[i] = (uint8_t)(_millis>>(40-8*i));
+  result.bytes[6] = 0x70 | (uint8_t)(_counter>>8);
+  result.bytes[7] = (uint8_t)_counter;
+  uint64_t low = random64();
+  result.bytes[8] = 0x80 | (uint8_t)((low>>56)&0x3F);
+  for( int i=9; i<16; i++ ) result.bytes[i] = (uint8_t)(low>>(8*(15-i)));
+  return result;
+}
+
+uint64_t UUIDv7Generator::unixMillis(const UUID& id) {
+  uint64_t result = 0;
+  for( int i=0; i<6; i++ ) result = (result<<8) | id.bytes[i];
+  return result;
+}
+
+} // End of namespace lsc
@@ -0,0 +1,189 @@
+
+/**
+ *
+ *  SystemClock Library
+ *  Copyright (C) 2024  Daniel L Toth
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or any
+ *  later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *  The author can be contacted at dan@leelanausoftware.com
+ *
+ */
+
+#ifndef UNIQUE_ID_H
+#define UNIQUE_ID_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "SystemClock.h"
+
+#define SNOWFLAKE_NODE_BITS      6                     // Node (device) bits of a Snowflake ID
+#define SNOWFLAKE_THREAD_BITS    4                     // Generator (thread) bits of a Snowflake ID
+#define SNOWFLAKE_SEQUENCE_BITS  12                    // Per millisecond sequence bits of a Snowflake ID
+#define SNOWFLAKE_NO_SLOT        -1                    // Returned by claimSlot() when every generator slot is taken
+#define SNOWFLAKE_INVALID_ID     0ULL                  // Returned by next() of a generator without a slot
+#define SNOWFLAKE_EPOCH          1704067200000ULL      // Jan 1, 2024 00:00:00 UTC in Unix milliseconds
+#define UNIX_EPOCH_SECS          2208988800LL          // Seconds from the Prime epoch (Jan 1, 1900) to the Unix epoch (Jan 1, 1970)
+#define ID_RESYNC_MILLIS         1000UL                // Interval in milliseconds a generator re-reads SystemClock
+
+/** Leelanau Software Company namespace
+*
+*/
+namespace lsc {
+
+/**
+ *   IDClock converts SystemClock time into Unix milliseconds for ID generation. Reading SystemClock for every ID is too
+ *   expensive at high rates, so IDClock takes a reference from SystemClock::peekTime() and extrapolates with millis(),
+ *   refreshing the reference every ID_RESYNC_MILLIS. Time returned never runs backward: if SystemClock steps backward
+ *   after an NTP synchronization, IDClock holds at the last value issued until real time catches up.
+ *   peekTime() is safe from any thread (see SystemClock), so each thread may keep its own IDClock on a shared SystemClock.
+ */
+class IDClock {
+  public:
+  IDClock(SystemClock& c) : _clock(c)                          {}
+
+  uint64_t       unixMillis();                                 // Current Unix milliseconds, never decreasing
+  uint64_t       last()              const                     {return _last;}
+  void           advance(uint64_t ms)                          {if(ms > _last) _last = ms;}
+
+  static uint64_t toUnixMillis(const Instant& t)               {return (uint64_t)((t.secs()-UNIX_EPOCH_SECS)*1000) + (((uint64_t)t.fraction()*1000)>>32);}
+
+  private:
+  SystemClock&   _clock;
+  uint64_t       _base      = 0;                               // Unix milliseconds at _baseMillis
+  unsigned long  _baseMillis = 0;                              // millis() of the last SystemClock read
+  uint64_t       _last      = 0;                               // Last Unix milliseconds returned
+  bool           _valid     = false;
+};
+
+/**
+ *   SnowflakeFactory is the shared half of a Snowflake ID scheme, holding the node ID and handing out generator slots.
+ *   Each thread creates its own SnowflakeGenerator from the factory, so IDs are produced without any shared state.
+ *   A Snowflake ID is a 63-bit positive integer laid out as:
+ *      [41 bit milliseconds since SNOWFLAKE_EPOCH][6 bit node][4 bit generator slot][12 bit sequence]
+ *   giving 69 years of IDs and 4096 IDs per millisecond per generator. IDs from a generator are strictly increasing, and
+ *   IDs from different generators on different nodes never collide, since each live generator holds its own slot.
+ *   The following methods are supported:
+ *      int       claimSlot()                         // Take a free generator slot, SNOWFLAKE_NO_SLOT if all 16 are taken
+ *      void      releaseSlot(int slot, uint64_t ms)  // Return a slot and the last millisecond it issued, done by ~SnowflakeGenerator()
+ *      uint64_t  slotMillis(int slot)                // Highest millisecond issued from a slot by released generators
+ *      uint16_t  slotsInUse()                        // Bit mask of slots taken
+ *
+ *   Slots are a bit mask in one atomic, so claiming and releasing are lock-free. A released slot may be claimed again at
+ *   once. Since a generator borrowing milliseconds during a burst can run ahead of the clock, the factory keeps the
+ *   highest millisecond each slot has issued, and a new generator on the slot starts after it, so it cannot repeat an
+ *   ID of an earlier one however soon it is created or however the clock has stepped.
+ */
+class SnowflakeFactory {
+  public:
+  SnowflakeFactory(SystemClock& c, uint16_t node) : _clock(c)  {_node = node & ((1<<SNOWFLAKE_NODE_BITS)-1);}
+
+  SystemClock&   clock()                                       {return _clock;}
+  uint16_t       node()              const                     {return _node;}
+  int            claimSlot();
+  void           releaseSlot(int slot, uint64_t ms = 0);
+  uint64_t       slotMillis(int slot) const                    {return (((slot>=0) && (slot<(1<<SNOWFLAKE_THREAD_BITS)))?(_highWater[slot].load(std::memory_order_relaxed)):(0));}
+  uint16_t       slotsInUse()        const                     {return _slots.load(std::memory_order_relaxed);}
+
+  private:
+  SystemClock&           _clock;
+  uint16_t               _node;
+  std::atomic<uint16_t>  _slots{0};                            // Bit i set while slot i is claimed
+  std::atomic<uint64_t>  _highWater[1<<SNOWFLAKE_THREAD_BITS] = {};  // Highest Unix milliseconds issued from each slot
+};
+
+/**
+ *   SnowflakeGenerator produces Snowflake IDs for a single thread, holding a slot of its factory for its lifetime. A
+ *   seventeenth live generator of one factory gets no slot: valid() is false and next() returns SNOWFLAKE_INVALID_ID.
+ *   The following methods are supported:
+ *      uint64_t  next()                        // Next ID, SNOWFLAKE_INVALID_ID if the generator has no slot
+ *      bool      valid()                       // True if the generator holds a slot
+ *      static uint64_t  unixMillis(uint64_t)   // Unix milliseconds encoded in an ID
+ *
+ *   Example:
+ *      SystemClock        c;
+ *      SnowflakeFactory   ids(c,17);                  // Node 17
+ *      ...
+ *      thread_local SnowflakeGenerator gen(ids);       // One generator per thread
+ *      uint64_t id = gen.next();
+ *
+ *   Note:
+ *      If the 4096 IDs of a millisecond are exhausted, the generator borrows the next millisecond rather than waiting, so
+ *      issued time may briefly lead the clock by a few milliseconds during bursts. A generator taking over a released
+ *      slot likewise starts in the millisecond after the last one the slot issued, even if the clock has not reached it.
+ */
+class SnowflakeGenerator {
+  public:
+  SnowflakeGenerator(SnowflakeFactory& f);
+  ~SnowflakeGenerator()                                        {_factory.releaseSlot(_slot,_millis);}
+  SnowflakeGenerator(const SnowflakeGenerator&) = delete;
+  SnowflakeGenerator& operator=(const SnowflakeGenerator&) = delete;
+
+  uint64_t        next();
+  bool            valid()            const                     {return _slot != SNOWFLAKE_NO_SLOT;}
+
+  static uint64_t unixMillis(uint64_t id)                      {return (id>>(SNOWFLAKE_NODE_BITS+SNOWFLAKE_THREAD_BITS+SNOWFLAKE_SEQUENCE_BITS)) + SNOWFLAKE_EPOCH;}
+
+  private:
+  SnowflakeFactory& _factory;
+  IDClock         _time;
+  int             _slot;
+  uint64_t        _prefix;                                     // Node and slot bits
+  uint64_t        _millis   = 0;                               // Unix milliseconds of the last ID
+  uint32_t        _sequence = 0;
+};
+
+/**
+ *   UUID is a 128-bit universally unique identifier stored in network byte order.
+ */
+typedef struct UUID {
+  uint8_t        bytes[16];
+  void           toString(char buffer[], unsigned int buffLen) const;   // Format as 8-4-4-4-12 lower case hex, buffLen >= 37
+  bool operator==(const UUID& rhs) const                                {return memcmp(bytes,rhs.bytes,16)==0;}
+  bool operator!=(const UUID& rhs) const                                {return !(*this==rhs);}
+} UUID;
+
+/**
+ *   UUIDv7Generator produces RFC 9562 version 7 UUIDs for a single thread, laid out as:
+ *      [48 bit Unix milliseconds][4 bit version 7][12 bit counter][2 bit variant][62 bit random]
+ *   The 12-bit rand_a field is used as a dedicated counter (RFC 9562 Section 6.2, Method 1), seeded randomly each
+ *   millisecond with the top bit clear, so UUIDs from one generator sort in the order issued. Uniqueness across threads
+ *   and devices comes from the 62 random bits, drawn from a xorshift generator seeded from the hardware random number
+ *   generator. As with SnowflakeGenerator, counter exhaustion borrows the next millisecond.
+ *
+ *   Example:
+ *      thread_local UUIDv7Generator gen(c);
+ *      char buff[37];
+ *      gen.next().toString(buff,sizeof(buff));
+ */
+class UUIDv7Generator {
+  public:
+  UUIDv7Generator(SystemClock& c);
+
+  UUID            next();
+
+  static uint64_t unixMillis(const UUID& id);
+
+  private:
+  uint64_t        random64();
+
+  IDClock         _time;
+  uint64_t        _millis   = 0;
+  uint16_t        _counter  = 0;
+  uint64_t        _state[2];                                   // xorshift128+ state
+};
+
+} // End of namespace lsc
+
+#endif